@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "Bench.h"
+#include "Timing.h"
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                      Run plan                      **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+/********************************************************/
+/* Defaults: "size" bytes per run, ask after every run, */
+/* no report                                            */
+/********************************************************/
+void bench_init(Bench *bench, uint64_t size)
+{
+    memset(bench, 0, sizeof(*bench));
+    bench->size = size;
+    bench->interactive = true;
+    pthread_mutex_init(&bench->lock, NULL);
+}
+
+/********************************************************/
+/* Parse a byte count with an optional K, M, G or T     */
+/* (binary) suffix. Returns 0 on success, -1 if it is   */
+/* malformed or out of range                            */
+/********************************************************/
+int bench_parse_size(const char *text, uint64_t *size)
+{
+    char *end;
+    unsigned long long value = strtoull(text, &end, 0);
+    if (end == text)
+        return -1;
+
+    int shift;
+    switch (toupper((unsigned char)*end))
+    {
+        case 'T':   shift = 40;     end++;  break;
+        case 'G':   shift = 30;     end++;  break;
+        case 'M':   shift = 20;     end++;  break;
+        case 'K':   shift = 10;     end++;  break;
+        case '\0':  shift = 0;              break;
+        default:    return -1;
+    }
+    if (*end == 'B' || *end == 'b')
+        end++;
+    if (*end != '\0' || value == 0 || value > (BENCH_MAX_SIZE >> shift))     // Checked before shifting: a large value must not wrap
+        return -1;
+    *size = value << shift;
+    return 0;
+}
+
+/********************************************************/
+/* Apply a command-line flag if it is a benchmark one   */
+/* (-size, -runs, -warmup, -duration, -report, -format) */
+/* Returns 1 if it was applied, 0 if it is not a        */
+/* benchmark flag and -1 if its value is invalid        */
+/********************************************************/
+int bench_option(Bench *bench, const char *flag, const char *value)
+{
+    if (strcmp(flag, "-size") == 0)
+    {
+        if (bench_parse_size(value, &bench->size) < 0)
+        {
+            fprintf(stderr, "Invalid size '%s' (bytes, with an optional K, M, G or T suffix, up to 1T)\n", value);
+            return -1;
+        }
+    }
+    else if (strcmp(flag, "-runs") == 0)
+    {
+        bench->runs = atoi(value);
+        if (bench->runs < 1)
+        {
+            fprintf(stderr, "The number of runs must be at least 1\n");
+            return -1;
+        }
+        bench->interactive = false;
+    }
+    else if (strcmp(flag, "-warmup") == 0)
+    {
+        bench->warmup = atoi(value);
+        if (bench->warmup < 0)
+        {
+            fprintf(stderr, "The number of warm-up runs cannot be negative\n");
+            return -1;
+        }
+    }
+    else if (strcmp(flag, "-duration") == 0)
+    {
+        bench->duration = atof(value);
+        if (bench->duration <= 0)
+        {
+            fprintf(stderr, "The duration must be a positive number of seconds\n");
+            return -1;
+        }
+        bench->interactive = false;
+    }
+    else if (strcmp(flag, "-report") == 0)
+    {
+        bench->reportPath = value;
+    }
+    else if (strcmp(flag, "-format") == 0)
+    {
+        if (strcmp(value, "json") == 0)         bench->json = true;
+        else if (strcmp(value, "csv") == 0)     bench->json = false;
+        else
+        {
+            fprintf(stderr, "Unknown report format '%s' (available: csv, json)\n", value);
+            return -1;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+/********************************************************/
+/* Whether run "run" (1-based) is a warm-up run         */
+/********************************************************/
+bool bench_is_warmup(const Bench *bench, int run)
+{
+    return run <= bench->warmup;
+}
+
+/********************************************************/
+/* A run starts: the first measured one starts the      */
+/* -duration clock                                      */
+/********************************************************/
+void bench_run_started(Bench *bench, int run)
+{
+    if (!bench->measuring && !bench_is_warmup(bench, run))
+    {
+        bench->measureStart = timing_now_ns();
+        bench->measuring = true;
+    }
+}
+
+/********************************************************/
+/* Non-interactive plan: whether another run follows    */
+/* the "done" runs completed so far (warm-up included)  */
+/* The run ends at -runs measured runs or at -duration, */
+/* whichever comes first                                */
+/********************************************************/
+bool bench_next(Bench *bench, int done)
+{
+    if (done < bench->warmup)
+        return true;
+    if (bench->runs > 0 && done - bench->warmup >= bench->runs)
+        return false;
+    if (bench->duration > 0 && bench->measuring && timing_ms(bench->measureStart, timing_now_ns()) >= bench->duration * 1000)
+        return false;
+    return !bench->interactive;
+}
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                       Report                       **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+/********************************************************/
+/* Open the -report file, if any (a CSV report starts   */
+/* with its header). Returns 0 on success, -1 on error  */
+/********************************************************/
+int bench_open(Bench *bench)
+{
+    if (bench->reportPath == NULL)
+        return 0;
+    bench->report = fopen(bench->reportPath, "w");
+    if (bench->report == NULL)
+    {
+        perror("Failed to open the report");
+        return -1;
+    }
+    if (!bench->json)
+        fprintf(bench->report, "role,protocol,variant,connection,run,warmup,bytes,ms,mbit_s,rtt_ms,rtt_p50_ms,rtt_p99_ms,segments,retransmissions,syscalls,cpu_ms\n");
+    fflush(bench->report);
+    return 0;
+}
+
+/********************************************************/
+/* Write a counter, or the format's "unknown" value     */
+/********************************************************/
+static void bench_write_long(FILE *out, bool json, long value)
+{
+    if (value >= 0)     fprintf(out, "%ld", value);
+    else if (json)      fputs("null", out);
+}
+
+static void bench_write_double(FILE *out, bool json, double value)
+{
+    if (value >= 0)     fprintf(out, "%.3f", value);
+    else if (json)      fputs("null", out);
+}
+
+/********************************************************/
+/* Append one run to the report (no-op without one)     */
+/********************************************************/
+void bench_record(Bench *bench, const Bench_Record *record)
+{
+    if (bench->report == NULL)
+        return;
+    double mbits = record->ms > 0 ? record->bytes * 8.0 / 1e6 / (record->ms / 1000.0) : 0.0;
+    const char *variant = record->variant ? record->variant : "";
+    const char *separator = bench->json ? ", " : ",";
+
+    pthread_mutex_lock(&bench->lock);
+    FILE *out = bench->report;
+    if (bench->json)
+        fprintf(out, "{\"role\": \"%s\", \"protocol\": \"%s\", \"variant\": \"%s\", \"connection\": %d, \"run\": %d, \"warmup\": %s, "
+                     "\"bytes\": %llu, \"ms\": %.3f, \"mbit_s\": %.3f, \"rtt_ms\": ",
+                record->role, record->protocol, variant, record->connection, record->run, record->warmup ? "true" : "false",
+                (unsigned long long)record->bytes, record->ms, mbits);
+    else
+        fprintf(out, "%s,%s,%s,%d,%d,%d,%llu,%.3f,%.3f,", record->role, record->protocol, variant, record->connection,
+                record->run, record->warmup, (unsigned long long)record->bytes, record->ms, mbits);
+    bench_write_double(out, bench->json, record->rttMs);
+    fprintf(out, "%s%s", separator, bench->json ? "\"rtt_p50_ms\": " : "");
+    bench_write_double(out, bench->json, record->rttP50Ms);
+    fprintf(out, "%s%s", separator, bench->json ? "\"rtt_p99_ms\": " : "");
+    bench_write_double(out, bench->json, record->rttP99Ms);
+    fprintf(out, "%s%s", separator, bench->json ? "\"segments\": " : "");
+    bench_write_long(out, bench->json, record->segments);
+    fprintf(out, "%s%s", separator, bench->json ? "\"retransmissions\": " : "");
+    bench_write_long(out, bench->json, record->retransmissions);
+    fprintf(out, "%s%s", separator, bench->json ? "\"syscalls\": " : "");
+    bench_write_long(out, bench->json, record->syscalls);
+    fprintf(out, "%s%s", separator, bench->json ? "\"cpu_ms\": " : "");
+    bench_write_double(out, bench->json, record->cpuMs);
+    fputs(bench->json ? "}\n" : "\n", out);
+    fflush(out);                        // Every run is visible to the collector at once
+    pthread_mutex_unlock(&bench->lock);
+}
+
+/********************************************************/
+/* Close the report                                     */
+/********************************************************/
+void bench_close(Bench *bench)
+{
+    if (bench->report)
+        fclose(bench->report);
+    bench->report = NULL;
+    pthread_mutex_destroy(&bench->lock);
+}
@@ -0,0 +1,67 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/*
+ * Non-interactive benchmark mode shared by the four programs. A sender given
+ * -runs or -duration no longer asks "send again?" after every run: it sends
+ * -warmup unreported runs, then -runs measured runs and/or runs until
+ * -duration seconds have passed. -size sets the bytes of every run (K, M and
+ * G suffixes, up to many GB). With -report FILE every run becomes one record
+ * in FILE - CSV with a header line, or JSON Lines (one object per run) when
+ * -format json is given - so sender and receiver results can be collected by
+ * scripts. Records are written and flushed under a lock, so the receivers'
+ * worker threads may share one report.
+ */
+
+#define BENCH_MAX_SIZE (1ULL << 40)     // Largest run size accepted by -size (1 TB)
+
+// What a program does between runs and where its results go
+typedef struct {
+    uint64_t size;                      // Bytes per run (-size)
+    int warmup;                         // Runs before the measured ones, not reported as measured (-warmup)
+    int runs;                           // Measured runs (-runs; 0 = no limit)
+    double duration;                    // Seconds of measured runs (-duration; 0 = no limit)
+    bool interactive;                   // Neither -runs nor -duration: ask after every run
+    const char *reportPath;             // -report
+    bool json;                          // -format json (JSON Lines) instead of CSV
+    FILE *report;                       // Open report (NULL: none)
+    pthread_mutex_t lock;               // Serializes the records of several threads
+    uint64_t measureStart;              // Start of the first measured run (timing_now_ns)
+    bool measuring;                     // Set once the first measured run started
+} Bench;
+
+// One run, as seen by a sender or a receiver; negative counters are "not measured"
+typedef struct {
+    const char *role;                   // "sender" or "receiver"
+    const char *protocol;               // "tcp" or "rudp"
+    const char *variant;                // Congestion control, send path, ... (free text)
+    int connection;                     // Connection (or session) number, 1 on the senders
+    int run;                            // Run number within the connection (warm-up runs included)
+    bool warmup;                        // A warm-up run
+    uint64_t bytes;                     // Payload bytes of the run
+    double ms;                          // Duration of the run
+    double rttMs;                       // Smoothed RTT at the end of the run (-1 if unknown)
+    double rttP50Ms;                    // Median per-segment RTT of the run (-1 if unknown)
+    double rttP99Ms;                    // 99th percentile per-segment RTT of the run (-1 if unknown)
+    long segments;                      // Segments (or send calls) of the run (-1 if unknown)
+    long retransmissions;               // Retransmitted segments of the run (-1 if unknown)
+    long syscalls;                      // Data-path system calls of the run (-1 if unknown)
+    double cpuMs;                       // CPU time (user + system) of the run (-1 if unknown)
+} Bench_Record;
+
+void bench_init(Bench *bench, uint64_t size);
+int bench_option(Bench *bench, const char *flag, const char *value);
+int bench_parse_size(const char *text, uint64_t *size);
+int bench_open(Bench *bench);
+bool bench_is_warmup(const Bench *bench, int run);
+void bench_run_started(Bench *bench, int run);
+bool bench_next(Bench *bench, int done);
+void bench_record(Bench *bench, const Bench_Record *record);
+void bench_close(Bench *bench);
+
+#endif
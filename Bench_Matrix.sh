@@ -0,0 +1,169 @@
+#!/bin/bash
+#
+# Benchmark matrix: runs every protocol x congestion control x payload size x
+# impairment profile on loopback, each cell as a fresh receiver/sender pair
+# (behind Impairment_Proxy unless the profile is "clean"), and collects the
+# cells' -report files into one summary table. Started by "make MATRIX"; every
+# knob below can be overridden from the environment or the make command line:
+#
+#     make MATRIX PROTOCOLS=rudp RUDP_ALGOS="reno cubic" SIZES="2M 16M" PROFILES="clean loss" RUNS=5
+#
+# Results go to $OUT: per cell the sender's and receiver's CSV reports and
+# logs, summary.csv with one line per cell, and summary.txt, the table printed
+# at the end.
+
+PROTOCOLS=${PROTOCOLS:-"tcp rudp"}
+TCP_ALGOS=${TCP_ALGOS:-"reno cubic"}
+RUDP_ALGOS=${RUDP_ALGOS:-"none reno cubic"}
+SIZES=${SIZES:-"1M 8M"}
+PROFILES=${PROFILES:-"clean delay loss burst slow"}
+RUNS=${RUNS:-3}                     # Measured runs per cell
+WARMUP=${WARMUP:-1}                 # Warm-up runs per cell (left out of the summary)
+RUDP_WINDOW=${RUDP_WINDOW:-64}      # Sliding window of the RUDP sender
+SEED=${SEED:-1}                     # Payload and impairment seed, the same for every cell
+PORT=${PORT:-30000}                 # First port; every cell takes the next two
+CELL_TIMEOUT=${CELL_TIMEOUT:-300}   # Seconds before a cell is given up
+OUT=${OUT:-Matrix_Results}
+
+cd "$(dirname "$0")" || exit 1
+mkdir -p "$OUT"
+
+# Impairment_Proxy options of a profile
+profile_flags()
+{
+    case $1 in
+        clean)  echo "" ;;
+        delay)  echo "-delay 1 -jitter 0.2" ;;
+        loss)   echo "-loss 1 -delay 1" ;;
+        burst)  echo "-burst 1:25 -delay 1" ;;
+        slow)   echo "-rate 100 -delay 5" ;;
+        *)      return 1 ;;
+    esac
+}
+
+# The TCP proxy relays byte streams: profiles that drop, reorder or alter packets do not apply to TCP
+tcp_profile()
+{
+    case " $1 " in
+        *" -loss "*|*" -burst "*|*" -reorder "*|*" -dup "*|*" -corrupt "*) return 1 ;;
+    esac
+    return 0
+}
+
+# Mean of a report column over the measured runs ("-" when it is empty)
+column_mean()
+{
+    awk -F, -v name="$2" '
+        NR == 1 { for (i = 1; i <= NF; i++) if ($i == name) col = i; next }
+        col && $6 == 0 && $col != "" { sum += $col; n++ }
+        END { if (n) printf "%.3f", sum / n; else printf "-" }' "$1" 2>/dev/null || echo "-"
+}
+
+# Sum of a report column over the measured runs
+column_sum()
+{
+    awk -F, -v name="$2" '
+        NR == 1 { for (i = 1; i <= NF; i++) if ($i == name) col = i; next }
+        col && $6 == 0 && $col != "" { sum += $col; n++ }
+        END { if (n) printf "%d", sum; else printf "-" }' "$1" 2>/dev/null || echo "-"
+}
+
+# Run one cell; prints its summary line
+run_cell()
+{
+    local proto=$1 algo=$2 size=$3 profile=$4
+    local cell="${proto}_${algo}_${size}_${profile}"
+    local flags
+    flags=$(profile_flags "$profile") || { echo "Unknown profile '$profile'" >&2; return 1; }
+
+    if [ "$proto" = tcp ] && ! tcp_profile "$flags"; then
+        echo "$proto,$algo,$size,$profile,0,-,-,-,-,-,-,-,-,n/a"
+        return 0
+    fi
+
+    local receiver_port=$PORT sender_port=$PORT
+    local proxy_port=$((PORT + 1))
+    PORT=$((PORT + 2))
+    rm -f "$OUT/$cell".*
+
+    # The receiver serves one sender, then exits
+    if [ "$proto" = tcp ]; then
+        timeout "$CELL_TIMEOUT" ./TCP_Receiver -p "$receiver_port" -algo "$algo" -clients 1 -seed "$SEED" -warmup "$WARMUP" \
+            -report "$OUT/$cell.recv.csv" > "$OUT/$cell.recv.log" 2>&1 &
+    else
+        timeout "$CELL_TIMEOUT" ./RUDP_Receiver -p "$receiver_port" -clients 1 -seed "$SEED" -warmup "$WARMUP" \
+            -report "$OUT/$cell.recv.csv" > "$OUT/$cell.recv.log" 2>&1 &
+    fi
+    local receiver=$!
+
+    local proxy=
+    if [ -n "$flags" ]; then
+        local mode=udp
+        [ "$proto" = tcp ] && mode=tcp
+        ./Impairment_Proxy -mode "$mode" -p "$proxy_port" -ip 127.0.0.1 -dp "$receiver_port" $flags -seed "$SEED" > "$OUT/$cell.proxy.log" 2>&1 &
+        proxy=$!
+        sender_port=$proxy_port
+    fi
+    sleep 0.5                       # Let both bind their ports
+
+    local status=ok
+    if [ -n "$proxy" ] && ! kill -0 "$proxy" 2>/dev/null; then
+        echo "The proxy of $cell did not start (see $OUT/$cell.proxy.log)" >&2
+        kill "$receiver" 2>/dev/null
+        wait "$receiver"
+        echo "$proto,$algo,$size,$profile,0,-,-,-,-,-,-,-,-,failed"
+        return 0
+    fi
+    if [ "$proto" = tcp ]; then
+        timeout "$CELL_TIMEOUT" ./TCP_Sender -ip 127.0.0.1 -p "$sender_port" -algo "$algo" -size "$size" -runs "$RUNS" -warmup "$WARMUP" \
+            -seed "$SEED" -report "$OUT/$cell.send.csv" > "$OUT/$cell.send.log" 2>&1 < /dev/null || status=failed
+    else
+        timeout "$CELL_TIMEOUT" ./RUDP_Sender -ip 127.0.0.1 -p "$sender_port" -w "$RUDP_WINDOW" -algo "$algo" -size "$size" -runs "$RUNS" \
+            -warmup "$WARMUP" -seed "$SEED" -report "$OUT/$cell.send.csv" > "$OUT/$cell.send.log" 2>&1 < /dev/null || status=failed
+    fi
+    wait "$receiver" || status=failed
+    grep -q "Files are not identical" "$OUT/$cell.recv.log" && status=failed
+    if [ -n "$proxy" ]; then
+        kill -INT "$proxy" 2>/dev/null  # The proxy prints its statistics on the way out
+        wait "$proxy"
+    fi
+
+    local send="$OUT/$cell.send.csv" recv="$OUT/$cell.recv.csv"
+    local runs
+    runs=$(awk -F, 'NR > 1 && $6 == 0' "$send" 2>/dev/null | wc -l)
+    echo "$proto,$algo,$size,$profile,$runs,$(column_mean "$send" mbit_s),$(column_mean "$recv" mbit_s),$(column_mean "$send" rtt_ms)," \
+         "$(column_mean "$send" rtt_p50_ms),$(column_mean "$send" rtt_p99_ms),$(column_sum "$send" retransmissions)," \
+         "$(column_mean "$send" cpu_ms),$(column_mean "$send" ms),$status" | tr -d ' '
+}
+
+summary="$OUT/summary.csv"
+echo "protocol,algo,size,profile,runs,send_mbit_s,recv_mbit_s,srtt_ms,rtt_p50_ms,rtt_p99_ms,retransmissions,cpu_ms,run_ms,status" > "$summary"
+
+for proto in $PROTOCOLS; do
+    if [ "$proto" = tcp ]; then
+        algos=$TCP_ALGOS
+    else
+        algos=$RUDP_ALGOS
+    fi
+    for algo in $algos; do
+        if [ "$proto" = tcp ] && ! grep -qw "$algo" /proc/sys/net/ipv4/tcp_available_congestion_control 2>/dev/null; then
+            echo "Skipping TCP '$algo': not available in this kernel" >&2
+            continue
+        fi
+        for size in $SIZES; do
+            for profile in $PROFILES; do
+                echo "[$(date +%H:%M:%S)] $proto / $algo / $size / $profile" >&2
+                run_cell "$proto" "$algo" "$size" "$profile" >> "$summary"
+            done
+        done
+    done
+done
+
+# Align the columns (two passes over the file: widths, then the rows)
+awk -F, 'NR == FNR { for (i = 1; i <= NF; i++) if (length($i) > w[i]) w[i] = length($i); next }
+         { for (i = 1; i < NF; i++) printf "%-*s  ", w[i], $i; print $NF }' "$summary" "$summary" > "$OUT/summary.txt"
+echo
+cat "$OUT/summary.txt"
+echo
+echo "Per-cell reports and logs: $OUT/ (summary: $summary)"
+! grep -q ",failed$" "$summary"
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>      // For __rdtsc
+#endif
+#include "RUDP_Checksum.h"
+
+#define BENCH_BUFFER_SIZE 65536     // Largest payload measured
+#define BENCH_BYTES (64L << 20)     // Bytes hashed per kernel and payload size
+
+/*
+ * Microbenchmark of the integrity check kernels: checks that every Internet
+ * checksum kernel matches the scalar one (and both CRC32C kernels agree),
+ * then reports bytes per cycle (TSC) and GB/s for payload sizes from a tiny
+ * ACK header up to a full GSO datagram.
+ */
+
+// A kernel measured by the benchmark
+typedef struct {
+    const char *name;
+    unsigned short int (*checksum)(const void *data, unsigned int bytes);
+    uint32_t (*crc32c)(uint32_t crc, const void *data, size_t bytes);
+} Bench_Kernel;
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                 Auxiliary functions                **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+/********************************************************/
+/* Read the cycle counter (0 where it is unavailable)   */
+/********************************************************/
+static unsigned long long bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/********************************************************/
+/* Read the monotonic clock in nanoseconds              */
+/********************************************************/
+static long long bench_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/********************************************************/
+/* Run one kernel over "size"-byte payloads and print   */
+/* its bytes per cycle and GB/s                         */
+/********************************************************/
+static void bench_kernel(const Bench_Kernel *kernel, const unsigned char *buffer, unsigned int size)
+{
+    long iterations = BENCH_BYTES / size;
+    volatile unsigned long sink = 0;        // Keeps the results alive
+
+    long long startNs = bench_ns();
+    unsigned long long startCycles = bench_cycles();
+    for (long i = 0; i < iterations; i++)
+    {
+        if (kernel->checksum)   sink += kernel->checksum(buffer, size);
+        else                    sink += kernel->crc32c(0, buffer, size);
+    }
+    unsigned long long cycles = bench_cycles() - startCycles;
+    long long ns = bench_ns() - startNs;
+
+    double bytes = (double)iterations * size;
+    printf("%-18s %8u %14.3f %12.3f\n", kernel->name, size, cycles ? bytes / cycles : 0.0, bytes / ns);
+    (void)sink;
+}
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                      Main Code                     **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+int main(void)
+{
+    static const unsigned int sizes[] = {16, 64, 256, 1476, 4096, 16384, 65536};
+    static const Bench_Kernel kernels[] = {
+        {"inet-scalar", rudp_checksum_scalar, NULL},
+        {"inet-sse2", rudp_checksum_sse2, NULL},
+        {"inet-avx2", rudp_checksum_avx2, NULL},
+        {"crc32c-table", NULL, rudp_crc32c_sw},
+        {"crc32c-sse4.2", NULL, rudp_crc32c_hw},
+    };
+    const int numKernels = sizeof(kernels) / sizeof(kernels[0]);
+
+    unsigned char *buffer = malloc(BENCH_BUFFER_SIZE + 1);
+    if (buffer == NULL)
+    {
+        printf("ERROR: Failed to allocate the benchmark buffer!\n");
+        return 1;
+    }
+    srand(1);
+    for (int i = 0; i < BENCH_BUFFER_SIZE + 1; i++)
+        buffer[i] = rand() % 256;
+
+    // Every kernel must agree with the reference on all lengths and alignments
+    for (unsigned int size = 0; size <= 2048; size++)
+    {
+        for (int offset = 0; offset < 2; offset++)
+        {
+            const unsigned char *data = buffer + offset;
+            unsigned short int expected = rudp_checksum_scalar(data, size);
+            if (rudp_checksum_sse2(data, size) != expected || rudp_checksum_avx2(data, size) != expected ||
+                rudp_crc32c_hw(0, data, size) != rudp_crc32c_sw(0, data, size) ||
+                rudp_crc32c(rudp_crc32c(0, data, size / 2), data + size / 2, size - size / 2) != rudp_crc32c_sw(0, data, size))
+            {
+                printf("ERROR: Kernels disagree on %u bytes at offset %d!\n", size, offset);
+                free(buffer);
+                return 1;
+            }
+        }
+    }
+    if (rudp_crc32c_sw(0, "123456789", 9) != 0xE3069283)
+    {
+        printf("ERROR: CRC32C check value mismatch!\n");
+        free(buffer);
+        return 1;
+    }
+
+    printf("Dispatch: checksum=%s, crc32c=%s\n", rudp_checksum_kernel(), rudp_crc32c_kernel());
+    printf("%-18s %8s %14s %12s\n", "Kernel", "Bytes", "Bytes/cycle", "GB/s");
+    for (int k = 0; k < numKernels; k++)
+    {
+        for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            bench_kernel(&kernels[k], buffer, sizes[s]);
+    }
+
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include <string.h>
+#include "Digest.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                      XXH64                         **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+static inline uint64_t rotl64(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));   // The input may be unaligned (little-endian targets)
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t hash, uint64_t acc)
+{
+    hash ^= xxh64_round(0, acc);
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+/********************************************************/
+/* Consume whole 32-byte stripes, one 8-byte word per   */
+/* lane. Returns the bytes consumed                     */
+/********************************************************/
+static size_t xxh64_stripes(uint64_t acc[4], const unsigned char *p, size_t size)
+{
+    uint64_t a0 = acc[0], a1 = acc[1], a2 = acc[2], a3 = acc[3];
+    size_t done = 0;
+    for (; size - done >= 32; done += 32)
+    {
+        a0 = xxh64_round(a0, read64(p + done));
+        a1 = xxh64_round(a1, read64(p + done + 8));
+        a2 = xxh64_round(a2, read64(p + done + 16));
+        a3 = xxh64_round(a3, read64(p + done + 24));
+    }
+    acc[0] = a0; acc[1] = a1; acc[2] = a2; acc[3] = a3;
+    return done;
+}
+
+/********************************************************/
+/* Start a digest                                       */
+/********************************************************/
+void digest_init(Digest *digest, uint64_t seed)
+{
+    memset(digest, 0, sizeof(*digest));
+    digest->seed = seed;
+    digest->acc[0] = seed + PRIME64_1 + PRIME64_2;
+    digest->acc[1] = seed + PRIME64_2;
+    digest->acc[2] = seed;
+    digest->acc[3] = seed - PRIME64_1;
+}
+
+/********************************************************/
+/* Hash the next "size" bytes of the stream             */
+/********************************************************/
+void digest_update(Digest *digest, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+    digest->total += size;
+
+    // Complete a stripe left over by the previous update
+    if (digest->buffered > 0)
+    {
+        size_t fill = 32 - digest->buffered;
+        if (fill > size)
+            fill = size;
+        memcpy(digest->buffer + digest->buffered, p, fill);
+        digest->buffered += fill;
+        p += fill;
+        size -= fill;
+        if (digest->buffered < 32)
+            return;
+        xxh64_stripes(digest->acc, digest->buffer, 32);
+        digest->buffered = 0;
+    }
+
+    size_t done = xxh64_stripes(digest->acc, p, size);
+    memcpy(digest->buffer, p + done, size - done);
+    digest->buffered = size - done;
+}
+
+/********************************************************/
+/* The digest of everything hashed so far (the state    */
+/* is left untouched)                                   */
+/********************************************************/
+uint64_t digest_final(const Digest *digest)
+{
+    uint64_t hash;
+    if (digest->total >= 32)
+    {
+        const uint64_t *acc = digest->acc;
+        hash = rotl64(acc[0], 1) + rotl64(acc[1], 7) + rotl64(acc[2], 12) + rotl64(acc[3], 18);
+        for (int i = 0; i < 4; i++)
+            hash = xxh64_merge(hash, acc[i]);
+    }
+    else
+    {
+        hash = digest->seed + PRIME64_5;
+    }
+    hash += digest->total;
+
+    // The tail: 8-byte words, then a 4-byte word, then single bytes
+    const unsigned char *p = digest->buffer;
+    unsigned left = digest->buffered;
+    for (; left >= 8; p += 8, left -= 8)
+    {
+        hash ^= xxh64_round(0, read64(p));
+        hash = rotl64(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (left >= 4)
+    {
+        hash ^= (uint64_t)read32(p) * PRIME64_1;
+        hash = rotl64(hash, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+        left -= 4;
+    }
+    for (; left > 0; p++, left--)
+    {
+        hash ^= *p * PRIME64_5;
+        hash = rotl64(hash, 11) * PRIME64_1;
+    }
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/********************************************************/
+/* XXH64 of a single block                              */
+/********************************************************/
+uint64_t digest_block(const void *data, size_t size, uint64_t seed)
+{
+    Digest digest;
+    digest_init(&digest, seed);
+    digest_update(&digest, data, size);
+    return digest_final(&digest);
+}
+
+/********************************************************/
+/* Contribution of a segment at byte "offset" of a run  */
+/* to an order-independent run digest: the run's        */
+/* digest is the sum of those of all its segments       */
+/********************************************************/
+uint64_t digest_segment(const void *data, size_t size, uint64_t offset)
+{
+    return digest_block(data, size, offset);
+}
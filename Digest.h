@@ -0,0 +1,32 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * End-to-end run digest: XXH64, computed incrementally as the data is sent
+ * and as it arrives, so verifying a run needs neither a second pass over its
+ * file nor the sender's copy. TCP streams a run in order and hashes it
+ * sequentially; RUDP places segments in any order, so its run digest is the
+ * sum of every segment's XXH64 seeded with the segment's byte offset.
+ */
+
+#define DIGEST_SIZE 8               // Bytes of a digest on the wire (network byte order)
+
+// Streaming XXH64 state
+typedef struct {
+    uint64_t acc[4];                // The four lane accumulators
+    uint64_t seed;
+    uint64_t total;                 // Bytes hashed so far
+    unsigned char buffer[32];       // Input short of a whole 32-byte stripe
+    unsigned buffered;              // Bytes held in "buffer"
+} Digest;
+
+void digest_init(Digest *digest, uint64_t seed);
+void digest_update(Digest *digest, const void *data, size_t size);
+uint64_t digest_final(const Digest *digest);
+uint64_t digest_block(const void *data, size_t size, uint64_t seed);
+uint64_t digest_segment(const void *data, size_t size, uint64_t offset);
+
+#endif
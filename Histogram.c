@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <string.h>
+#include "Histogram.h"
+#include "Log.h"
+
+
+/********************************************************/
+/* Bucket of a sample: values below 2 * HIST_SUB_COUNT  */
+/* have a bucket each, larger ones share a bucket with  */
+/* the values that have the same HIST_SUB_BITS + 1 top  */
+/* bits                                                 */
+/********************************************************/
+static int hist_bucket(uint64_t value)
+{
+    if (value < 2 * HIST_SUB_COUNT)
+        return (int)value;
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > HIST_MAX_EXPONENT)
+        return HIST_BUCKETS - 1;
+    int shift = exponent - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_COUNT + (int)((value >> shift) - HIST_SUB_COUNT);
+}
+
+/********************************************************/
+/* The value a bucket stands for: the middle of its     */
+/* range                                                */
+/********************************************************/
+static uint64_t hist_bucket_value(int bucket)
+{
+    if (bucket < 2 * HIST_SUB_COUNT)
+        return bucket;
+    int shift = bucket / HIST_SUB_COUNT - 1;
+    uint64_t low = (uint64_t)(bucket % HIST_SUB_COUNT + HIST_SUB_COUNT) << shift;
+    return low + ((1ULL << shift) >> 1);
+}
+
+void hist_reset(Histogram *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+}
+
+void hist_record(Histogram *hist, uint64_t value)
+{
+    hist->counts[hist_bucket(value)]++;
+    if (hist->total == 0 || value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+    hist->total++;
+    hist->sum += value;
+}
+
+/********************************************************/
+/* Add the samples of "from" to "into"                  */
+/********************************************************/
+void hist_merge(Histogram *into, const Histogram *from)
+{
+    if (from->total == 0)
+        return;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        into->counts[i] += from->counts[i];
+    if (into->total == 0 || from->min < into->min)
+        into->min = from->min;
+    if (from->max > into->max)
+        into->max = from->max;
+    into->total += from->total;
+    into->sum += from->sum;
+}
+
+/********************************************************/
+/* The sample at "percentile" (0 to 100), within the    */
+/* resolution of its bucket and never beyond the exact  */
+/* minimum and maximum. 0 if the histogram is empty     */
+/********************************************************/
+uint64_t hist_percentile(const Histogram *hist, double percentile)
+{
+    if (hist->total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * hist->total + 0.5);
+    if (rank < 1)               rank = 1;
+    if (rank > hist->total)     rank = hist->total;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += hist->counts[i];
+        if (seen >= rank)
+        {
+            uint64_t value = hist_bucket_value(i);
+            if (value < hist->min)      value = hist->min;
+            if (value > hist->max)      value = hist->max;
+            return value;
+        }
+    }
+    return hist->max;
+}
+
+double hist_mean(const Histogram *hist)
+{
+    return hist->total ? hist->sum / hist->total : 0.0;
+}
+
+/********************************************************/
+/* Print the count, mean and tail percentiles of a      */
+/* histogram of nanoseconds, in milliseconds            */
+/********************************************************/
+void hist_print(const char *name, const Histogram *hist)
+{
+    if (hist->total == 0)
+    {
+        log_plain("%s: no samples\n", name);
+        return;
+    }
+    log_plain("%s: %llu samples; mean %.3f ms; p50 %.3f ms; p90 %.3f ms; p99 %.3f ms; p99.9 %.3f ms; max %.3f ms\n", name,
+           (unsigned long long)hist->total, hist_mean(hist) / 1e6, hist_percentile(hist, 50) / 1e6, hist_percentile(hist, 90) / 1e6,
+           hist_percentile(hist, 99) / 1e6, hist_percentile(hist, 99.9) / 1e6, hist->max / 1e6);
+}
@@ -0,0 +1,35 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * HDR-style latency histogram: every power of two is split into
+ * HIST_SUB_COUNT linear sub-buckets, so a sample is kept with a relative
+ * error under 1 / HIST_SUB_COUNT (about 3%) at any magnitude, from
+ * nanoseconds to hours. Recording is a bit scan and an increment, cheap
+ * enough for every segment; percentiles walk the buckets once. Samples are
+ * nanoseconds.
+ */
+
+#define HIST_SUB_BITS 5                                 // log2 of the sub-buckets per power of two
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXPONENT 47                            // Largest power of two kept apart (2^47 ns: about 39 hours)
+#define HIST_BUCKETS ((HIST_MAX_EXPONENT - HIST_SUB_BITS + 2) * HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];      // Samples per bucket
+    uint64_t total;                     // Samples recorded
+    uint64_t min;                       // Smallest sample (exact)
+    uint64_t max;                       // Largest sample (exact)
+    double sum;                         // Sum of the samples (for the mean)
+} Histogram;
+
+void hist_reset(Histogram *hist);
+void hist_record(Histogram *hist, uint64_t value);
+void hist_merge(Histogram *into, const Histogram *from);
+uint64_t hist_percentile(const Histogram *hist, double percentile);
+double hist_mean(const Histogram *hist);
+void hist_print(const char *name, const Histogram *hist);
+
+#endif
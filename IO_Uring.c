@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>         // For _NSIG
+#include <sys/mman.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include "IO_Uring.h"
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                  Ring management                   **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+/********************************************************/
+/* Create a ring with "entries" submission slots and    */
+/* map its queues. Returns 0 on success, -1 on failure  */
+/* (e.g. io_uring is disabled or unsupported)           */
+/********************************************************/
+int uring_init(IO_Uring *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->sqRing = ring->cqRing = ring->sqes = MAP_FAILED;
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+    {
+        perror("io_uring_setup(2)");
+        return -1;
+    }
+    ring->entries = params.sq_entries;
+
+    // Map the submission ring, the completion ring (often the same mapping) and the SQE array
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cqRingSize > ring->sqRingSize)    ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED)
+        goto fail;
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        ring->cqRing = ring->sqRing;
+    else
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cqRing == MAP_FAILED)
+        goto fail;
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+        goto fail;
+
+    char *sq = ring->sqRing, *cq = ring->cqRing;
+    ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+
+fail:
+    perror("mmap(2): io_uring");
+    uring_free(ring);
+    return -1;
+}
+
+/********************************************************/
+/* Unmap the queues and close the ring                  */
+/********************************************************/
+void uring_free(IO_Uring *ring)
+{
+    if (ring->sqes != MAP_FAILED && ring->sqes != NULL)                                 munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing != MAP_FAILED && ring->cqRing != NULL && ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+    if (ring->sqRing != MAP_FAILED && ring->sqRing != NULL)                             munmap(ring->sqRing, ring->sqRingSize);
+    if (ring->fd >= 0)                                                                  close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+/********************************************************/
+/* Register buffers for the *_FIXED operations; the     */
+/* kernel pins them once instead of on every request    */
+/********************************************************/
+int uring_register_buffers(IO_Uring *ring, const struct iovec *buffers, unsigned count)
+{
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, buffers, count) < 0)
+    {
+        perror("io_uring_register(2)");
+        return -1;
+    }
+    return 0;
+}
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**             Submission and completion              **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+/********************************************************/
+/* Return the next free submission entry, cleared, or   */
+/* NULL if the submission queue is full                 */
+/********************************************************/
+struct io_uring_sqe *uring_get_sqe(IO_Uring *ring)
+{
+    unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sqTail + ring->queued;
+    if (tail - head >= ring->entries)
+        return NULL;
+
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqArray[index] = index;
+    ring->queued++;
+    return sqe;
+}
+
+/********************************************************/
+/* Hand the prepared entries to the kernel and wait for */
+/* "wait_for" completions, at most "timeout" when one   */
+/* is given (IORING_ENTER_EXT_ARG)                      */
+/********************************************************/
+static int uring_enter(IO_Uring *ring, unsigned wait_for, struct __kernel_timespec *timeout)
+{
+    unsigned submit = ring->queued;
+    __atomic_store_n(ring->sqTail, *ring->sqTail + submit, __ATOMIC_RELEASE);
+    ring->queued = 0;
+
+    struct io_uring_getevents_arg arg = {.sigmask = 0, .sigmask_sz = _NSIG / 8, .ts = (uintptr_t)timeout};
+    unsigned flags = wait_for ? IORING_ENTER_GETEVENTS : 0;
+    if (timeout)
+        flags |= IORING_ENTER_EXT_ARG;
+
+    while (1)
+    {
+        int result = syscall(__NR_io_uring_enter, ring->fd, submit, wait_for, flags, timeout ? &arg : NULL, timeout ? sizeof(arg) : 0);
+        ring->enterCalls++;
+        if (result >= 0)
+        {
+            ring->inFlight += result;
+            return result;
+        }
+        if (errno == ETIME)
+            return 0;       // Nothing was left to submit and the wait timed out
+        if (errno != EINTR)
+        {
+            perror("io_uring_enter(2)");
+            return -1;
+        }
+    }
+}
+
+/********************************************************/
+/* Submit the prepared entries and wait until at least  */
+/* "wait_for" completions are available, in a single   */
+/* io_uring_enter(2). Returns the number submitted, or  */
+/* -1 on error                                          */
+/********************************************************/
+int uring_submit(IO_Uring *ring, unsigned wait_for)
+{
+    return uring_enter(ring, wait_for, NULL);
+}
+
+/********************************************************/
+/* As uring_submit(), but stop waiting after            */
+/* "timeout_us" microseconds                            */
+/********************************************************/
+int uring_submit_timeout(IO_Uring *ring, unsigned wait_for, long timeout_us)
+{
+    struct __kernel_timespec timeout = {timeout_us / 1000000, (timeout_us % 1000000) * 1000};
+    return uring_enter(ring, wait_for, &timeout);
+}
+
+/********************************************************/
+/* Return the oldest unconsumed completion, or NULL     */
+/********************************************************/
+struct io_uring_cqe *uring_peek_cqe(IO_Uring *ring)
+{
+    unsigned head = *ring->cqHead;
+    if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &ring->cqes[head & *ring->cqMask];
+}
+
+/********************************************************/
+/* Return the oldest completion, entering the kernel to */
+/* wait for one if none is available yet                */
+/********************************************************/
+struct io_uring_cqe *uring_wait_cqe(IO_Uring *ring)
+{
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(ring)) == NULL)
+    {
+        if (uring_submit(ring, 1) < 0)
+            return NULL;
+    }
+    return cqe;
+}
+
+/********************************************************/
+/* Mark the completion returned by peek/wait consumed   */
+/********************************************************/
+void uring_cqe_seen(IO_Uring *ring)
+{
+    __atomic_store_n(ring->cqHead, *ring->cqHead + 1, __ATOMIC_RELEASE);
+    ring->inFlight--;
+}
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                 Request preparation                **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+static void uring_prep_rw(struct io_uring_sqe *sqe, int op, int fd, const void *addr, unsigned len, unsigned long long offset)
+{
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = offset;
+}
+
+void uring_prep_send(struct io_uring_sqe *sqe, int sock, const void *buf, size_t len, int flags)
+{
+    uring_prep_rw(sqe, IORING_OP_SEND, sock, buf, len, 0);
+    sqe->msg_flags = flags;
+}
+
+void uring_prep_recv(struct io_uring_sqe *sqe, int sock, void *buf, size_t len, int flags)
+{
+    uring_prep_rw(sqe, IORING_OP_RECV, sock, buf, len, 0);
+    sqe->msg_flags = flags;
+}
+
+void uring_prep_sendmsg(struct io_uring_sqe *sqe, int sock, const struct msghdr *msg, int flags)
+{
+    uring_prep_rw(sqe, IORING_OP_SENDMSG, sock, msg, 1, 0);
+    sqe->msg_flags = flags;
+}
+
+void uring_prep_recvmsg(struct io_uring_sqe *sqe, int sock, struct msghdr *msg, int flags)
+{
+    uring_prep_rw(sqe, IORING_OP_RECVMSG, sock, msg, 1, 0);
+    sqe->msg_flags = flags;
+}
+
+void uring_prep_read_fixed(struct io_uring_sqe *sqe, int fd, void *buf, unsigned len, off_t offset, int buf_index)
+{
+    uring_prep_rw(sqe, IORING_OP_READ_FIXED, fd, buf, len, offset);
+    sqe->buf_index = buf_index;
+}
+
+void uring_prep_write_fixed(struct io_uring_sqe *sqe, int fd, const void *buf, unsigned len, off_t offset, int buf_index)
+{
+    uring_prep_rw(sqe, IORING_OP_WRITE_FIXED, fd, buf, len, offset);
+    sqe->buf_index = buf_index;
+}
+
+void uring_prep_cancel(struct io_uring_sqe *sqe, unsigned long long user_data)
+{
+    uring_prep_rw(sqe, IORING_OP_ASYNC_CANCEL, -1, NULL, 0, 0);
+    sqe->addr = user_data;
+}
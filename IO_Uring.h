@@ -0,0 +1,52 @@
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+/*
+ * A minimal io_uring engine on top of the raw system calls (no liburing):
+ * one submission/completion ring pair, SQE preparation helpers for the
+ * socket and file operations the senders and receivers use, and buffer
+ * registration for the fixed-buffer file reads and writes.
+ */
+
+// Submission and completion rings shared with the kernel
+typedef struct {
+    int fd;                             // The io_uring file descriptor (-1 when closed)
+    unsigned entries;                   // Submission queue size
+    unsigned *sqHead, *sqTail;          // Submission ring indexes (head is moved by the kernel)
+    unsigned *sqMask, *sqArray;         // Submission ring mask and SQE index array
+    struct io_uring_sqe *sqes;          // Submission queue entries
+    unsigned *cqHead, *cqTail, *cqMask; // Completion ring indexes and mask (tail is moved by the kernel)
+    struct io_uring_cqe *cqes;          // Completion queue entries
+    void *sqRing, *cqRing;              // Mappings of both rings (the same one with IORING_FEAT_SINGLE_MMAP)
+    size_t sqRingSize, cqRingSize;      // Sizes of the ring mappings
+    size_t sqesSize;                    // Size of the SQE array mapping
+    unsigned queued;                    // SQEs prepared but not submitted yet
+    unsigned inFlight;                  // SQEs submitted whose completion was not consumed yet
+    long enterCalls;                    // io_uring_enter(2) system calls made
+} IO_Uring;
+
+int uring_init(IO_Uring *ring, unsigned entries);
+void uring_free(IO_Uring *ring);
+int uring_register_buffers(IO_Uring *ring, const struct iovec *buffers, unsigned count);
+
+struct io_uring_sqe *uring_get_sqe(IO_Uring *ring);
+int uring_submit(IO_Uring *ring, unsigned wait_for);
+int uring_submit_timeout(IO_Uring *ring, unsigned wait_for, long timeout_us);
+struct io_uring_cqe *uring_peek_cqe(IO_Uring *ring);
+struct io_uring_cqe *uring_wait_cqe(IO_Uring *ring);
+void uring_cqe_seen(IO_Uring *ring);
+
+void uring_prep_send(struct io_uring_sqe *sqe, int sock, const void *buf, size_t len, int flags);
+void uring_prep_recv(struct io_uring_sqe *sqe, int sock, void *buf, size_t len, int flags);
+void uring_prep_sendmsg(struct io_uring_sqe *sqe, int sock, const struct msghdr *msg, int flags);
+void uring_prep_recvmsg(struct io_uring_sqe *sqe, int sock, struct msghdr *msg, int flags);
+void uring_prep_read_fixed(struct io_uring_sqe *sqe, int fd, void *buf, unsigned len, off_t offset, int buf_index);
+void uring_prep_write_fixed(struct io_uring_sqe *sqe, int fd, const void *buf, unsigned len, off_t offset, int buf_index);
+void uring_prep_cancel(struct io_uring_sqe *sqe, unsigned long long user_data);
+
+#endif
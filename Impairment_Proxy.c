@@ -0,0 +1,818 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>         // For variadic functions
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>           // For ppoll (nanosecond timeouts)
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>    // For TCP_CONGESTION and TCP_NODELAY
+#include <sys/socket.h>
+#include "Payload.h"
+#include "Timing.h"
+#include "Log.h"
+
+/*
+ * A user-space network impairment proxy (no root, no tc netem): it relays
+ * the traffic of a sender to its receiver and degrades it on the way. Every
+ * packet (UDP) or chunk (TCP) is scheduled on a virtual link per direction:
+ * it may be dropped (at random, or in bursts by a Gilbert-Elliott channel),
+ * corrupted or duplicated, it waits for the link's bandwidth, then for the
+ * link's delay plus jitter, and a share of packets may skip the delay to
+ * overtake the others (reordering, as with netem). Every decision comes from
+ * a xoshiro256** generator per direction seeded by -seed, so a run with the
+ * same seed sees the same impairment of its n-th packet in each direction.
+ */
+
+#define PROXY_BUFFER_SIZE 65536     // Largest datagram (or TCP chunk) relayed at once
+#define MAX_FLOWS 64                // UDP senders or TCP connections relayed at the same time
+#define DEFAULT_QUEUE 1000          // Default packets a direction holds before it drops new ones (drop-tail)
+#define TCP_QUEUE_BYTES 4194304     // Bytes a TCP direction holds before the proxy stops reading its source
+#define UDP_IDLE_NS 30000000000ULL  // A UDP flow silent this long is forgotten (30 s)
+#define FORWARD 0                   // Direction: sender to receiver
+#define BACKWARD 1                  // Direction: receiver to sender
+
+// How one direction of the link is degraded (probabilities in 0..1, times in ns)
+typedef struct {
+    double loss;                    // Random loss (in the good state of the Gilbert-Elliott channel)
+    double burstEnter;              // Gilbert-Elliott: chance per packet to turn bad (0 = no bursts)
+    double burstLeave;              // Gilbert-Elliott: chance per packet to turn good again
+    double burstLoss;               // Gilbert-Elliott: loss in the bad state
+    uint64_t delay;                 // Fixed one-way delay
+    uint64_t jitter;                // Delay varies uniformly by up to +/- jitter
+    double reorder;                 // Share of packets sent without the delay (needs a delay)
+    double duplicate;               // Share of packets sent twice
+    double corrupt;                 // Share of packets with one bit flipped
+    double rateMbit;                // Bandwidth cap in Mbit/s (0 = unlimited)
+    int queue;                      // Packets a direction may hold
+} Impairment;
+
+// A direction of the virtual link: its generator, channel state and counters
+typedef struct {
+    uint64_t rng[4];                // xoshiro256** state
+    bool bad;                       // Gilbert-Elliott channel in the bad state
+    uint64_t linkFree;              // When the bandwidth cap lets the next packet start
+    int queued;                     // Packets scheduled and not sent yet
+    long packets, bytes;            // Received from the source
+    long sent;                      // Handed to the destination (duplicates included)
+    long lost, burstLost, queueDrops, duplicated, corrupted, reordered;
+} Link;
+
+// A packet (or a TCP chunk) on its way; a zero-length TCP chunk carries its source's end of stream
+typedef struct Packet {
+    uint64_t release;               // When it leaves the proxy
+    uint64_t seq;                   // Arrival order (ties of "release" keep it)
+    int flow;                       // Flow it belongs to
+    unsigned generation;            // The flow's generation (a closed flow's packets are dropped)
+    int dir;                        // FORWARD or BACKWARD
+    size_t length;                  // Bytes in "data"
+    size_t written;                 // TCP: bytes already written to the destination
+    struct Packet *next;            // TCP: next chunk released to the same destination
+    char data[];
+} Packet;
+
+// A UDP sender, or a TCP connection, relayed through its own socket to the receiver
+typedef struct {
+    bool used;
+    unsigned generation;            // Bumped whenever the slot is reused
+    struct sockaddr_in client;      // UDP: the sender's address
+    int down;                       // TCP: the accepted connection (UDP: -1, the listening socket answers)
+    int up;                         // The socket connected to the receiver
+    uint64_t lastActive;            // UDP: time of the flow's latest packet
+    Packet *outHead[2], *outTail[2];    // TCP: chunks released to each destination, not fully written yet
+    size_t held[2];                 // TCP: bytes of each direction inside the proxy
+    bool readEnd[2];                // TCP: the source of a direction closed its side
+    bool writeEnd[2];               // TCP: the end of stream reached the destination of a direction
+    uint64_t lastRelease[2];        // TCP: release of the latest chunk (a byte stream is never reordered)
+} Flow;
+
+static Impairment impairments[2];  // Per direction (-both 0 leaves the receiver's packets alone)
+static Link links[2];
+static Flow flows[MAX_FLOWS];
+static Packet **heap;               // Scheduled packets, a min-heap on (release, seq)
+static int heapCount, heapCapacity;
+static uint64_t nextSeq;
+static bool tcpMode = false;
+static int listener = -1;
+static struct sockaddr_in target;   // The receiver
+static const char *algo = NULL;     // TCP: congestion control of the proxy's connections to the receiver
+static volatile sig_atomic_t stopping = 0;
+
+
+// Declaration of auxiliary functions (see full implementation below)
+int parse_percent(const char *text, double *value);
+uint64_t rng_next(uint64_t *state);
+double rng_uniform(uint64_t *state);
+void rng_seed(uint64_t *state, uint64_t seed);
+void schedule_packet(Packet *packet, uint64_t now);
+void impair_packet(Packet *packet, uint64_t now);
+void heap_push(Packet *packet);
+Packet *heap_pop(void);
+int flow_open_udp(const struct sockaddr_in *client, uint64_t now);
+int flow_open_tcp(int down);
+void flow_close(int index, const char *reason);
+void release_packet(Packet *packet);
+int flush_tcp(int index, int dir);
+void read_udp(int sock, int index, uint64_t now);
+void read_tcp(int index, int dir, uint64_t now);
+void print_statistics(void);
+void on_signal(int sig);
+
+
+/*Main function for the impairment proxy.*/
+/*Return 0 if the program successfully runs, and 1 otherwise*/
+int main(int argc, char *argv[])
+{
+
+    /*----------------------------------------*/
+    /*    Validate Command-Line Arguments     */
+    /*----------------------------------------*/
+
+    const char *usage = "Usage: %s -p PORT -ip IP -dp PORT [-mode udp|tcp] [-loss PCT] [-burst ENTER:LEAVE[:LOSS]] [-delay MS] [-jitter MS]"
+                        " [-reorder PCT] [-dup PCT] [-corrupt PCT] [-rate MBIT] [-queue PACKETS] [-both 0|1] [-algo ALGO] [-seed SEED] [-log LEVEL]\n";
+    if (argc < 7 || argc % 2 == 0)
+    {
+        log_error(usage, argv[0]);
+        return 1;
+    }
+
+    int port = 0, targetPort = 0;
+    const char *targetIp = NULL;
+    int both = 1;
+    Impairment impairment = {.burstLoss = 1.0, .queue = DEFAULT_QUEUE};
+    uint64_t seed = payload_random_seed();
+    bool invalid = false;
+    double ms;
+
+    for (int i = 1; i < argc; i += 2)
+    {
+        const char *value = argv[i + 1];
+        if (strcmp(argv[i], "-p") == 0)                 port = atoi(value);
+        else if (strcmp(argv[i], "-ip") == 0)           targetIp = value;
+        else if (strcmp(argv[i], "-dp") == 0)           targetPort = atoi(value);
+        else if (strcmp(argv[i], "-mode") == 0)
+        {
+            if (strcmp(value, "tcp") == 0)              tcpMode = true;
+            else if (strcmp(value, "udp") != 0)         invalid = true;
+        }
+        else if (strcmp(argv[i], "-loss") == 0)         invalid |= parse_percent(value, &impairment.loss) < 0;
+        else if (strcmp(argv[i], "-burst") == 0)
+        {
+            double enter, leave, loss = 100.0;
+            if (sscanf(value, "%lf:%lf:%lf", &enter, &leave, &loss) < 2 || enter < 0 || enter > 100 || leave <= 0 || leave > 100 || loss < 0 || loss > 100)
+                invalid = true;
+            impairment.burstEnter = enter / 100.0;
+            impairment.burstLeave = leave / 100.0;
+            impairment.burstLoss = loss / 100.0;
+        }
+        else if (strcmp(argv[i], "-delay") == 0 && (ms = atof(value)) >= 0)     impairment.delay = (uint64_t)(ms * 1e6);
+        else if (strcmp(argv[i], "-jitter") == 0 && (ms = atof(value)) >= 0)    impairment.jitter = (uint64_t)(ms * 1e6);
+        else if (strcmp(argv[i], "-reorder") == 0)      invalid |= parse_percent(value, &impairment.reorder) < 0;
+        else if (strcmp(argv[i], "-dup") == 0)          invalid |= parse_percent(value, &impairment.duplicate) < 0;
+        else if (strcmp(argv[i], "-corrupt") == 0)      invalid |= parse_percent(value, &impairment.corrupt) < 0;
+        else if (strcmp(argv[i], "-rate") == 0)         invalid |= (impairment.rateMbit = atof(value)) < 0;
+        else if (strcmp(argv[i], "-queue") == 0)        invalid |= (impairment.queue = atoi(value)) < 1;
+        else if (strcmp(argv[i], "-both") == 0)         both = atoi(value);
+        else if (strcmp(argv[i], "-algo") == 0)         algo = value;
+        else if (strcmp(argv[i], "-seed") == 0)         seed = strtoull(value, NULL, 0);
+        else if (log_option(argv[i], value) != 1)       invalid = true;
+    }
+
+    if (invalid || port <= 0 || targetPort <= 0 || targetIp == NULL || inet_pton(AF_INET, targetIp, &target.sin_addr) <= 0)
+    {
+        log_error(usage, argv[0]);
+        return 1;
+    }
+    if (impairment.reorder > 0 && impairment.delay == 0)
+    {
+        log_error("ERROR: -reorder sends packets ahead of the delayed ones, so it needs a -delay\n");
+        return 1;
+    }
+
+    // A TCP chunk is part of a byte stream: it can be slowed down, but not dropped, corrupted, duplicated or reordered
+    if (tcpMode && (impairment.loss > 0 || impairment.burstEnter > 0 || impairment.reorder > 0 || impairment.duplicate > 0 || impairment.corrupt > 0))
+    {
+        log_error("ERROR: TCP mode relays byte streams; only -delay, -jitter and -rate apply to it\n");
+        return 1;
+    }
+    target.sin_family = AF_INET;
+    target.sin_port = htons(targetPort);
+
+    /*----------------------------------------*/
+    /*                Main Code               */
+    /*----------------------------------------*/
+
+    struct sigaction action = {.sa_handler = on_signal};   // No SA_RESTART: ppoll(2) returns on a signal
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Every direction draws from its own generator, so its decisions do not depend on the other's traffic
+    rng_seed(links[FORWARD].rng, seed);
+    rng_seed(links[BACKWARD].rng, seed ^ 0x5851F42D4C957F2DULL);
+    impairments[FORWARD] = impairment;
+    impairments[BACKWARD] = both ? impairment : (Impairment){.burstLoss = 1.0, .queue = impairment.queue};
+
+    listener = socket(AF_INET, tcpMode ? SOCK_STREAM : SOCK_DGRAM, 0);
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY), .sin_port = htons(port)};
+    int reuse = 1;
+    if (listener < 0 || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+        bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 || (tcpMode && listen(listener, MAX_FLOWS) < 0))
+    {
+        perror("bind(2)");
+        return 1;
+    }
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+
+    log_info("Relaying %s port %d to %s:%d (seed 0x%016llx)\n", tcpMode ? "TCP" : "UDP", port, targetIp, targetPort, (unsigned long long)seed);
+    log_info("Impairment: loss %.2f%%, burst %.2f%%/%.2f%% (loss %.2f%%), delay %.3f ms +/- %.3f ms, reorder %.2f%%, duplicate %.2f%%, corrupt %.2f%%, rate %s%.1f Mbit/s, queue %d%s\n",
+             impairment.loss * 100, impairment.burstEnter * 100, impairment.burstLeave * 100, impairment.burstLoss * 100, impairment.delay / 1e6,
+             impairment.jitter / 1e6, impairment.reorder * 100, impairment.duplicate * 100, impairment.corrupt * 100, impairment.rateMbit > 0 ? "" : "unlimited ",
+             impairment.rateMbit, impairment.queue, both ? ", both directions" : ", sender to receiver only");
+
+    struct pollfd fds[1 + 2 * MAX_FLOWS];
+    int owners[1 + 2 * MAX_FLOWS];          // Flow of every polled socket (-1: the listener)
+    uint64_t lastSweep = timing_now_ns();
+
+    while (!stopping)
+    {
+        // Sockets to read (unless their direction holds too much) and TCP destinations with chunks to write
+        int count = 0;
+        fds[count] = (struct pollfd){.fd = listener, .events = POLLIN};
+        owners[count++] = -1;
+        for (int i = 0; i < MAX_FLOWS; i++)
+        {
+            Flow *flow = &flows[i];
+            if (!flow->used)
+                continue;
+            if (!tcpMode)
+            {
+                fds[count] = (struct pollfd){.fd = flow->up, .events = POLLIN};
+                owners[count++] = i;
+                continue;
+            }
+            short down = 0, up = 0;
+            if (!flow->readEnd[FORWARD] && flow->held[FORWARD] < TCP_QUEUE_BYTES)       down |= POLLIN;
+            if (!flow->readEnd[BACKWARD] && flow->held[BACKWARD] < TCP_QUEUE_BYTES)     up |= POLLIN;
+            if (flow->outHead[FORWARD])         up |= POLLOUT;
+            if (flow->outHead[BACKWARD])        down |= POLLOUT;
+            fds[count] = (struct pollfd){.fd = down ? flow->down : -1, .events = down};     // A negative fd is skipped, even on a hang-up
+            owners[count++] = i;
+            fds[count] = (struct pollfd){.fd = up ? flow->up : -1, .events = up};
+            owners[count++] = i;
+        }
+
+        // Sleep until a socket is ready or the earliest scheduled packet is due
+        uint64_t now = timing_now_ns();
+        struct timespec timeout = {1, 0}, *wait = &timeout;
+        if (heapCount > 0)
+        {
+            uint64_t due = heap[0]->release > now ? heap[0]->release - now : 0;
+            timeout = (struct timespec){(time_t)(due / 1000000000ULL), (long)(due % 1000000000ULL)};
+        }
+        int ready = ppoll(fds, count, wait, NULL);
+        if (ready < 0 && errno != EINTR)
+        {
+            perror("ppoll(2)");
+            break;
+        }
+
+        now = timing_now_ns();
+        for (int k = 0; ready > 0 && k < count; k++)
+        {
+            if (fds[k].revents == 0)
+                continue;
+            int index = owners[k];
+            if (index < 0)
+            {
+                if (tcpMode)
+                {
+                    int down = accept(listener, NULL, NULL);
+                    if (down >= 0 && flow_open_tcp(down) < 0)
+                        close(down);
+                }
+                else
+                {
+                    read_udp(listener, -1, now);
+                }
+                continue;
+            }
+            if (!flows[index].used)
+                continue;
+            if (!tcpMode)
+            {
+                read_udp(fds[k].fd, index, now);
+                continue;
+            }
+
+            int dir = fds[k].fd == flows[index].down ? FORWARD : BACKWARD;     // The direction this socket is the source of
+            if ((fds[k].revents & POLLOUT) && flush_tcp(index, 1 - dir) < 0)
+                continue;
+            if (fds[k].revents & (POLLIN | POLLHUP | POLLERR))
+                read_tcp(index, dir, now);
+        }
+
+        // Hand every due packet to its destination
+        now = timing_now_ns();
+        while (heapCount > 0 && heap[0]->release <= now)
+            release_packet(heap_pop());
+
+        // Forget the UDP senders that went silent
+        if (!tcpMode && now - lastSweep > 1000000000ULL)
+        {
+            for (int i = 0; i < MAX_FLOWS; i++)
+            {
+                if (flows[i].used && now - flows[i].lastActive > UDP_IDLE_NS)
+                    flow_close(i, "idle");
+            }
+            lastSweep = now;
+        }
+    }
+
+    print_statistics();
+    for (int i = 0; i < MAX_FLOWS; i++)
+    {
+        if (flows[i].used)
+            flow_close(i, "proxy stopped");
+    }
+    while (heapCount > 0)
+        free(heap_pop());
+    free(heap);
+    close(listener);
+    return 0;
+}
+
+
+/*----------------------------------------*/
+/*          Auxiliary functions           */
+/*----------------------------------------*/
+
+/*Parse a percentage (0 to 100) into a probability. Returns -1 if it is out of range*/
+int parse_percent(const char *text, double *value)
+{
+    char *end;
+    double percent = strtod(text, &end);
+    if (end == text || *end != '\0' || percent < 0 || percent > 100)
+        return -1;
+    *value = percent / 100.0;
+    return 0;
+}
+
+/*One output of a xoshiro256** generator*/
+uint64_t rng_next(uint64_t *s)
+{
+    uint64_t result = ((s[1] * 5) << 7 | (s[1] * 5) >> 57) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = s[3] << 45 | s[3] >> 19;
+    return result;
+}
+
+/*A uniform double in [0, 1)*/
+double rng_uniform(uint64_t *state)
+{
+    return (rng_next(state) >> 11) * 0x1.0p-53;
+}
+
+/*Seed a generator with SplitMix64, as the payload lanes are*/
+void rng_seed(uint64_t *state, uint64_t seed)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        state[i] = z ^ (z >> 31);
+    }
+}
+
+/*Give a packet its release time: the link's bandwidth first, then its delay and jitter, unless it skips the delay (reordering)*/
+void schedule_packet(Packet *packet, uint64_t now)
+{
+    Link *link = &links[packet->dir];
+    const Impairment *imp = &impairments[packet->dir];
+    uint64_t depart = now;
+
+    if (imp->rateMbit > 0)
+    {
+        if (link->linkFree > depart)
+            depart = link->linkFree;
+        depart += (uint64_t)(packet->length * 8000.0 / imp->rateMbit);    // Serialization time in ns
+        link->linkFree = depart;
+    }
+
+    uint64_t delay = imp->delay;
+    if (imp->jitter > 0)
+    {
+        int64_t offset = (int64_t)(rng_uniform(link->rng) * (2 * imp->jitter + 1)) - (int64_t)imp->jitter;
+        delay = (int64_t)delay + offset > 0 ? delay + offset : 0;
+    }
+    if (imp->reorder > 0 && rng_uniform(link->rng) < imp->reorder)
+    {
+        delay = 0;
+        link->reordered++;
+    }
+    packet->release = depart + delay;
+
+    // A byte stream keeps its order whatever the jitter
+    if (tcpMode)
+    {
+        Flow *flow = &flows[packet->flow];
+        if (packet->release < flow->lastRelease[packet->dir])
+            packet->release = flow->lastRelease[packet->dir];
+        flow->lastRelease[packet->dir] = packet->release;
+        flow->held[packet->dir] += packet->length;
+    }
+    packet->seq = nextSeq++;
+    heap_push(packet);
+}
+
+/*Run a received packet through the channel: loss, then the queue limit, corruption and duplication*/
+void impair_packet(Packet *packet, uint64_t now)
+{
+    Link *link = &links[packet->dir];
+    const Impairment *imp = &impairments[packet->dir];
+    link->packets++;
+    link->bytes += packet->length;
+
+    if (packet->length > 0 && !tcpMode)
+    {
+        // Gilbert-Elliott: the channel moves between its states once per packet, and each state has its own loss
+        if (imp->burstEnter > 0)
+        {
+            double move = rng_uniform(link->rng);
+            if (link->bad ? move < imp->burstLeave : move < imp->burstEnter)
+                link->bad = !link->bad;
+        }
+        if (rng_uniform(link->rng) < (link->bad ? imp->burstLoss : imp->loss))
+        {
+            if (link->bad)      link->burstLost++;
+            else                link->lost++;
+            free(packet);
+            return;
+        }
+        if (link->queued >= imp->queue)
+        {
+            link->queueDrops++;
+            free(packet);
+            return;
+        }
+        if (imp->corrupt > 0 && rng_uniform(link->rng) < imp->corrupt)
+        {
+            uint64_t bit = rng_next(link->rng) % (packet->length * 8);
+            packet->data[bit / 8] ^= 1 << (bit % 8);
+            link->corrupted++;
+        }
+        if (imp->duplicate > 0 && rng_uniform(link->rng) < imp->duplicate)
+        {
+            Packet *copy = malloc(sizeof(Packet) + packet->length);
+            if (copy != NULL)
+            {
+                memcpy(copy, packet, sizeof(Packet) + packet->length);
+                schedule_packet(copy, now);
+                link->duplicated++;
+            }
+        }
+    }
+    schedule_packet(packet, now);
+}
+
+/*Add a packet to the schedule*/
+void heap_push(Packet *packet)
+{
+    if (heapCount == heapCapacity)
+    {
+        int capacity = heapCapacity ? 2 * heapCapacity : 1024;
+        Packet **grown = realloc(heap, capacity * sizeof(Packet *));
+        if (grown == NULL)
+        {
+            log_error("ERROR: Out of memory for the packet schedule!\n");
+            free(packet);
+            return;
+        }
+        heap = grown;
+        heapCapacity = capacity;
+    }
+
+    int i = heapCount++;
+    while (i > 0)
+    {
+        Packet *parent = heap[(i - 1) / 2];
+        if (parent->release < packet->release || (parent->release == packet->release && parent->seq < packet->seq))
+            break;
+        heap[i] = parent;
+        i = (i - 1) / 2;
+    }
+    heap[i] = packet;
+    links[packet->dir].queued++;
+}
+
+/*Take the earliest packet off the schedule*/
+Packet *heap_pop(void)
+{
+    Packet *top = heap[0];
+    Packet *last = heap[--heapCount];
+    int i = 0;
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= heapCount)
+            break;
+        if (child + 1 < heapCount && (heap[child + 1]->release < heap[child]->release ||
+            (heap[child + 1]->release == heap[child]->release && heap[child + 1]->seq < heap[child]->seq)))
+            child++;
+        if (last->release < heap[child]->release || (last->release == heap[child]->release && last->seq < heap[child]->seq))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    links[top->dir].queued--;
+    return top;
+}
+
+/*A new UDP sender: relay it through its own socket, so the receiver's replies find their way back*/
+int flow_open_udp(const struct sockaddr_in *client, uint64_t now)
+{
+    int index = 0;
+    while (index < MAX_FLOWS && flows[index].used)
+        index++;
+    if (index == MAX_FLOWS)
+    {
+        log_error("ERROR: More than %d senders; packet dropped\n", MAX_FLOWS);
+        return -1;
+    }
+
+    int up = socket(AF_INET, SOCK_DGRAM, 0);
+    if (up < 0 || connect(up, (const struct sockaddr *)&target, sizeof(target)) < 0)
+    {
+        perror("connect(2)");
+        if (up >= 0)
+            close(up);
+        return -1;
+    }
+    fcntl(up, F_SETFL, O_NONBLOCK);
+
+    Flow *flow = &flows[index];
+    unsigned generation = flow->generation + 1;
+    memset(flow, 0, sizeof(*flow));
+    flow->used = true;
+    flow->generation = generation;
+    flow->client = *client;
+    flow->down = -1;
+    flow->up = up;
+    flow->lastActive = now;
+    log_info("Flow #%d: sender %s:%d\n", index + 1, inet_ntoa(client->sin_addr), ntohs(client->sin_port));
+    return index;
+}
+
+/*A new TCP connection: open its twin to the receiver*/
+int flow_open_tcp(int down)
+{
+    int index = 0;
+    while (index < MAX_FLOWS && flows[index].used)
+        index++;
+    if (index == MAX_FLOWS)
+    {
+        log_error("ERROR: More than %d connections; connection refused\n", MAX_FLOWS);
+        return -1;
+    }
+
+    int up = socket(AF_INET, SOCK_STREAM, 0);
+    if (up < 0)
+        return -1;
+    if (algo && setsockopt(up, IPPROTO_TCP, TCP_CONGESTION, algo, strlen(algo)) < 0)
+        perror("setsockopt: TCP_CONGESTION");
+    if (connect(up, (const struct sockaddr *)&target, sizeof(target)) < 0)
+    {
+        perror("connect(2)");
+        close(up);
+        return -1;
+    }
+    int enable = 1;
+    setsockopt(up, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));     // The chunks leave when the schedule says so
+    setsockopt(down, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    fcntl(up, F_SETFL, O_NONBLOCK);
+    fcntl(down, F_SETFL, O_NONBLOCK);
+
+    Flow *flow = &flows[index];
+    unsigned generation = flow->generation + 1;
+    memset(flow, 0, sizeof(*flow));
+    flow->used = true;
+    flow->generation = generation;
+    flow->down = down;
+    flow->up = up;
+    log_info("Flow #%d: connection accepted\n", index + 1);
+    return index;
+}
+
+/*Close a flow; its packets still on the schedule are dropped when they come due*/
+void flow_close(int index, const char *reason)
+{
+    Flow *flow = &flows[index];
+    for (int dir = 0; dir < 2; dir++)
+    {
+        while (flow->outHead[dir])
+        {
+            Packet *packet = flow->outHead[dir];
+            flow->outHead[dir] = packet->next;
+            free(packet);
+        }
+    }
+    if (flow->down >= 0)
+        close(flow->down);
+    close(flow->up);
+    flow->used = false;
+    flow->generation++;
+    log_info("Flow #%d closed (%s)\n", index + 1, reason);
+}
+
+/*A packet is due: send it (UDP), or queue it behind the unwritten chunks of its destination (TCP)*/
+void release_packet(Packet *packet)
+{
+    Flow *flow = &flows[packet->flow];
+    if (!flow->used || flow->generation != packet->generation)
+    {
+        free(packet);
+        return;
+    }
+
+    if (!tcpMode)
+    {
+        ssize_t sent = packet->dir == FORWARD ? send(flow->up, packet->data, packet->length, 0)
+                                              : sendto(listener, packet->data, packet->length, 0, (const struct sockaddr *)&flow->client, sizeof(flow->client));
+        if (sent >= 0)
+            links[packet->dir].sent++;
+        else
+            links[packet->dir].queueDrops++;        // Socket buffer full (or receiver gone): lost like on a real link
+        free(packet);
+        return;
+    }
+
+    packet->next = NULL;
+    if (flow->outTail[packet->dir])     flow->outTail[packet->dir]->next = packet;
+    else                                flow->outHead[packet->dir] = packet;
+    flow->outTail[packet->dir] = packet;
+    flush_tcp(packet->flow, packet->dir);
+}
+
+/*Write the released chunks of a TCP direction until its destination would block; an empty chunk ends the stream. Returns -1 if the flow was closed*/
+int flush_tcp(int index, int dir)
+{
+    Flow *flow = &flows[index];
+    int sock = dir == FORWARD ? flow->up : flow->down;
+    while (flow->outHead[dir])
+    {
+        Packet *packet = flow->outHead[dir];
+        if (packet->length == 0)
+        {
+            shutdown(sock, SHUT_WR);
+            flow->writeEnd[dir] = true;
+        }
+        else
+        {
+            ssize_t written = send(sock, packet->data + packet->written, packet->length - packet->written, 0);
+            if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return 0;
+            if (written < 0)
+            {
+                flow_close(index, strerror(errno));
+                return -1;
+            }
+            packet->written += written;
+            if (packet->written < packet->length)
+                continue;
+            links[dir].sent++;
+        }
+        flow->held[dir] -= packet->length;
+        flow->outHead[dir] = packet->next;
+        if (flow->outHead[dir] == NULL)
+            flow->outTail[dir] = NULL;
+        free(packet);
+    }
+
+    if (flow->writeEnd[FORWARD] && flow->writeEnd[BACKWARD])
+    {
+        flow_close(index, "both sides done");
+        return -1;
+    }
+    return 0;
+}
+
+/*Read the datagrams waiting on a UDP socket: the listener's come from senders, a flow's socket holds its receiver's replies*/
+void read_udp(int sock, int index, uint64_t now)
+{
+    for (;;)
+    {
+        Packet *packet = malloc(sizeof(Packet) + PROXY_BUFFER_SIZE);
+        if (packet == NULL)
+            return;
+        struct sockaddr_in from;
+        socklen_t fromLength = sizeof(from);
+        ssize_t length = recvfrom(sock, packet->data, PROXY_BUFFER_SIZE, 0, (struct sockaddr *)&from, &fromLength);
+        if (length < 0)
+        {
+            free(packet);
+            return;
+        }
+
+        int flow = index;
+        if (index < 0)
+        {
+            flow = -1;
+            for (int i = 0; i < MAX_FLOWS && flow < 0; i++)
+            {
+                if (flows[i].used && flows[i].client.sin_port == from.sin_port && flows[i].client.sin_addr.s_addr == from.sin_addr.s_addr)
+                    flow = i;
+            }
+            if (flow < 0 && (flow = flow_open_udp(&from, now)) < 0)
+            {
+                free(packet);
+                continue;
+            }
+        }
+        flows[flow].lastActive = now;
+
+        Packet *shrunk = realloc(packet, sizeof(Packet) + length);     // Only the datagram stays allocated while it waits
+        if (shrunk)
+            packet = shrunk;
+        packet->flow = flow;
+        packet->generation = flows[flow].generation;
+        packet->dir = index < 0 ? FORWARD : BACKWARD;
+        packet->length = length;
+        impair_packet(packet, now);
+    }
+}
+
+/*Read a chunk from the source of a TCP direction; its end of stream is scheduled like data, so it arrives after the last byte*/
+void read_tcp(int index, int dir, uint64_t now)
+{
+    Flow *flow = &flows[index];
+    if (flow->readEnd[dir])
+        return;
+    Packet *packet = malloc(sizeof(Packet) + PROXY_BUFFER_SIZE);
+    if (packet == NULL)
+        return;
+
+    ssize_t length = recv(dir == FORWARD ? flow->down : flow->up, packet->data, PROXY_BUFFER_SIZE, 0);
+    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        free(packet);
+        return;
+    }
+    if (length < 0)
+    {
+        free(packet);
+        flow_close(index, strerror(errno));
+        return;
+    }
+    if (length == 0)
+        flow->readEnd[dir] = true;
+
+    Packet *shrunk = realloc(packet, sizeof(Packet) + length);
+    if (shrunk)
+        packet = shrunk;
+    packet->flow = index;
+    packet->generation = flow->generation;
+    packet->dir = dir;
+    packet->length = length;
+    packet->written = 0;
+    impair_packet(packet, now);
+}
+
+/*Print what happened to the packets of each direction*/
+void print_statistics(void)
+{
+    log_plain("\n");
+    log_plain("---------------------------------------------\n");
+    log_plain("           Impairment Statistics            \n");
+    log_plain("---------------------------------------------\n");
+    for (int dir = 0; dir < 2; dir++)
+    {
+        Link *link = &links[dir];
+        log_plain("%s: %ld %s (%ld bytes) received, %ld sent\n", dir == FORWARD ? "Sender to receiver" : "Receiver to sender",
+               link->packets, tcpMode ? "chunks" : "packets", link->bytes, link->sent);
+        if (!tcpMode)
+            log_plain("  lost %ld (random) + %ld (burst), queue drops %ld, duplicated %ld, corrupted %ld, reordered %ld\n",
+                   link->lost, link->burstLost, link->queueDrops, link->duplicated, link->corrupted, link->reordered);
+    }
+    log_plain("---------------------------------------------\n");
+}
+
+/*Stop the relay loop (SIGINT, SIGTERM)*/
+void on_signal(int sig)
+{
+    (void)sig;
+    stopping = 1;
+}
+
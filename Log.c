@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>    // For the drainer's sleep between passes
+#include "Log.h"
+#include "Timing.h"
+
+#define LOG_RING_SLOTS 256              // Records per thread ring (a power of two)
+#define LOG_RECORD_SIZE 512             // Bytes per record, message included
+#define LOG_DRAIN_INTERVAL_MS 20        // Longest time a message waits in its ring
+
+// One message, formatted by its thread; the timestamp is formatted by the drainer
+typedef struct {
+    uint64_t sequence;                  // Order of the message among all threads' messages
+    int64_t second;                     // Wall clock second the message was logged in
+    uint16_t length;                    // Bytes of "text"
+    uint8_t stamped;                    // Prefix the timestamp
+    char text[LOG_RECORD_SIZE - 19];    // The message (not NUL-terminated)
+} Log_Record;
+
+// A thread's ring: the owner thread publishes records at "head", the drainer consumes them at "tail"
+typedef struct Log_Ring {
+    Log_Record slots[LOG_RING_SLOTS];
+    uint32_t head __attribute__((aligned(64)));     // Records published (written by the owner only)
+    uint64_t dropped;                   // Messages dropped on a full ring (reported by the drainer)
+    uint32_t tail __attribute__((aligned(64)));     // Records consumed (written by the drainer only)
+    int owned;                          // Cleared when the owner thread exits, so another thread adopts the ring
+    struct Log_Ring *next;              // The list of every ring
+} Log_Ring;
+
+int logLevel = LOG_INFO;
+
+static pthread_once_t logOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t logKey;            // Releases a thread's ring when the thread exits
+static __thread Log_Ring *logRing;      // The calling thread's ring
+static Log_Ring *logRings;              // Every ring ever registered (never shrinks)
+static uint64_t logSequence;            // Next message's sequence number
+static pthread_mutex_t logDrainLock = PTHREAD_MUTEX_INITIALIZER;   // One drain at a time (drainer or log_flush)
+static pthread_t logDrainer;
+static int logDraining = 0;             // Set while the drainer thread runs
+static int logStopping = 0;             // Tells the drainer to exit
+static uint32_t logWake = 0;            // Futex word: bumped to wake the drainer early
+static int64_t cachedSecond = -1;       // Second of "cachedStamp" (drainer side, under logDrainLock)
+static char cachedStamp[16];            // "[HH:MM:SS] " of "cachedSecond"
+
+static void log_stop(void);
+
+
+/********************************************************/
+/* Wake the drainer before its next pass is due         */
+/********************************************************/
+static void log_wake(void)
+{
+    __atomic_add_fetch(&logWake, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &logWake, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/********************************************************/
+/* Write one record to stdout, with its timestamp       */
+/* (called under logDrainLock)                          */
+/********************************************************/
+static void log_emit(const Log_Record *record)
+{
+    if (record->stamped)
+    {
+        if (record->second != cachedSecond)     // Formatted once per second, not once per message
+        {
+            time_t second = (time_t)record->second;
+            struct tm tm_info;
+            localtime_r(&second, &tm_info);
+            strftime(cachedStamp, sizeof(cachedStamp), "[%H:%M:%S] ", &tm_info);
+            cachedSecond = record->second;
+        }
+        fputs(cachedStamp, stdout);
+    }
+    fwrite(record->text, 1, record->length, stdout);
+}
+
+/********************************************************/
+/* Write every published record of every ring, merged   */
+/* in sequence order, and report dropped messages.      */
+/* Returns the number of records written                */
+/********************************************************/
+static int log_drain(void)
+{
+    int drained = 0;
+    pthread_mutex_lock(&logDrainLock);
+    for (;;)
+    {
+        // The oldest record at the tail of a ring goes first
+        Log_Ring *oldest = NULL;
+        const Log_Record *record = NULL;
+        for (Log_Ring *ring = __atomic_load_n(&logRings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next)
+        {
+            if (ring->tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+                continue;
+            const Log_Record *candidate = &ring->slots[ring->tail % LOG_RING_SLOTS];
+            if (record == NULL || candidate->sequence < record->sequence)
+            {
+                oldest = ring;
+                record = candidate;
+            }
+        }
+        if (record == NULL)
+            break;
+        log_emit(record);
+        __atomic_store_n(&oldest->tail, oldest->tail + 1, __ATOMIC_RELEASE);   // The slot may be reused
+        drained++;
+    }
+
+    unsigned long long dropped = 0;
+    for (Log_Ring *ring = __atomic_load_n(&logRings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next)
+        dropped += __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0)
+    {
+        Log_Record record = {.second = time(NULL), .stamped = 1};
+        record.length = snprintf(record.text, sizeof(record.text), "%llu log message(s) dropped (log ring full)\n", dropped);
+        log_emit(&record);
+        drained++;
+    }
+
+    if (drained > 0)
+        fflush(stdout);
+    pthread_mutex_unlock(&logDrainLock);
+    return drained;
+}
+
+/********************************************************/
+/* Drainer thread: a pass every LOG_DRAIN_INTERVAL_MS,  */
+/* or as soon as a producer wakes it                    */
+/********************************************************/
+static void *log_drainer(void *arg)
+{
+    (void)arg;
+    struct timespec interval = {0, LOG_DRAIN_INTERVAL_MS * 1000000L};
+    while (!__atomic_load_n(&logStopping, __ATOMIC_ACQUIRE))
+    {
+        uint32_t wake = __atomic_load_n(&logWake, __ATOMIC_ACQUIRE);
+        if (log_drain() == 0)
+            syscall(SYS_futex, &logWake, FUTEX_WAIT_PRIVATE, wake, &interval, NULL, 0);
+    }
+    return NULL;
+}
+
+/********************************************************/
+/* A thread exits: its ring (and what is still in it)   */
+/* is left for the next thread that logs                */
+/********************************************************/
+static void log_release(void *ring)
+{
+    __atomic_store_n(&((Log_Ring *)ring)->owned, 0, __ATOMIC_RELEASE);
+}
+
+/********************************************************/
+/* Start the drainer once per process. It blocks every  */
+/* signal, so signals keep interrupting the threads     */
+/* that wait for them                                   */
+/********************************************************/
+static void log_start(void)
+{
+    pthread_key_create(&logKey, log_release);
+
+    sigset_t all, previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    if (pthread_create(&logDrainer, NULL, log_drainer, NULL) == 0)
+        logDraining = 1;                // Otherwise every thread drains its own messages
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    atexit(log_stop);
+}
+
+/********************************************************/
+/* Stop the drainer at exit and write what is left      */
+/********************************************************/
+static void log_stop(void)
+{
+    if (__atomic_load_n(&logDraining, __ATOMIC_ACQUIRE))
+    {
+        __atomic_store_n(&logStopping, 1, __ATOMIC_RELEASE);
+        log_wake();
+        pthread_join(logDrainer, NULL);
+        __atomic_store_n(&logDraining, 0, __ATOMIC_RELEASE);
+    }
+    log_drain();
+}
+
+/********************************************************/
+/* The calling thread's ring: adopted from an exited    */
+/* thread, or allocated and pushed on the ring list     */
+/* (NULL if out of memory)                              */
+/********************************************************/
+static Log_Ring *log_ring(void)
+{
+    if (logRing != NULL)
+        return logRing;
+
+    Log_Ring *ring;
+    for (ring = __atomic_load_n(&logRings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next)
+    {
+        int released = 0;
+        if (__atomic_compare_exchange_n(&ring->owned, &released, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+    if (ring == NULL)
+    {
+        if (posix_memalign((void **)&ring, 64, sizeof(Log_Ring)) != 0)
+            return NULL;
+        memset(ring, 0, sizeof(Log_Ring));
+        ring->owned = 1;
+        ring->next = __atomic_load_n(&logRings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&logRings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+    pthread_setspecific(logKey, ring);
+    logRing = ring;
+    return ring;
+}
+
+/********************************************************/
+/* Format a message into a record: the text, the count  */
+/* of suppressed messages before its newline, and a     */
+/* "..." ending if it had to be cut                     */
+/********************************************************/
+static void log_format(Log_Record *record, int stamped, int suppressed, const char *format, va_list args)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);         // The second is all the timestamp shows
+    record->second = now.tv_sec;
+    record->stamped = stamped;
+
+    int size = sizeof(record->text);
+    int length = vsnprintf(record->text, size, format, args);
+    if (length < 0)
+        length = 0;
+    if (suppressed > 0 && length < size)
+    {
+        int newline = length > 0 && record->text[length - 1] == '\n';
+        length -= newline;
+        length += snprintf(record->text + length, size - length, " (%d similar suppressed)%s", suppressed, newline ? "\n" : "");
+    }
+    if (length >= size)
+    {
+        length = size - 1;
+        memcpy(record->text + length - 4, "...\n", 4);
+    }
+    record->length = length;
+}
+
+/********************************************************/
+/* Log a message (printf format) at "level", prefixed   */
+/* with the time if "stamped"; "suppressed" is the      */
+/* count of rate-limited messages skipped before it.    */
+/* Called through the log_* macros, which skip the call */
+/* for disabled levels                                  */
+/********************************************************/
+void log_print(int level, int stamped, int suppressed, const char *format, ...)
+{
+    pthread_once(&logOnce, log_start);
+    va_list args;
+    va_start(args, format);
+
+    Log_Ring *ring = log_ring();
+    if (ring == NULL)
+    {
+        // No ring: write directly, after everything already queued
+        Log_Record record;
+        log_format(&record, stamped, suppressed, format, args);
+        va_end(args);
+        log_drain();
+        pthread_mutex_lock(&logDrainLock);
+        log_emit(&record);
+        fflush(stdout);
+        pthread_mutex_unlock(&logDrainLock);
+        return;
+    }
+
+    // A full ring drops the message, unless it is an error or nobody else drains
+    uint32_t head = ring->head;
+    while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == LOG_RING_SLOTS)
+    {
+        int draining = __atomic_load_n(&logDraining, __ATOMIC_ACQUIRE);
+        if (draining && level != LOG_ERROR)
+        {
+            __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+            va_end(args);
+            log_wake();
+            return;
+        }
+        if (draining)
+        {
+            log_wake();
+            sched_yield();
+        }
+        else
+            log_drain();
+    }
+
+    Log_Record *record = &ring->slots[head % LOG_RING_SLOTS];
+    log_format(record, stamped, suppressed, format, args);
+    va_end(args);
+    record->sequence = __atomic_fetch_add(&logSequence, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    // Errors are written at once, and a filling ring is drained before it overflows
+    if (!__atomic_load_n(&logDraining, __ATOMIC_ACQUIRE))
+        log_drain();
+    else if ((level == LOG_ERROR && stamped) || head + 1 - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) >= LOG_RING_SLOTS / 2)
+        log_wake();
+}
+
+/********************************************************/
+/* Rate limit of a log site: returns -1 if a message    */
+/* was let through less than "interval_ms" ago (this    */
+/* one is suppressed), otherwise the number of messages */
+/* suppressed since the last one let through            */
+/********************************************************/
+int log_limit(Log_Limit *limit, unsigned interval_ms)
+{
+    uint64_t now = timing_now_ns();
+    uint64_t next = __atomic_load_n(&limit->next, __ATOMIC_RELAXED);
+    if (now < next || !__atomic_compare_exchange_n(&limit->next, &next, now + interval_ms * 1000000ULL, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        __atomic_add_fetch(&limit->suppressed, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    return (int)__atomic_exchange_n(&limit->suppressed, 0, __ATOMIC_RELAXED);
+}
+
+/********************************************************/
+/* Write every message logged so far, then flush stdout */
+/* (before printing directly or reading the terminal)   */
+/********************************************************/
+void log_flush(void)
+{
+    log_drain();
+    fflush(stdout);
+}
+
+/********************************************************/
+/* Apply a command-line flag if it is the log one       */
+/* (-log error|warn|info|debug). Returns 1 if it was    */
+/* applied, 0 if it is not the log flag and -1 if its   */
+/* value is invalid                                     */
+/********************************************************/
+int log_option(const char *flag, const char *value)
+{
+    static const char *names[] = {"error", "warn", "info", "debug"};
+    if (strcmp(flag, "-log") != 0)
+        return 0;
+    for (int level = LOG_ERROR; level <= LOG_DEBUG; level++)
+    {
+        if (strcmp(value, names[level]) == 0)
+        {
+            logLevel = level;
+            return 1;
+        }
+    }
+    fprintf(stderr, "Invalid log level '%s' (available: error, warn, info, debug)\n", value);
+    return -1;
+}
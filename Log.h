@@ -0,0 +1,58 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+
+/*
+ * Asynchronous logging shared by all the programs. A log call formats its
+ * message into a ring owned by the calling thread (a single-producer ring of
+ * fixed-size records, registered on the thread's first message) and returns:
+ * it takes no lock and makes no system call. A background thread drains every
+ * ring in message order, prefixes the "[HH:MM:SS] " timestamp - formatted once
+ * per second, from the coarse clock second the message recorded - and writes
+ * to stdout. A thread whose ring is full drops its message (counted, and
+ * reported by the drainer) unless it is an error, which waits for room.
+ *
+ * Messages below the level set with -log error|warn|info|debug (default info)
+ * cost one comparison, so debug messages stay compiled in. Messages a site
+ * may emit once per segment go through log_ratelimited(), which lets one
+ * message through per interval and appends how many were suppressed. Report
+ * output (statistics, separators) goes through log_plain(): no timestamp, at
+ * every level, and in order with the messages around it. log_flush() writes
+ * everything logged so far, e.g. before reading an answer from the terminal.
+ */
+
+enum { LOG_ERROR, LOG_WARN, LOG_INFO, LOG_DEBUG };
+
+#define LOG_SEGMENT_INTERVAL_MS 1000    // Interval of the rate-limited per-segment messages
+
+// State of one rate-limited log site
+typedef struct {
+    uint64_t next;                      // Earliest time of the next message (timing_now_ns)
+    uint32_t suppressed;                // Messages suppressed since the last one written
+} Log_Limit;
+
+extern int logLevel;                    // Messages above this level are skipped (-log)
+
+#define log_enabled(level) ((level) <= logLevel)
+#define log_at(level, ...) do { if (log_enabled(level)) log_print((level), 1, 0, __VA_ARGS__); } while (0)
+#define log_error(...) log_at(LOG_ERROR, __VA_ARGS__)
+#define log_warn(...) log_at(LOG_WARN, __VA_ARGS__)
+#define log_info(...) log_at(LOG_INFO, __VA_ARGS__)
+#define log_debug(...) log_at(LOG_DEBUG, __VA_ARGS__)
+#define log_plain(...) log_print(LOG_ERROR, 0, 0, __VA_ARGS__)    // Report output: no timestamp, never filtered or dropped
+
+// At most one message per "interval_ms" from this site
+#define log_ratelimited(level, interval_ms, ...) do {                                       \
+        static Log_Limit logLimit_;                                                         \
+        int logSuppressed_;                                                                 \
+        if (log_enabled(level) && (logSuppressed_ = log_limit(&logLimit_, (interval_ms))) >= 0) \
+            log_print((level), 1, logSuppressed_, __VA_ARGS__);                             \
+    } while (0)
+
+void log_print(int level, int stamped, int suppressed, const char *format, ...) __attribute__((format(printf, 4, 5)));
+int log_limit(Log_Limit *limit, unsigned interval_ms);
+void log_flush(void);
+int log_option(const char *flag, const char *value);
+
+#endif
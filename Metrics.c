@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>    // For TCP_INFO
+#include "Metrics.h"
+#include "Timing.h"
+#include "Log.h"
+
+const Metrics_Info metricsInfo[METRIC_COUNT] = {
+    [METRIC_BYTES]              = {"bytes_total", "counter", "Payload bytes sent (first transmissions) or received in order", 1},
+    [METRIC_SEGMENTS]           = {"segments_total", "counter", "Data segments sent for the first time or received in order", 1},
+    [METRIC_RETRANSMISSIONS]    = {"retransmissions_total", "counter", "Segments transmitted again", 1},
+    [METRIC_CHECKSUM_FAILURES]  = {"checksum_failures_total", "counter", "Packets dropped by the integrity check", 1},
+    [METRIC_TIMEOUTS]           = {"timeouts_total", "counter", "Retransmission timeouts", 1},
+    [METRIC_RUNS]               = {"runs_total", "counter", "Runs completed", 1},
+    [METRIC_RTO]                = {"rto_seconds", "gauge", "Current retransmission timeout", 1e-6},
+    [METRIC_SRTT]               = {"srtt_seconds", "gauge", "Smoothed round-trip time", 1e-6},
+    [METRIC_RTTVAR]             = {"rttvar_seconds", "gauge", "Round-trip time variance", 1e-6},
+    [METRIC_CWND]               = {"cwnd_segments", "gauge", "Congestion window", 1e-3},
+    [METRIC_IN_FLIGHT]          = {"in_flight_segments", "gauge", "Segments from the oldest unacknowledged one to the next one to send", 1},
+    [METRIC_RCV_RTT]            = {"rcv_rtt_seconds", "gauge", "Receiver's estimate of the round-trip time", 1e-6},
+};
+
+static Metrics_Segment localSegment;    // Blocks of a program run without -metrics
+static Metrics_Segment *segment = &localSegment;
+static Metrics_Block overflowBlock;     // Handed out once every block is taken
+static bool requested = false;          // -metrics 1
+static char segmentName[96];            // Name given to shm_open(3)
+
+
+/********************************************************/
+/* Remove the segment when the program exits            */
+/********************************************************/
+static void metrics_remove(void)
+{
+    shm_unlink(segmentName);
+}
+
+/********************************************************/
+/* Apply a command-line flag if it is the metrics one   */
+/* (-metrics 0|1). Returns 1 if it was applied, 0 if it */
+/* is not the metrics flag and -1 if its value is       */
+/* invalid                                              */
+/********************************************************/
+int metrics_option(const char *flag, const char *value)
+{
+    if (strcmp(flag, "-metrics") != 0)
+        return 0;
+    if (strcmp(value, "0") != 0 && strcmp(value, "1") != 0)
+    {
+        fprintf(stderr, "Invalid metrics setting '%s' (0 or 1)\n", value);
+        return -1;
+    }
+    requested = value[0] == '1';
+    return 1;
+}
+
+/********************************************************/
+/* Create the program's segment if -metrics 1 was       */
+/* given; call it before any block is claimed. Returns  */
+/* 0 on success (or without -metrics), -1 on failure    */
+/********************************************************/
+int metrics_open(const char *program)
+{
+    if (!requested)
+        return 0;
+
+    const char *base = strrchr(program, '/');
+    base = base ? base + 1 : program;
+    snprintf(segmentName, sizeof(segmentName), "/" METRICS_PREFIX "%s.%d", base, (int)getpid());
+    int fd = shm_open(segmentName, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        perror("shm_open(3)");
+        return -1;
+    }
+    Metrics_Segment *shared = MAP_FAILED;
+    if (ftruncate(fd, sizeof(Metrics_Segment)) == 0)
+        shared = mmap(NULL, sizeof(Metrics_Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED)
+    {
+        perror("mmap(2): metrics");
+        shm_unlink(segmentName);
+        return -1;
+    }
+    atexit(metrics_remove);
+
+    shared->version = METRICS_VERSION;
+    shared->pid = getpid();
+    snprintf(shared->program, sizeof(shared->program), "%s", base);
+    shared->startTime = time(NULL);
+    __atomic_store_n(&shared->magic, METRICS_MAGIC, __ATOMIC_RELEASE);
+    segment = shared;
+    log_info("Live metrics in /dev/shm%s (read them with Metrics_Reader)\n", segmentName);
+    return 0;
+}
+
+/********************************************************/
+/* Take a free block of the segment for the calling     */
+/* thread, maintaining the metrics of "mask", labelled  */
+/* by the printf-style "format" (Prometheus labels,     */
+/* e.g. stream="%d"). Never fails: once every block is  */
+/* taken, an unexported spare one is returned           */
+/********************************************************/
+Metrics_Block *metrics_claim(uint32_t mask, const char *format, ...)
+{
+    for (int i = 0; i < METRICS_MAX_BLOCKS; i++)
+    {
+        Metrics_Block *block = &segment->block[i];
+        uint32_t expected = METRICS_FREE;
+        if (!__atomic_compare_exchange_n(&block->state, &expected, METRICS_CLAIMED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            continue;
+
+        memset(block->values, 0, sizeof(block->values));
+        block->mask = mask;
+        block->nextSample = 0;
+        va_list args;
+        va_start(args, format);
+        vsnprintf(block->label, sizeof(block->label), format, args);
+        va_end(args);
+
+        // Readers scan the blocks below the high-water mark, and show those published as live
+        uint32_t blocks = __atomic_load_n(&segment->blocks, __ATOMIC_RELAXED);
+        while (blocks < (uint32_t)i + 1 && !__atomic_compare_exchange_n(&segment->blocks, &blocks, i + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+        __atomic_store_n(&block->state, METRICS_LIVE, __ATOMIC_RELEASE);
+        return block;
+    }
+    log_ratelimited(LOG_WARN, 60000, "All %d metrics blocks are taken; new connections are not exported\n", METRICS_MAX_BLOCKS);
+    return &overflowBlock;
+}
+
+/********************************************************/
+/* Hand a block back once its connection, stream or     */
+/* worker is gone                                       */
+/********************************************************/
+void metrics_release(Metrics_Block *block)
+{
+    if (block != &overflowBlock)
+        __atomic_store_n(&block->state, METRICS_FREE, __ATOMIC_RELEASE);
+}
+
+/********************************************************/
+/* Copy the kernel's view of a TCP socket (TCP_INFO)    */
+/* into the block's gauges, at most once per            */
+/* METRICS_SAMPLE_MS; nothing without -metrics          */
+/********************************************************/
+void metrics_tcp_info(Metrics_Block *block, int sock)
+{
+    if (segment == &localSegment)
+        return;
+    uint64_t now = timing_now_ns();
+    if (now < block->nextSample)
+        return;
+    block->nextSample = now + METRICS_SAMPLE_MS * 1000000ULL;
+
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+    if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &length) < 0)
+        return;
+    metrics_set(block, METRIC_RTO, info.tcpi_rto);
+    metrics_set(block, METRIC_SRTT, info.tcpi_rtt);
+    metrics_set(block, METRIC_RTTVAR, info.tcpi_rttvar);
+    metrics_set(block, METRIC_CWND, (int64_t)info.tcpi_snd_cwnd * 1000);
+    metrics_set(block, METRIC_IN_FLIGHT, info.tcpi_unacked);
+    metrics_set(block, METRIC_RETRANSMISSIONS, info.tcpi_total_retrans);
+    metrics_set(block, METRIC_RCV_RTT, info.tcpi_rcv_rtt);
+}
@@ -0,0 +1,102 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+/*
+ * Live counters of a running transfer. Given -metrics 1, a program creates
+ * the shared-memory segment /dev/shm/net_metrics.<PROGRAM>.<PID> and every
+ * thread moving data owns a block of it (a sender's connection or stream, a
+ * receiver's worker or connection): it is the block's only writer, so an
+ * update is a plain relaxed atomic store - no lock, no read-modify-write, no
+ * system call. Gauges such as the RTO or the congestion window are stored as
+ * the data path changes them; on the TCP side they come from TCP_INFO,
+ * sampled at most every METRICS_SAMPLE_MS. Metrics_Reader prints the live
+ * segments, or serves them in the Prometheus text format over HTTP or a Unix
+ * socket. Without -metrics the blocks live in private memory and the updates
+ * cost the same few stores. The segment is removed when the program exits;
+ * one left behind by a killed program is removed by the reader.
+ */
+
+#define METRICS_PREFIX "net_metrics."   // Name of the segments in /dev/shm: PREFIX + program + "." + pid
+#define METRICS_MAGIC 0x4d455452        // "METR": first field of a segment
+#define METRICS_VERSION 1               // Layout of the segment (bumped on any change)
+#define METRICS_MAX_BLOCKS 64           // Blocks per segment (connections, streams or workers)
+#define METRICS_LABEL_SIZE 48           // Prometheus labels of a block, e.g. stream="2"
+#define METRICS_SAMPLE_MS 100           // Shortest interval between two TCP_INFO samples of a block
+
+// The metrics; the unit of every value is given by metricsInfo
+enum {
+    METRIC_BYTES,                       // Payload bytes sent (first transmissions) or received in order
+    METRIC_SEGMENTS,                    // Data segments sent for the first time, or received in order
+    METRIC_RETRANSMISSIONS,             // Segments sent again (RUDP), or the kernel's total retransmissions (TCP)
+    METRIC_CHECKSUM_FAILURES,           // Packets dropped by the integrity check
+    METRIC_TIMEOUTS,                    // Retransmission timeouts (once per timeout event)
+    METRIC_RUNS,                        // Runs completed
+    METRIC_RTO,                         // Current retransmission timeout (us)
+    METRIC_SRTT,                        // Smoothed RTT (us)
+    METRIC_RTTVAR,                      // RTT variance (us)
+    METRIC_CWND,                        // Congestion window (thousandths of a segment)
+    METRIC_IN_FLIGHT,                   // Segments from the oldest unacknowledged one to the next one to send
+    METRIC_RCV_RTT,                     // Receiver's estimate of the RTT (us, TCP_INFO)
+    METRIC_COUNT
+};
+
+#define METRIC_BIT(metric) (1u << (metric))
+
+// Metrics a block of each kind maintains (the others are not exported)
+#define METRICS_RUDP_SENDER (METRIC_BIT(METRIC_BYTES) | METRIC_BIT(METRIC_SEGMENTS) | METRIC_BIT(METRIC_RETRANSMISSIONS) | \
+                             METRIC_BIT(METRIC_CHECKSUM_FAILURES) | METRIC_BIT(METRIC_TIMEOUTS) | METRIC_BIT(METRIC_RUNS) | \
+                             METRIC_BIT(METRIC_RTO) | METRIC_BIT(METRIC_SRTT) | METRIC_BIT(METRIC_RTTVAR) | \
+                             METRIC_BIT(METRIC_CWND) | METRIC_BIT(METRIC_IN_FLIGHT))
+#define METRICS_RUDP_RECEIVER (METRIC_BIT(METRIC_BYTES) | METRIC_BIT(METRIC_SEGMENTS) | METRIC_BIT(METRIC_CHECKSUM_FAILURES) | \
+                               METRIC_BIT(METRIC_RUNS))
+#define METRICS_TCP_SENDER (METRIC_BIT(METRIC_BYTES) | METRIC_BIT(METRIC_RETRANSMISSIONS) | METRIC_BIT(METRIC_RUNS) | \
+                            METRIC_BIT(METRIC_RTO) | METRIC_BIT(METRIC_SRTT) | METRIC_BIT(METRIC_RTTVAR) | \
+                            METRIC_BIT(METRIC_CWND) | METRIC_BIT(METRIC_IN_FLIGHT))
+#define METRICS_TCP_RECEIVER (METRIC_BIT(METRIC_BYTES) | METRIC_BIT(METRIC_RUNS) | METRIC_BIT(METRIC_RCV_RTT))
+
+// Block states (a reader shows only live blocks)
+enum { METRICS_FREE, METRICS_CLAIMED, METRICS_LIVE };
+
+// Counters of one connection, stream or worker; written by a single thread
+typedef struct {
+    uint32_t state;                     // METRICS_FREE, METRICS_CLAIMED (being set up) or METRICS_LIVE
+    uint32_t mask;                      // Metrics the block maintains (METRIC_BIT set)
+    char label[METRICS_LABEL_SIZE];     // Prometheus labels, e.g. connection="3"
+    uint64_t nextSample;                // Earliest next TCP_INFO sample (timing_now_ns; writer only)
+    int64_t values[METRIC_COUNT];
+} __attribute__((aligned(64))) Metrics_Block;
+
+// Layout of a segment
+typedef struct {
+    uint32_t magic;                     // METRICS_MAGIC, stored last once the header is complete
+    uint32_t version;                   // METRICS_VERSION
+    int32_t pid;                        // The writing process
+    uint32_t blocks;                    // Blocks ever claimed (upper bound of the blocks to scan)
+    char program[32];                   // Name of the writing program
+    int64_t startTime;                  // Creation of the segment (seconds since the epoch)
+    Metrics_Block block[METRICS_MAX_BLOCKS];
+} Metrics_Segment;
+
+// Description of a metric, for the readers
+typedef struct {
+    const char *name;                   // Prometheus name, without the "net_" prefix
+    const char *type;                   // "counter" or "gauge"
+    const char *help;
+    double scale;                       // Exported value = stored value * scale
+} Metrics_Info;
+
+extern const Metrics_Info metricsInfo[METRIC_COUNT];
+
+// Relaxed atomic stores by the block's only writer: readers never see a torn value
+#define metrics_set(block, metric, value) __atomic_store_n(&(block)->values[metric], (int64_t)(value), __ATOMIC_RELAXED)
+#define metrics_add(block, metric, n) metrics_set((block), (metric), (block)->values[metric] + (n))
+
+int metrics_option(const char *flag, const char *value);
+int metrics_open(const char *program);
+Metrics_Block *metrics_claim(uint32_t mask, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void metrics_release(Metrics_Block *block);
+void metrics_tcp_info(Metrics_Block *block, int sock);
+
+#endif
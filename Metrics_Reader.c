@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>         // For listing the segments in /dev/shm
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>         // For the Unix socket endpoint
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "Metrics.h"
+
+/*
+ * Reader of the live metrics the four programs keep with -metrics 1. It maps
+ * every segment in /dev/shm read-only, copies the live blocks (never locking
+ * or writing anything the programs use) and prints them as a table, once or
+ * every -watch seconds with the throughput since the previous sample, or in
+ * the Prometheus text format. With -http PORT (bound to 127.0.0.1) and/or
+ * -unix PATH it serves that format instead, a fresh copy per request, so a
+ * Prometheus server or curl can scrape a running transfer:
+ *
+ *     curl -s http://127.0.0.1:9464/metrics
+ *     curl -s --unix-socket /tmp/metrics.sock http://localhost/metrics
+ */
+
+#define MAX_PROCESSES 32            // Programs shown at once
+#define REQUEST_SIZE 4096           // Largest HTTP request head read
+#define REQUEST_TIMEOUT_MS 1000     // Longest wait for a scraper's request
+
+// A copy of one program's segment
+typedef struct {
+    char name[NAME_MAX + 1];        // The segment's name in /dev/shm
+    char program[32];
+    int pid;
+    int64_t startTime;
+    int count;                      // Live blocks copied
+    Metrics_Block blocks[METRICS_MAX_BLOCKS];
+} Reader_Process;
+
+// Bytes of a block at the previous -watch sample, for its throughput
+typedef struct {
+    int pid;
+    char label[METRICS_LABEL_SIZE];
+    int64_t bytes;
+} Reader_Previous;
+
+static Reader_Process processes[MAX_PROCESSES];
+static Reader_Previous previous[MAX_PROCESSES * METRICS_MAX_BLOCKS];
+static int previousCount = 0;
+static volatile sig_atomic_t stopping = 0;
+
+
+// Auxiliary function declaration (see full implementation below)
+int read_segments(int pid);
+void print_table(FILE *out, int count, double interval);
+void print_prometheus(FILE *out, int count);
+int open_http(int port);
+int open_unix(const char *path);
+void serve_request(int listener, int pid);
+void on_signal(int sig);
+
+
+/*Main function for the metrics reader.*/
+/*Return 0 if the program successfully runs, and 1 otherwise*/
+int main(int argc, char *argv[])
+{
+
+    /*----------------------------------------*/
+    /*    Validate Command-Line Arguments     */
+    /*----------------------------------------*/
+
+    const char *usage = "Usage: %s [-pid PID] [-format text|prometheus] [-watch SECONDS] [-http PORT] [-unix PATH]\n";
+    int pid = 0, httpPort = 0;
+    double watch = 0;
+    bool prometheus = false, invalid = argc % 2 == 0;
+    const char *unixPath = NULL;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const char *value = argv[i + 1];
+        if (strcmp(argv[i], "-pid") == 0)               invalid |= (pid = atoi(value)) <= 0;
+        else if (strcmp(argv[i], "-watch") == 0)        invalid |= (watch = atof(value)) <= 0;
+        else if (strcmp(argv[i], "-http") == 0)         invalid |= (httpPort = atoi(value)) <= 0 || httpPort > 65535;
+        else if (strcmp(argv[i], "-unix") == 0)         unixPath = value;
+        else if (strcmp(argv[i], "-format") == 0)
+        {
+            if (strcmp(value, "prometheus") == 0)       prometheus = true;
+            else if (strcmp(value, "text") != 0)        invalid = true;
+        }
+        else                                            invalid = true;
+    }
+    if (invalid)
+    {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+
+    /*----------------------------------------*/
+    /*                Main Code               */
+    /*----------------------------------------*/
+
+    struct sigaction action = {.sa_handler = on_signal};   // No SA_RESTART: poll(2) and sleeps return on a signal
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Endpoint: answer every scrape with the segments as they are at that moment
+    if (httpPort > 0 || unixPath != NULL)
+    {
+        struct pollfd fds[2];
+        int count = 0;
+        if (httpPort > 0 && (fds[count++].fd = open_http(httpPort)) < 0)
+            return 1;
+        if (unixPath != NULL && (fds[count++].fd = open_unix(unixPath)) < 0)
+            return 1;
+        for (int i = 0; i < count; i++)
+            fds[i].events = POLLIN;
+        if (httpPort > 0)
+            printf("Serving Prometheus metrics on http://127.0.0.1:%d/metrics\n", httpPort);
+        if (unixPath != NULL)
+            printf("Serving Prometheus metrics on the Unix socket %s\n", unixPath);
+        fflush(stdout);
+
+        while (!stopping)
+        {
+            if (poll(fds, count, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                perror("poll(2)");
+                break;
+            }
+            for (int i = 0; i < count; i++)
+            {
+                if (fds[i].revents & POLLIN)
+                    serve_request(fds[i].fd, pid);
+            }
+        }
+        for (int i = 0; i < count; i++)
+            close(fds[i].fd);
+        if (unixPath != NULL)
+            unlink(unixPath);
+        return 0;
+    }
+
+    // Once, or every "watch" seconds until interrupted
+    do
+    {
+        int count = read_segments(pid);
+        if (prometheus)
+        {
+            print_prometheus(stdout, count);
+        }
+        else
+        {
+            if (watch > 0)
+            {
+                char stamp[16];
+                time_t now = time(NULL);
+                strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&now));
+                printf("---------------- %s ----------------\n", stamp);
+            }
+            if (count == 0)
+                printf("No live metrics%s (start a program with -metrics 1)\n", pid ? " for this pid" : "");
+            print_table(stdout, count, watch);
+        }
+        fflush(stdout);
+        if (watch > 0)
+        {
+            struct timespec pause = {(time_t)watch, (long)((watch - (time_t)watch) * 1e9)};
+            nanosleep(&pause, NULL);
+        }
+    } while (watch > 0 && !stopping);
+
+    return 0;
+}
+
+
+/*----------------------------------------*/
+/*          Auxiliary functions           */
+/*----------------------------------------*/
+
+/* Copy the live blocks of one segment, if its program  */
+/* is still running (a segment left behind by a killed  */
+/* program is removed). Returns 1 if it was copied      */
+static int read_segment(const char *name, Reader_Process *process)
+{
+    char path[NAME_MAX + 2];
+    snprintf(path, sizeof(path), "/%s", name);
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0)
+        return 0;
+    struct stat info;
+    const Metrics_Segment *segment = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(Metrics_Segment))
+        segment = mmap(NULL, sizeof(Metrics_Segment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED)
+        return 0;
+
+    int copied = 0;
+    if (__atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) == METRICS_MAGIC && segment->version == METRICS_VERSION)
+    {
+        if (kill(segment->pid, 0) < 0 && errno == ESRCH)
+        {
+            shm_unlink(path);
+        }
+        else
+        {
+            snprintf(process->name, sizeof(process->name), "%s", name);
+            snprintf(process->program, sizeof(process->program), "%s", segment->program);
+            process->pid = segment->pid;
+            process->startTime = segment->startTime;
+            process->count = 0;
+            uint32_t blocks = __atomic_load_n(&segment->blocks, __ATOMIC_RELAXED);
+            for (uint32_t i = 0; i < blocks && i < METRICS_MAX_BLOCKS; i++)
+            {
+                const Metrics_Block *block = &segment->block[i];
+                if (__atomic_load_n(&block->state, __ATOMIC_ACQUIRE) != METRICS_LIVE)
+                    continue;
+                Metrics_Block *copy = &process->blocks[process->count];
+                copy->mask = block->mask;
+                memcpy(copy->label, block->label, sizeof(copy->label));
+                copy->label[sizeof(copy->label) - 1] = '\0';
+                for (int m = 0; m < METRIC_COUNT; m++)
+                    copy->values[m] = __atomic_load_n(&block->values[m], __ATOMIC_RELAXED);
+                if (__atomic_load_n(&block->state, __ATOMIC_ACQUIRE) == METRICS_LIVE)   // Not reused while copied
+                    process->count++;
+            }
+            copied = 1;
+        }
+    }
+    munmap((void *)segment, sizeof(Metrics_Segment));
+    return copied;
+}
+
+/* Copy the segments of every running program (or only */
+/* of "pid" if not 0). Returns the number copied        */
+int read_segments(int pid)
+{
+    DIR *dir = opendir("/dev/shm");
+    if (dir == NULL)
+    {
+        perror("opendir(3): /dev/shm");
+        return 0;
+    }
+    int count = 0;
+    struct dirent *entry;
+    while (count < MAX_PROCESSES && (entry = readdir(dir)) != NULL)
+    {
+        if (strncmp(entry->d_name, METRICS_PREFIX, strlen(METRICS_PREFIX)) != 0)
+            continue;
+        const char *dot = strrchr(entry->d_name, '.');
+        if (pid && (dot == NULL || atoi(dot + 1) != pid))
+            continue;
+        count += read_segment(entry->d_name, &processes[count]);
+    }
+    closedir(dir);
+    return count;
+}
+
+/* Bytes of a block at the previous sample (-1 if it is */
+/* new), remembering the current ones for the next      */
+static int64_t previous_bytes(int pid, const Metrics_Block *block)
+{
+    for (int i = 0; i < previousCount; i++)
+    {
+        if (previous[i].pid == pid && strcmp(previous[i].label, block->label) == 0)
+        {
+            int64_t bytes = previous[i].bytes;
+            previous[i].bytes = block->values[METRIC_BYTES];
+            return bytes;
+        }
+    }
+    if (previousCount < (int)(sizeof(previous) / sizeof(previous[0])))
+    {
+        previous[previousCount] = (Reader_Previous){.pid = pid, .bytes = block->values[METRIC_BYTES]};
+        memcpy(previous[previousCount++].label, block->label, sizeof(block->label));
+    }
+    return -1;
+}
+
+/* Print the copied segments as a table: one line per   */
+/* block with its metrics, and its throughput since the */
+/* previous sample when watching                        */
+void print_table(FILE *out, int count, double interval)
+{
+    time_t now = time(NULL);
+    for (int p = 0; p < count; p++)
+    {
+        Reader_Process *process = &processes[p];
+        fprintf(out, "%s (pid %d, up %lld s): %d block(s)\n", process->program, process->pid, (long long)(now - process->startTime), process->count);
+        for (int b = 0; b < process->count; b++)
+        {
+            Metrics_Block *block = &process->blocks[b];
+            fprintf(out, "  %-24s", block->label);
+            for (int m = 0; m < METRIC_COUNT; m++)
+            {
+                if (!(block->mask & METRIC_BIT(m)))
+                    continue;
+                if (metricsInfo[m].scale == 1)
+                    fprintf(out, " %s=%lld", metricsInfo[m].name, (long long)block->values[m]);
+                else
+                    fprintf(out, " %s=%g", metricsInfo[m].name, block->values[m] * metricsInfo[m].scale);
+            }
+            int64_t before = interval > 0 ? previous_bytes(process->pid, block) : -1;
+            if (before >= 0)
+                fprintf(out, " rate=%.3fMbit/s", (block->values[METRIC_BYTES] - before) * 8 / 1e6 / interval);
+            fputc('\n', out);
+        }
+    }
+}
+
+/* Print the copied segments in the Prometheus text     */
+/* format (version 0.0.4): every metric once, with one  */
+/* sample per block maintaining it                      */
+void print_prometheus(FILE *out, int count)
+{
+    for (int m = 0; m < METRIC_COUNT; m++)
+    {
+        bool header = false;
+        for (int p = 0; p < count; p++)
+        {
+            Reader_Process *process = &processes[p];
+            for (int b = 0; b < process->count; b++)
+            {
+                Metrics_Block *block = &process->blocks[b];
+                if (!(block->mask & METRIC_BIT(m)))
+                    continue;
+                if (!header)
+                {
+                    fprintf(out, "# HELP net_%s %s\n# TYPE net_%s %s\n", metricsInfo[m].name, metricsInfo[m].help, metricsInfo[m].name, metricsInfo[m].type);
+                    header = true;
+                }
+                fprintf(out, "net_%s{program=\"%s\",pid=\"%d\"%s%s} ", metricsInfo[m].name, process->program, process->pid,
+                        block->label[0] ? "," : "", block->label);
+                if (metricsInfo[m].scale == 1)
+                    fprintf(out, "%lld\n", (long long)block->values[m]);
+                else
+                    fprintf(out, "%.9g\n", block->values[m] * metricsInfo[m].scale);
+            }
+        }
+    }
+}
+
+/* Listen for scrapes on 127.0.0.1:port. Returns the    */
+/* listening socket, or -1 on error                     */
+int open_http(int port)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK), .sin_port = htons(port)};
+    int reuse = 1;
+    if (sock < 0 || setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+        bind(sock, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(sock, 16) < 0)
+    {
+        perror("bind(2): -http");
+        if (sock >= 0)
+            close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* Listen for scrapes on a Unix socket at "path" (an    */
+/* old socket file there is replaced). Returns the      */
+/* listening socket, or -1 on error                     */
+int open_unix(const char *path)
+{
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "The Unix socket path is longer than %zu characters\n", sizeof(address.sun_path) - 1);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    struct stat info;
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode))
+        unlink(path);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(sock, 16) < 0)
+    {
+        perror("bind(2): -unix");
+        if (sock >= 0)
+            close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* Answer one scrape: read the request head, then send  */
+/* the metrics for GET /metrics (or GET /), a 404 for   */
+/* other paths and a 405 for other methods              */
+void serve_request(int listener, int pid)
+{
+    int client = accept(listener, NULL, NULL);
+    if (client < 0)
+        return;
+
+    // Read until the end of the request head, without waiting forever for a slow client
+    char request[REQUEST_SIZE];
+    size_t length = 0;
+    struct pollfd fd = {.fd = client, .events = POLLIN};
+    while (length < sizeof(request) - 1 && poll(&fd, 1, REQUEST_TIMEOUT_MS) > 0)
+    {
+        ssize_t bytes = recv(client, request + length, sizeof(request) - 1 - length, 0);
+        if (bytes <= 0)
+            break;
+        length += bytes;
+        request[length] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+            break;
+    }
+    request[length] = '\0';
+
+    const char *status = "200 OK";
+    char *body = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&body, &size);
+    if (out == NULL)
+    {
+        close(client);
+        return;
+    }
+    if (strncmp(request, "GET ", 4) != 0)
+    {
+        status = "405 Method Not Allowed";
+        fprintf(out, "Only GET is supported\n");
+    }
+    else if (strncmp(request + 4, "/metrics", 8) != 0 && strncmp(request + 4, "/ ", 2) != 0)
+    {
+        status = "404 Not Found";
+        fprintf(out, "The metrics are at /metrics\n");
+    }
+    else
+    {
+        print_prometheus(out, read_segments(pid));
+    }
+    fclose(out);
+
+    char head[256];
+    int headLength = snprintf(head, sizeof(head), "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                                                  "Content-Length: %zu\r\nConnection: close\r\n\r\n", status, size);
+    if (send(client, head, headLength, 0) == headLength)
+    {
+        for (size_t done = 0; done < size; )
+        {
+            ssize_t bytes = send(client, body + done, size - done, 0);
+            if (bytes <= 0)
+                break;
+            done += bytes;
+        }
+    }
+    free(body);
+    close(client);
+}
+
+/*Stop watching or serving (SIGINT, SIGTERM)*/
+void on_signal(int sig)
+{
+    (void)sig;
+    stopping = 1;
+}
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/random.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>      // For the AVX2 intrinsics
+#define PAYLOAD_X86 1
+#endif
+#include "Payload.h"
+
+#define PAYLOAD_LANES 4                                     // Interleaved xoshiro256** generators per block
+#define PAYLOAD_ROUNDS (PAYLOAD_BLOCK / 8 / PAYLOAD_LANES)  // Outputs of every lane per block
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                     Generators                     **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+/********************************************************/
+/* SplitMix64: expands a seed into well-mixed words     */
+/********************************************************/
+static uint64_t splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/********************************************************/
+/* Seed the lanes of a block: state word "w" of lane    */
+/* "l" is s[w][l]                                       */
+/********************************************************/
+static void payload_seed_lanes(uint64_t s[4][PAYLOAD_LANES], uint64_t seed, uint64_t block)
+{
+    uint64_t state = seed ^ (block * 0xD1B54A32D192ED03ULL);
+    for (int l = 0; l < PAYLOAD_LANES; l++)
+    {
+        for (int w = 0; w < 4; w++)
+            s[w][l] = splitmix64(&state);
+    }
+}
+
+static inline uint64_t rotl64(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/********************************************************/
+/* Portable kernel: one xoshiro256** step of every lane */
+/* per round, outputs stored lane after lane            */
+/********************************************************/
+static void payload_block_scalar(unsigned char *out, uint64_t seed, uint64_t block)
+{
+    uint64_t s[4][PAYLOAD_LANES];
+    payload_seed_lanes(s, seed, block);
+
+    for (int r = 0; r < PAYLOAD_ROUNDS; r++, out += 8 * PAYLOAD_LANES)
+    {
+        for (int l = 0; l < PAYLOAD_LANES; l++)
+        {
+            uint64_t result = rotl64(s[1][l] * 5, 7) * 9;
+            uint64_t t = s[1][l] << 17;
+            s[2][l] ^= s[0][l];
+            s[3][l] ^= s[1][l];
+            s[1][l] ^= s[2][l];
+            s[0][l] ^= s[3][l];
+            s[2][l] ^= t;
+            s[3][l] = rotl64(s[3][l], 45);
+            memcpy(out + 8 * l, &result, sizeof(result));   // Little-endian on every supported target
+        }
+    }
+}
+
+#ifdef PAYLOAD_X86
+#define ROTL_AVX2(x, k) _mm256_or_si256(_mm256_slli_epi64((x), (k)), _mm256_srli_epi64((x), 64 - (k)))
+
+/********************************************************/
+/* AVX2 kernel: the four lanes in one vector per state  */
+/* word; the multiplications by 5 and 9 are shift + add */
+/********************************************************/
+__attribute__((target("avx2")))
+static void payload_block_avx2(unsigned char *out, uint64_t seed, uint64_t block)
+{
+    uint64_t s[4][PAYLOAD_LANES];
+    payload_seed_lanes(s, seed, block);
+    __m256i s0 = _mm256_loadu_si256((const __m256i *)s[0]);
+    __m256i s1 = _mm256_loadu_si256((const __m256i *)s[1]);
+    __m256i s2 = _mm256_loadu_si256((const __m256i *)s[2]);
+    __m256i s3 = _mm256_loadu_si256((const __m256i *)s[3]);
+
+    for (int r = 0; r < PAYLOAD_ROUNDS; r++, out += 32)
+    {
+        __m256i times5 = _mm256_add_epi64(s1, _mm256_slli_epi64(s1, 2));
+        __m256i rotated = ROTL_AVX2(times5, 7);
+        __m256i result = _mm256_add_epi64(rotated, _mm256_slli_epi64(rotated, 3));
+        __m256i t = _mm256_slli_epi64(s1, 17);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = ROTL_AVX2(s3, 45);
+        _mm256_storeu_si256((__m256i *)out, result);
+    }
+}
+#else
+static void payload_block_avx2(unsigned char *out, uint64_t seed, uint64_t block)    { payload_block_scalar(out, seed, block); }
+#endif
+
+typedef void (*Payload_Kernel)(unsigned char *out, uint64_t seed, uint64_t block);
+static Payload_Kernel payload_block = NULL;     // Selected on the first call
+static const char *payload_kernel_name = "scalar";
+
+/********************************************************/
+/* Use the AVX2 kernel when the CPU has it              */
+/********************************************************/
+static void payload_select(void)
+{
+    Payload_Kernel kernel = payload_block_scalar;
+#ifdef PAYLOAD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernel = payload_block_avx2;
+        payload_kernel_name = "avx2";
+    }
+#endif
+    __atomic_store_n(&payload_block, kernel, __ATOMIC_RELEASE);    // Senders' and receivers' threads may race here
+}
+
+static Payload_Kernel payload_get_kernel(void)
+{
+    Payload_Kernel kernel = __atomic_load_n(&payload_block, __ATOMIC_ACQUIRE);
+    if (kernel == NULL)
+    {
+        payload_select();
+        kernel = payload_block;
+    }
+    return kernel;
+}
+
+/********************************************************/
+/* Name of the payload kernel in use                    */
+/********************************************************/
+const char *payload_kernel(void)
+{
+    payload_get_kernel();
+    return payload_kernel_name;
+}
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                   Seeds and ranges                 **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+/********************************************************/
+/* A fresh seed from the kernel's entropy pool (time    */
+/* and PID if it is unavailable)                        */
+/********************************************************/
+uint64_t payload_random_seed(void)
+{
+    uint64_t seed;
+    if (getrandom(&seed, sizeof(seed), 0) != sizeof(seed))
+        seed = ((uint64_t)time(NULL) << 32) ^ getpid();
+    return seed;
+}
+
+/********************************************************/
+/* Seed of run number "run" of a session seeded "seed"  */
+/********************************************************/
+uint64_t payload_run_seed(uint64_t seed, int run)
+{
+    uint64_t state = seed + (uint64_t)run * 0x9E3779B97F4A7C15ULL;
+    return splitmix64(&state);
+}
+
+/********************************************************/
+/* Fill "buffer" with "size" payload bytes starting at  */
+/* byte "offset" of the payload seeded "seed"; whole    */
+/* blocks are generated in place                        */
+/********************************************************/
+void payload_fill(void *buffer, size_t size, uint64_t seed, uint64_t offset)
+{
+    Payload_Kernel kernel = payload_get_kernel();
+    unsigned char *out = buffer;
+    unsigned char block[PAYLOAD_BLOCK];
+
+    while (size > 0)
+    {
+        uint64_t index = offset / PAYLOAD_BLOCK;
+        size_t skip = offset % PAYLOAD_BLOCK;
+        size_t length = PAYLOAD_BLOCK - skip;
+        if (length > size)
+            length = size;
+
+        if (length == PAYLOAD_BLOCK)
+        {
+            kernel(out, seed, index);
+        }
+        else
+        {
+            kernel(block, seed, index);
+            memcpy(out, block + skip, length);
+        }
+        out += length;
+        offset += length;
+        size -= length;
+    }
+}
+
+/********************************************************/
+/* Check "size" bytes against the payload from byte     */
+/* "offset". Returns 1 if they match, 0 otherwise       */
+/********************************************************/
+int payload_verify(const void *data, size_t size, uint64_t seed, uint64_t offset)
+{
+    const unsigned char *in = data;
+    unsigned char expected[PAYLOAD_BLOCK];
+
+    while (size > 0)
+    {
+        size_t length = PAYLOAD_BLOCK - offset % PAYLOAD_BLOCK;
+        if (length > size)
+            length = size;
+        payload_fill(expected, length, seed, offset);
+        if (memcmp(in, expected, length) != 0)
+            return 0;
+        in += length;
+        offset += length;
+        size -= length;
+    }
+    return 1;
+}
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                        Files                       **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+/********************************************************/
+/* Write a "size"-byte payload file, generated straight */
+/* into a shared mapping of it (no write(2) per byte).  */
+/* Returns 0 on success, -1 on failure                  */
+/********************************************************/
+int payload_write_file(const char *filename, size_t size, uint64_t seed)
+{
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror("Failed to open file");
+        return -1;
+    }
+    if (ftruncate(fd, size) < 0)
+    {
+        perror("ftruncate(2)");
+        close(fd);
+        return -1;
+    }
+    if (size > 0)
+    {
+        void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            perror("mmap(2)");
+            close(fd);
+            return -1;
+        }
+        payload_fill(map, size, seed, 0);
+        munmap(map, size);
+    }
+    return close(fd);
+}
+
+/********************************************************/
+/* Check that a file holds exactly the "size"-byte      */
+/* payload seeded "seed". Returns 1 if it does, 0 if it */
+/* differs and -1 if it cannot be read                  */
+/********************************************************/
+int payload_verify_file(const char *filename, size_t size, uint64_t seed)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size != size)
+    {
+        close(fd);
+        return 0;
+    }
+    if (size == 0)
+    {
+        close(fd);
+        return 1;
+    }
+
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    int identical = payload_verify(map, size, seed, 0);
+    munmap(map, size);
+    return identical;
+}
@@ -0,0 +1,27 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Fast, deterministic test payload: every byte is a function of a 64-bit
+ * seed and its offset alone. The payload is cut into PAYLOAD_BLOCK-byte
+ * blocks; each block seeds four xoshiro256** lanes with SplitMix64 from
+ * (seed, block number) and interleaves their outputs, so any range can be
+ * generated (or checked) on its own and the lanes map onto one AVX2 vector.
+ * A sender and a receiver given the same seed agree on every byte, so the
+ * receiver can verify a run without the sender's file.
+ */
+
+#define PAYLOAD_BLOCK 16384         // Bytes generated from one (seed, block) pair
+
+uint64_t payload_random_seed(void);
+uint64_t payload_run_seed(uint64_t seed, int run);
+void payload_fill(void *buffer, size_t size, uint64_t seed, uint64_t offset);
+int payload_verify(const void *data, size_t size, uint64_t seed, uint64_t offset);
+int payload_write_file(const char *filename, size_t size, uint64_t seed);
+int payload_verify_file(const char *filename, size_t size, uint64_t seed);
+const char *payload_kernel(void);
+
+#endif
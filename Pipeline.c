@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>    // For sleeping on a full or empty ring
+#include "Pipeline.h"
+#include "Log.h"
+#include "Payload.h"
+#include "Timing.h"
+
+#define RING_SPIN 256       // Checks of the other side's counter before sleeping
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ring_cpu_relax() __builtin_ia32_pause()
+#else
+#define ring_cpu_relax() ((void)0)
+#endif
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                   Lock-free ring                   **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+static void futex_wait(uint32_t *word, uint32_t expected)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(uint32_t *word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/********************************************************/
+/* Wake the other side if it announced it sleeps        */
+/********************************************************/
+static void ring_wake(uint32_t *waiting)
+{
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST) && __atomic_exchange_n(waiting, 0, __ATOMIC_SEQ_CST))
+        futex_wake(waiting);
+}
+
+/********************************************************/
+/* Wait until "done" holds: spin first, then announce   */
+/* the wait in "waiting" and sleep on it. "done" is     */
+/* re-checked after the announcement (both sides use    */
+/* sequentially consistent atomics) and a waker clears  */
+/* the flag before waking, so no wake-up is lost        */
+/********************************************************/
+static void ring_block(Ring *ring, int (*done)(Ring *, uint32_t), uint32_t arg, uint32_t *waiting)
+{
+    for (int spin = 0; spin < RING_SPIN; spin++)
+    {
+        if (done(ring, arg))
+            return;
+        ring_cpu_relax();
+    }
+    while (!done(ring, arg))
+    {
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);       // The announcement is visible before "done" is read again
+        if (done(ring, arg))
+            break;
+        futex_wait(waiting, 1);
+    }
+    __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+}
+
+/********************************************************/
+/* Allocate a ring of "slots" (a power of two) buffers  */
+/* of "slotSize" bytes. Returns 0 on success, -1 on     */
+/* failure                                              */
+/********************************************************/
+int ring_init(Ring *ring, uint32_t slots, size_t slotSize)
+{
+    memset(ring, 0, sizeof(*ring));
+    if (slots == 0 || (slots & (slots - 1)) != 0)
+        return -1;
+    ring->buffers = aligned_alloc(4096, (size_t)slots * slotSize);
+    ring->lengths = calloc(slots, sizeof(size_t));
+    if (ring->buffers == NULL || ring->lengths == NULL)
+    {
+        ring_free(ring);
+        return -1;
+    }
+    ring->slots = slots;
+    ring->slotSize = slotSize;
+    return 0;
+}
+
+void ring_free(Ring *ring)
+{
+    free(ring->buffers);
+    free(ring->lengths);
+    ring->buffers = NULL;
+    ring->lengths = NULL;
+}
+
+/********************************************************/
+/* Empty the ring for the next run (neither side may be */
+/* using it)                                            */
+/********************************************************/
+void ring_reset(Ring *ring)
+{
+    ring->head = ring->tail = 0;
+    ring->closed = ring->cancelled = 0;
+    ring->consumerWaiting = ring->producerWaiting = 0;
+}
+
+static int ring_has_room(Ring *ring, uint32_t unused)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_RELAXED) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) < ring->slots ||
+           __atomic_load_n(&ring->cancelled, __ATOMIC_ACQUIRE);
+}
+
+/********************************************************/
+/* Producer: the next slot to fill, once the consumer   */
+/* freed it. Returns NULL if the consumer cancelled     */
+/********************************************************/
+void *ring_reserve(Ring *ring)
+{
+    ring_block(ring, ring_has_room, 0, &ring->producerWaiting);
+    if (__atomic_load_n(&ring->cancelled, __ATOMIC_ACQUIRE))
+        return NULL;
+    return ring->buffers + (size_t)(ring->head & (ring->slots - 1)) * ring->slotSize;
+}
+
+/********************************************************/
+/* Producer: hand the reserved slot, holding "length"   */
+/* bytes, to the consumer                               */
+/********************************************************/
+void ring_publish(Ring *ring, size_t length)
+{
+    ring->lengths[ring->head & (ring->slots - 1)] = length;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_SEQ_CST);
+    ring_wake(&ring->consumerWaiting);
+}
+
+/********************************************************/
+/* Producer: no slot will follow                        */
+/********************************************************/
+void ring_close(Ring *ring)
+{
+    __atomic_store_n(&ring->closed, 1, __ATOMIC_SEQ_CST);
+    ring_wake(&ring->consumerWaiting);
+}
+
+/********************************************************/
+/* Consumer: whether slot "seq" was published           */
+/********************************************************/
+int ring_ready(Ring *ring, uint32_t seq)
+{
+    return (int32_t)(__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - seq) > 0;
+}
+
+static int ring_ready_or_closed(Ring *ring, uint32_t seq)
+{
+    return ring_ready(ring, seq) || __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+}
+
+/********************************************************/
+/* Consumer: wait for slot "seq". Returns 1 once it is  */
+/* published, 0 if the producer closed the ring first   */
+/********************************************************/
+int ring_wait(Ring *ring, uint32_t seq)
+{
+    ring_block(ring, ring_ready_or_closed, seq, &ring->consumerWaiting);
+    return ring_ready(ring, seq);
+}
+
+/********************************************************/
+/* Consumer: the buffer of published slot "seq" and the */
+/* bytes it holds                                       */
+/********************************************************/
+void *ring_slot(Ring *ring, uint32_t seq, size_t *length)
+{
+    uint32_t index = seq & (ring->slots - 1);
+    if (length)
+        *length = ring->lengths[index];
+    return ring->buffers + (size_t)index * ring->slotSize;
+}
+
+/********************************************************/
+/* Consumer: give every slot before "seq" back to the   */
+/* producer                                             */
+/********************************************************/
+void ring_release(Ring *ring, uint32_t seq)
+{
+    if ((int32_t)(seq - ring->tail) <= 0)
+        return;
+    __atomic_store_n(&ring->tail, seq, __ATOMIC_SEQ_CST);
+    ring_wake(&ring->producerWaiting);
+}
+
+/********************************************************/
+/* Consumer: stop the producer (an error, or a run cut  */
+/* short)                                               */
+/********************************************************/
+void ring_cancel(Ring *ring)
+{
+    __atomic_store_n(&ring->cancelled, 1, __ATOMIC_SEQ_CST);
+    ring_wake(&ring->producerWaiting);
+}
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                     Producer                       **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+/********************************************************/
+/* Producer thread: generate the range slot by slot     */
+/********************************************************/
+static void *pipeline_produce(void *arg)
+{
+    Pipeline *pipeline = arg;
+    Ring *ring = &pipeline->ring;
+    uint64_t done = 0;
+
+    while (done < pipeline->length)
+    {
+        unsigned char *slot = ring_reserve(ring);
+        if (slot == NULL)
+            break;
+        size_t length = (pipeline->length - done < ring->slotSize) ? pipeline->length - done : ring->slotSize;
+        uint64_t start = timing_now_ns();
+        payload_fill(slot, length, pipeline->seed, pipeline->offset + done);
+        pipeline->produceMs += timing_ms(start, timing_now_ns());
+        ring_publish(ring, length);
+        done += length;
+    }
+    ring_close(ring);
+    return NULL;
+}
+
+/********************************************************/
+/* Start producing "length" payload bytes from byte     */
+/* "offset" of the payload seeded "seed" into a ring of */
+/* "slots" x "slotSize" bytes. The ring is kept from    */
+/* the previous run if it has the same geometry.        */
+/* Returns 0 on success, -1 on failure                  */
+/********************************************************/
+int pipeline_start(Pipeline *pipeline, uint32_t slots, size_t slotSize, uint64_t seed, uint64_t offset, uint64_t length)
+{
+    Ring *ring = &pipeline->ring;
+    if (ring->buffers == NULL || ring->slots != slots || ring->slotSize != slotSize)
+    {
+        ring_free(ring);
+        if (ring_init(ring, slots, slotSize) < 0)
+        {
+            log_error("Failed to allocate the pipeline ring\n");
+            return -1;
+        }
+    }
+    ring_reset(ring);
+    pipeline->seed = seed;
+    pipeline->offset = offset;
+    pipeline->length = length;
+    pipeline->produceMs = 0;
+
+    if (pthread_create(&pipeline->thread, NULL, pipeline_produce, pipeline) != 0)
+    {
+        log_error("Failed to start the producer thread\n");
+        return -1;
+    }
+    pipeline->running = 1;
+    return 0;
+}
+
+/********************************************************/
+/* Stop the producer, whether it is done or not, and    */
+/* wait for it                                          */
+/********************************************************/
+void pipeline_finish(Pipeline *pipeline)
+{
+    if (!pipeline->running)
+        return;
+    ring_cancel(&pipeline->ring);
+    pthread_join(pipeline->thread, NULL);
+    pipeline->running = 0;
+}
+
+void pipeline_free(Pipeline *pipeline)
+{
+    pipeline_finish(pipeline);
+    ring_free(&pipeline->ring);
+}
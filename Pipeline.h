@@ -0,0 +1,62 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+ * Pipelined senders: a producer thread generates a run's payload into a
+ * single-producer/single-consumer lock-free ring of fixed-size buffers while
+ * the network thread drains it, so a run takes about max(produce, send)
+ * instead of their sum. Slots are numbered by free-running 32-bit sequence
+ * numbers: the producer publishes slot "head", the consumer frees every slot
+ * before "tail". Each side only writes its own counter; a side that finds the
+ * ring full (or empty) spins briefly, then sleeps on its "waiting" flag with
+ * futex(2), so the other side makes a system call only to wake a sleeper.
+ */
+
+#define PIPELINE_CACHE_LINE 64
+
+// Single-producer/single-consumer ring of fixed-size buffers
+typedef struct {
+    unsigned char *buffers;             // "slots" buffers of "slotSize" bytes
+    size_t *lengths;                    // Bytes the producer put in every slot
+    size_t slotSize;                    // Bytes per slot
+    uint32_t slots;                     // Number of slots (a power of two)
+    _Alignas(PIPELINE_CACHE_LINE) uint32_t head;    // Slots published (written by the producer only)
+    uint32_t consumerWaiting;           // Set while the consumer sleeps (futex word)
+    uint32_t closed;                    // Set by the producer once its last slot is published
+    _Alignas(PIPELINE_CACHE_LINE) uint32_t tail;    // Slots released (written by the consumer only)
+    uint32_t producerWaiting;           // Set while the producer sleeps (futex word)
+    uint32_t cancelled;                 // Set by the consumer to stop the producer early
+} Ring;
+
+// A producer thread filling a ring with a range of the payload
+typedef struct {
+    Ring ring;                          // The slots handed to the network thread
+    pthread_t thread;                   // The producer
+    int running;                        // Set while the producer thread has to be joined
+    uint64_t seed;                      // Payload seed of the run
+    uint64_t offset;                    // First payload byte of the range
+    uint64_t length;                    // Bytes in the range
+    double produceMs;                   // Time the producer spent generating (not waiting for slots)
+} Pipeline;
+
+int ring_init(Ring *ring, uint32_t slots, size_t slotSize);
+void ring_free(Ring *ring);
+void ring_reset(Ring *ring);
+void *ring_reserve(Ring *ring);
+void ring_publish(Ring *ring, size_t length);
+void ring_close(Ring *ring);
+int ring_ready(Ring *ring, uint32_t seq);
+int ring_wait(Ring *ring, uint32_t seq);
+void *ring_slot(Ring *ring, uint32_t seq, size_t *length);
+void ring_release(Ring *ring, uint32_t seq);
+void ring_cancel(Ring *ring);
+
+int pipeline_start(Pipeline *pipeline, uint32_t slots, size_t slotSize, uint64_t seed, uint64_t offset, uint64_t length);
+void pipeline_finish(Pipeline *pipeline);
+void pipeline_free(Pipeline *pipeline);
+
+#endif
@@ -9,10 +9,28 @@
 #include <sys/time.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>     // For UDP_SEGMENT and UDP_GRO
 #include <errno.h>
 #include <stdarg.h>         // For variadic functions
+#include <math.h>           // For cbrt (CUBIC)
+#include <fcntl.h>          // For the Receiver's output files
+#include <sys/mman.h>
+#include <stdint.h>
+#include <endian.h>         // For the run digest in network byte order
+#include <sys/random.h>     // For getrandom (connection IDs)
+#include <linux/filter.h>   // For the SO_REUSEPORT steering program
+#include <linux/net_tstamp.h> // For SO_TIMESTAMPING
 #include "RUDP_API.h"
 
+#define URING_RECV_TAG (1ULL << 63)     // user_data bit of a posted receive (clear for a send)
+#define URING_SLOT_SHIFT 48             // user_data bits above the batch address hold the slot
+#define URING_TAG(batch, slot, recv) ((uint64_t)(uintptr_t)(batch) | ((uint64_t)(slot) << URING_SLOT_SHIFT) | ((recv) ? URING_RECV_TAG : 0))
+
+// io_uring engine of the batches (implemented with the batch functions)
+static int rudp_uring_enter(IO_Uring *ring, unsigned wait_for, long timeout_us, RUDP_IO_Stats *io);
+static int rudp_uring_post_sends(int socket, RUDP_Batch *batch, struct mmsghdr *msgs, int count, RUDP_IO_Stats *io);
+static int rudp_uring_post_recvs(int socket, RUDP_Batch *batch);
+
 
 /********************************************************/
 /********************************************************/
@@ -24,7 +42,13 @@
 
 /********************************************************/
 /* Create a RUDP socket with the specified domain,      */
-/* type and protocol                                    */
+/* type and protocol. Its receive and send buffers are  */
+/* sized for a full window (SOCKET_BUFFER_SIZE): the    */
+/* default ones overflow long before MAX_WINDOW_SIZE    */
+/* segments are in flight. The privileged *BUFFORCE     */
+/* options pass net.core.rmem_max/wmem_max; otherwise   */
+/* the kernel caps the size, and rudp_socket_window()   */
+/* tells how many segments the granted buffers hold     */
 /********************************************************/
 int rudp_socket(int domain, int type, int protocol)
 {
@@ -34,193 +58,391 @@ int rudp_socket(int domain, int type, int protocol)
         perror("socket(2)");
         return -1;
     }
+
+    int size = SOCKET_BUFFER_SIZE;
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    if (setsockopt(sock, SOL_SOCKET, SO_SNDBUFFORCE, &size, sizeof(size)) < 0)
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
     return sock;
 }
 
 /********************************************************/
-/* Try to establish a RUDP connection between Receiver  */
-/* and Sender with 3-way handshake                      */
+/* Number of full-size datagrams the socket's granted   */
+/* receive and send buffers both hold, as the kernel    */
+/* charges them (SKB_OVERHEAD times their size)         */
 /********************************************************/
-int rudp_connect(int sock, const struct sockaddr_in *server_addr)
+int rudp_socket_window(int sock)
 {
-    // Initial setup for SYN packet
-    RUDP_Header syn_packet;
-    memset(&syn_packet, 0, sizeof(syn_packet));         // Zero out the SYN packet struct
-    syn_packet.flags = SYN;                             // Set SYN flag for handshake process
-    syn_packet.checksum = 0;                            // Initiate checksum to 0
-    syn_packet.checksum = rudp_compute_checksum(&syn_packet, sizeof(syn_packet));       // Calculate checksum for the SYN packet
+    int rcvbuf = 0, sndbuf = 0;
+    socklen_t length = sizeof(rcvbuf);
+    if (getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &length) < 0)
+        return MAX_WINDOW_SIZE;
+    length = sizeof(sndbuf);
+    if (getsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sndbuf, &length) < 0)
+        return MAX_WINDOW_SIZE;
+
+    int segments = (rcvbuf < sndbuf ? rcvbuf : sndbuf) / (MAX_PACKET_SIZE * SKB_OVERHEAD);
+    if (segments < 1)                   return 1;
+    if (segments > MAX_WINDOW_SIZE)     return MAX_WINDOW_SIZE;
+    return segments;
+}
 
-    print_time("Sending SYN packet to Receiver...\n");
-    
-    // Send SYN to Receiver
-    if (sendto(sock, &syn_packet, sizeof(syn_packet), 0, (const struct sockaddr *)server_addr, sizeof(*server_addr)) < 0)
+/********************************************************/
+/* Current time in microseconds, on the shared clock of */
+/* Timing.c (the unit of the RTO and congestion state)  */
+/********************************************************/
+long rudp_now_us(void)
+{
+    return (long)(timing_now_ns() / 1000);
+}
+
+/********************************************************/
+/* Reset an RTT estimator: without samples the RTO      */
+/* starts at the conservative initial value             */
+/********************************************************/
+void rudp_rtt_init(RUDP_RTT *rtt)
+{
+    memset(rtt, 0, sizeof(*rtt));
+    rtt->rto = INITIAL_RTO_US;
+}
+
+/********************************************************/
+/* Feed one RTT measurement (in microseconds) into the  */
+/* smoothed RTT and RTT variance, and recompute the RTO */
+/* as SRTT + 4 * RTTVAR (RFC 6298). A fresh sample also */
+/* cancels any exponential backoff                      */
+/********************************************************/
+void rudp_rtt_sample(RUDP_RTT *rtt, long sample)
+{
+    if (sample < 1)     sample = 1;
+
+    if (rtt->samples == 0)
     {
-        print_time("ERROR: SYN packet send failed!\n");
-        return -1;
+        rtt->srtt = sample;
+        rtt->rttvar = sample / 2;
+    }
+    else
+    {
+        long error = rtt->srtt - sample;
+        if (error < 0)      error = -error;
+        rtt->rttvar = (3 * rtt->rttvar + error) / 4;       // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|
+        rtt->srtt = (7 * rtt->srtt + sample) / 8;          // SRTT = 7/8 SRTT + 1/8 R
     }
+    rtt->samples++;
 
-    // Wait for SYN-ACK response.
-    fd_set read_fds;                               // Set of file descriptors to monitor for reading
-    struct timeval syn_ack_timeout = {TIMEOUT, 0}; // Timeout for waiting on SYN-ACK
-    RUDP_Header syn_ack_packet;                    // Struct for SYN-ACK packet from the Receiver
-    struct sockaddr_in syn_ack_from;               // Address of the SYN-ACK sender
-    socklen_t from_len = sizeof(syn_ack_from);     // Length of the sender address
+    rtt->rto = rtt->srtt + 4 * rtt->rttvar;
+    if (rtt->rto < MIN_RTO_US)                  rtt->rto = MIN_RTO_US;
+    if (rtt->rto > TIMEOUT * 1000000L)          rtt->rto = TIMEOUT * 1000000L;
+}
+
+/********************************************************/
+/* Double the RTO after a retransmission timeout        */
+/********************************************************/
+void rudp_rtt_backoff(RUDP_RTT *rtt)
+{
+    rtt->rto *= 2;
+    if (rtt->rto > TIMEOUT * 1000000L)          rtt->rto = TIMEOUT * 1000000L;
+    rtt->backoffs++;
+}
+
+/********************************************************/
+/* Print the integrity check the handshake agreed on    */
+/* (CHECKSUM_INTERNET or CHECKSUM_CRC32C)               */
+/********************************************************/
+static void rudp_print_checksum_mode(int mode)
+{
+    log_info("Integrity check: %s (%s)\n", mode == CHECKSUM_CRC32C ? "CRC32C" : "Internet checksum",
+             mode == CHECKSUM_CRC32C ? rudp_crc32c_kernel() : rudp_checksum_kernel());
+}
+
+// Byte positions of the wire header's fields (layout in RUDP_API.h)
+#define WIRE_FLAGS 1
+#define WIRE_CHECKSUM 2
+#define WIRE_CONNECTION_ID 4
+#define WIRE_OFFSET_LENGTH 8
+
+/********************************************************/
+/* Write a header into the first RUDP_HEADER_SIZE bytes */
+/* of a packet, in network byte order. Branch-free: an  */
+/* offset above RUDP_MAX_OFFSET or a length above       */
+/* RUDP_MAX_LENGTH is truncated, so the Sender checks   */
+/* a run's range once before sending it                 */
+/********************************************************/
+void rudp_header_encode(void *wire, const RUDP_Header *header)
+{
+    uint32_t first = htonl((uint32_t)RUDP_VERSION << 24 | (uint32_t)header->flags << 16 | header->checksum);
+    uint32_t id = htonl(header->connectionId);
+    uint64_t position = htobe64(header->offset << 16 | (header->length & RUDP_MAX_LENGTH));
+    memcpy(wire, &first, sizeof(first));
+    memcpy((char *)wire + WIRE_CONNECTION_ID, &id, sizeof(id));
+    memcpy((char *)wire + WIRE_OFFSET_LENGTH, &position, sizeof(position));
+}
+
+/********************************************************/
+/* Read the header at the start of a received packet    */
+/* (at least RUDP_HEADER_SIZE bytes); branch-free       */
+/********************************************************/
+void rudp_header_decode(const void *wire, RUDP_Header *header)
+{
+    uint32_t first, id;
+    uint64_t position;
+    memcpy(&first, wire, sizeof(first));
+    memcpy(&id, (const char *)wire + WIRE_CONNECTION_ID, sizeof(id));
+    memcpy(&position, (const char *)wire + WIRE_OFFSET_LENGTH, sizeof(position));
+    first = ntohl(first);
+    position = be64toh(position);
+    header->version = first >> 24;
+    header->flags = first >> 16;
+    header->checksum = first;
+    header->connectionId = ntohl(id);
+    header->offset = position >> 16;
+    header->length = position & RUDP_MAX_LENGTH;
+}
+
+/********************************************************/
+/* Compute the checksum of an encoded packet; its own   */
+/* checksum field is left out, so a received packet is  */
+/* verified as it arrived. SYN and SYN-ACK are always   */
+/* protected by the Internet checksum, since the mode   */
+/* is still being negotiated. Later packets carry the   */
+/* CRC32C_MODE flag when the connection agreed on       */
+/* CRC32C (folded into the 16-bit field), so a receiver */
+/* serving many connections verifies every packet       */
+/* without looking its connection up first             */
+/********************************************************/
+unsigned short int rudp_packet_checksum(const void *packet, unsigned int bytes)
+{
+    if (bytes < RUDP_HEADER_SIZE)
+        return rudp_checksum_fold(rudp_checksum_add(0, packet, bytes));
+    return rudp_segment_checksum(packet, RUDP_HEADER_SIZE, (const char *)packet + RUDP_HEADER_SIZE, bytes - RUDP_HEADER_SIZE);
+}
+
+/********************************************************/
+/* Same as rudp_packet_checksum(), for a packet whose   */
+/* payload lies elsewhere in memory (scatter-gather).   */
+/* The first "header_size" bytes are contiguous with    */
+/* the header (an even count: the header and whatever   */
+/* trails it in the slot, like LAST_PACKET's digest)    */
+/********************************************************/
+unsigned short int rudp_segment_checksum(const void *header, unsigned int header_size, const void *payload, unsigned int payload_size)
+{
+    const char *bytes = header;
+    unsigned int after = WIRE_CHECKSUM + sizeof(uint16_t);
+    uint8_t flags = bytes[WIRE_FLAGS];
+    if ((flags & CRC32C_MODE) && !(flags & SYN))
+    {
+        uint32_t crc = rudp_crc32c(rudp_crc32c(rudp_crc32c(0, bytes, WIRE_CHECKSUM), bytes + after, header_size - after), payload, payload_size);
+        return (unsigned short int)(crc ^ (crc >> 16));
+    }
+    uint32_t sum = rudp_checksum_add(rudp_checksum_add(0, bytes, WIRE_CHECKSUM), bytes + after, header_size - after);
+    return rudp_checksum_fold(rudp_checksum_add(sum, payload, payload_size));
+}
 
-    FD_ZERO(&read_fds);      // Initialize the file descriptor set
-    FD_SET(sock, &read_fds); // Add the socket to the set
+/********************************************************/
+/* Store the checksum of an encoded packet in its       */
+/* header, as rudp_segment_checksum() computes it       */
+/********************************************************/
+void rudp_packet_seal(void *header, unsigned int header_size, const void *payload, unsigned int payload_size)
+{
+    uint16_t checksum = htons(rudp_segment_checksum(header, header_size, payload, payload_size));
+    memcpy((char *)header + WIRE_CHECKSUM, &checksum, sizeof(checksum));
+}
 
-    int select_result = select(sock + 1, &read_fds, NULL, NULL, &syn_ack_timeout);
-    if (select_result > 0)
+/********************************************************/
+/* Send a packet and wait for the reply carrying the    */
+/* expected flags and the same offset. The wait         */
+/* is the connection's RTO; every timeout doubles it    */
+/* and retransmits the packet. Only replies to the      */
+/* first transmission are used as RTT samples (Karn)    */
+/* The decoded reply and its source are copied out if   */
+/* asked                                                */
+/* Returns 0 on reply, -1 on error, -2 on no reply      */
+/********************************************************/
+static int rudp_exchange(RUDP_Connection *conn, const void *packet, size_t packet_size, uint8_t reply_flags,
+                         int max_attempts, const char *packetType, RUDP_Header *reply_packet, struct sockaddr_in *reply_from)
+{
+    RUDP_Header sent;                   // The header of the packet sent, to match the reply against
+    RUDP_Header reply;                  // The decoded reply
+    char wire[RUDP_HEADER_SIZE];        // A buffer to store the received reply
+    struct sockaddr_in from;            // The address of the reply's sender
+    socklen_t from_len;                 // The length of the reply sender's address
+    fd_set read_fds;                    // Set of file descriptors
+
+    rudp_header_decode(packet, &sent);
+    for (int attempts = 0; attempts < max_attempts; attempts++)
     {
-        // SYN-ACK packet received
-        if (recvfrom(sock, &syn_ack_packet, sizeof(syn_ack_packet), 0, (struct sockaddr *)&syn_ack_from, &from_len) < 0)
+        conn->io.sendCalls++;
+        if (sendto(conn->sock, packet, packet_size, 0, (const struct sockaddr *)&conn->peer, sizeof(conn->peer)) < 0)
         {
-            print_time("ERROR: SYN-ACK packet receive failed!\n");
+            log_error("ERROR: Failed to send %s!\n", packetType);
             return -1;
         }
+        conn->io.datagramsSent++;
 
-        // Check if the received packet is SYN-ACK by its flags
-        if (syn_ack_packet.flags & ACK)
-        {
-            print_time("SYN-ACK received from Receiver\n");
+        uint64_t sentAt = timing_now_ns();
+        long deadline = (long)(sentAt / 1000) + conn->rtt.rto;
+        long now;
 
-            // Send ACK to complete the handshake process
-            RUDP_Header ack_response_packet;
-            memset(&ack_response_packet, 0, sizeof(ack_response_packet));       // Reset the ACK response packet
-            ack_response_packet.flags = ACK;                                    // Set ACK flag
-            
-            // Checksum check for ACK response packet
-            ack_response_packet.checksum = 0;                                  
-            ack_response_packet.checksum = rudp_compute_checksum(&ack_response_packet, sizeof(ack_response_packet));  
+        // Wait for the matching reply until the RTO expires, skipping stale or corrupted packets
+        while ((now = rudp_now_us()) < deadline)
+        {
+            struct timeval timeout = {(deadline - now) / 1000000, (deadline - now) % 1000000};
+            FD_ZERO(&read_fds);
+            FD_SET(conn->sock, &read_fds);
 
-            if (sendto(sock, &ack_response_packet, sizeof(ack_response_packet), 0, (const struct sockaddr *)&syn_ack_from, from_len) < 0)
+            int selectResult = select(conn->sock + 1, &read_fds, NULL, NULL, &timeout);
+            conn->io.pollCalls++;
+            if (selectResult < 0)
             {
-                print_time("ERROR: ACK response packet send failed!\n");
+                if (errno == EINTR)     continue;
+                log_error("ERROR: select error while waiting for ACK for %s\n", packetType);
                 return -1;
             }
-            print_time("ACK sent\n");
-            print_time("*** 3-way handshake completed ***\n");
+            if (selectResult == 0)      break;
+
+            from_len = sizeof(from);
+            conn->io.recvCalls++;
+            if (recvfrom(conn->sock, wire, sizeof(wire), 0, (struct sockaddr *)&from, &from_len) < (ssize_t)sizeof(wire))
+                continue;
+            conn->io.datagramsReceived++;
+
+            rudp_header_decode(wire, &reply);
+            if (reply.version != RUDP_VERSION || rudp_packet_checksum(wire, sizeof(wire)) != reply.checksum)
+                continue;
+            if ((reply.flags & reply_flags) != reply_flags || reply.offset != sent.offset || reply.connectionId != conn->id)
+                continue;
+
+            if (attempts == 0)
+                rudp_rtt_sample(&conn->rtt, (long)((timing_now_ns() - sentAt) / 1000));
+            if (reply_packet)
+                *reply_packet = reply;
+            if (reply_from)
+                *reply_from = from;
+            return 0;
         }
 
-        // Handle the situation where no ACK-SYN sent
-        else
-        {
-            print_time("ERROR: Invalid packet received during handshake.\n");
-            return -1;
-        }
+        rudp_rtt_backoff(&conn->rtt);
+        log_warn("Timeout waiting for ACK for %s, attempt %d/%d (RTO now %.3f ms)\n", packetType, attempts + 1, max_attempts, conn->rtt.rto / 1000.0);
     }
 
-    // If no packet received within the timeout
-    else if (select_result == 0)
+    log_error("Maximum retransmission attempts reached for %s...\n", packetType);
+    return -2;
+}
+
+/********************************************************/
+/* Try to establish a RUDP connection between Receiver  */
+/* and Sender with 3-way handshake                      */
+/********************************************************/
+int rudp_connect(RUDP_Connection *conn)
+{
+    // Initial setup for SYN packet
+    RUDP_Header syn_header = {0};                       // Zero out the SYN header
+    char syn_packet[RUDP_HEADER_SIZE];                  // The encoded SYN packet
+    syn_header.flags = SYN;                             // Set SYN flag for handshake process
+    syn_header.connectionId = conn->id;                 // The Receiver keeps the connection's state under its ID
+    if (conn->checksumMode == CHECKSUM_CRC32C)
+        syn_header.flags |= CRC32C_MODE;                // Ask the Receiver to switch to CRC32C after the handshake
+    rudp_header_encode(syn_packet, &syn_header);
+    rudp_packet_seal(syn_packet, sizeof(syn_packet), NULL, 0);        // Calculate checksum for the SYN packet
+
+    log_info("Sending SYN packet to Receiver...\n");
+
+    // Send SYN to Receiver and wait for the SYN-ACK response (retransmitted on RTO)
+    RUDP_Header syn_ack_packet;                    // The SYN-ACK, telling whether CRC32C was accepted
+    struct sockaddr_in syn_ack_from;               // Address of the SYN-ACK sender
+    int result = rudp_exchange(conn, syn_packet, sizeof(syn_packet), SYN | ACK, MAX_CONTROL_ATTEMPTS, "SYN packet", &syn_ack_packet, &syn_ack_from);
+    if (result == -2)
+    {
+        log_error("Handshake timeout.\n");
+        return -1;
+    }
+    if (result < 0)
     {
-        print_time("Handshake timeout.\n");
+        log_error("ERROR: SYN-ACK packet receive failed!\n");
         return -1;
     }
+    log_info("SYN-ACK received from Receiver\n");
+
+    // Packets after the SYN-ACK use CRC32C only if both sides agreed on it
+    if (!(syn_ack_packet.flags & CRC32C_MODE))
+        conn->checksumMode = CHECKSUM_INTERNET;
+    rudp_print_checksum_mode(conn->checksumMode);
+
+    // Send ACK to complete the handshake process
+    RUDP_Header ack_response_header = {0};                              // Reset the ACK response header
+    char ack_response_packet[RUDP_HEADER_SIZE];
+    ack_response_header.flags = ACK;                                    // Set ACK flag
+    if (conn->checksumMode == CHECKSUM_CRC32C)
+        ack_response_header.flags |= CRC32C_MODE;
+    ack_response_header.connectionId = conn->id;
+    
+    // Checksum for ACK response packet
+    rudp_header_encode(ack_response_packet, &ack_response_header);
+    rudp_packet_seal(ack_response_packet, sizeof(ack_response_packet), NULL, 0);
 
-    // Other failure
-    else
+    if (sendto(conn->sock, ack_response_packet, sizeof(ack_response_packet), 0, (const struct sockaddr *)&syn_ack_from, sizeof(syn_ack_from)) < 0)
     {
-        print_time("ERROR: select error during handshake\n");
+        log_error("ERROR: ACK response packet send failed!\n");
         return -1;
     }
+    log_info("ACK sent\n");
+    log_info("*** 3-way handshake completed (RTT %.3f ms) ***\n", conn->rtt.srtt / 1000.0);
 
     return 0;
 }
 
 /********************************************************/
-/* Send a RUDP packet to the specified dest. address    */
+/* Send a single RUDP packet to the connection's peer   */
+/* and wait for its ACK (STOP-and-WAIT). The packet     */
+/* starts with its encoded header, whose connection ID, */
+/* length and checksum are filled in here               */
 /********************************************************/
-int rudp_send(int socket, RUDP_Header *packet, size_t packet_size, const struct sockaddr_in *dest_addr)
+int rudp_send(RUDP_Connection *conn, void *packet, size_t packet_size)
 {
-    struct timeval timeout = {TIMEOUT, 0};              // A timeout for waiting on ACK
-    fd_set read_fds;                                    // Set of file descriptors
-    int attempts = 0;                                   // A counter for the number of transmission attempts
-    RUDP_Header ack_packet = {0};                       // A struct to store the received ACK packet
-    socklen_t from_len = sizeof(struct sockaddr_in);    // The length of the sender's address structure 
-    struct sockaddr_in from_addr;                       // A Struct to store the address of the ACK packet sender
+    RUDP_Header header;
+    rudp_header_decode(packet, &header);
+    header.connectionId = conn->id;
+    header.length = packet_size - RUDP_HEADER_SIZE;
+    if (conn->checksumMode == CHECKSUM_CRC32C)
+        header.flags |= CRC32C_MODE;
 
-    // Checksum check
-    packet->checksum = 0;       
-    packet->checksum = rudp_compute_checksum(packet, packet_size);  
+    // Checksum
+    rudp_header_encode(packet, &header);
+    rudp_packet_seal(packet, RUDP_HEADER_SIZE, (const char *)packet + RUDP_HEADER_SIZE, header.length);
 
     // Set the type of the packet sent
     char packetType[20];
-    if (packet->flags & FIN)                strcpy(packetType, "FIN packet");
-    else if (packet->flags & DATA)          strcpy(packetType, "Data packet");
-    else if (packet->flags & LAST_PACKET)   strcpy(packetType, "Data packet");
+    if (header.flags & FIN)                 strcpy(packetType, "FIN packet");
+    else if (header.flags & DATA)           strcpy(packetType, "Data packet");
+    else if (header.flags & LAST_PACKET)    strcpy(packetType, "Data packet");
     else                                    strcpy(packetType, "Unknown packet type");
     
     // Try to send the packet up to max attempts seted
-    while (attempts < MAX_ATTEMPTS)
-    {
-        // Send the packet to the destination address
-        if (sendto(socket, packet, packet_size, 0, (const struct sockaddr *)dest_addr, sizeof(*dest_addr)) < 0)
-        {
-            print_time("ERROR: Failed to send %s packet!\n", packetType);
-            return -1;
-        }
-
-        // print_time("%s sent successfully. Waiting for acknowledgment...\n", packetType);   // ~~INTERNAL CHECK: print messege for each segment ~~ //
-
-        FD_ZERO(&read_fds);             // Clear the fd_set before using it again
-        FD_SET(socket, &read_fds);      // Add the socket to the fd_set
-        
-        // Wait for an ACK within the specified timeout window
-        int selectResult = select(socket + 1, &read_fds, NULL, NULL, &timeout);
-
-        if (selectResult > 0)
-        {
-            // Try to receive the ACK packet
-            if (recvfrom(socket, &ack_packet, sizeof(ack_packet), 0, (struct sockaddr *)&from_addr, &from_len) >= 0)
-            {
-                // checksum check
-                unsigned short int original_checksum = ack_packet.checksum;                                         // Original checksum
-                ack_packet.checksum = 0;                         
-                unsigned short int calculated_checksum = rudp_compute_checksum(&ack_packet, sizeof(ack_packet));    // Calculated checksum 
-
-                // Validate the checksum and the ACK flag
-                if (calculated_checksum == original_checksum && (ack_packet.flags & ACK))
-                {
-                    return 0;       // ACK received
-                }
-            }
-        }
-
-        // Handle timeout in case of waiting for ACK
-        else if (selectResult == 0)
-        {
-            print_time("Timeout waiting for ACK for %s, attempt %d/%d\n", packetType, attempts + 1, MAX_ATTEMPTS);
-        }
-        attempts++;
-
-        if (attempts >= MAX_ATTEMPTS)
-        {
-            print_time("Maximum retransmission attempts reached for %s packet...\n", packetType);
-            return -2;          // Failed to receive ACK
-        }
-    }
-
-    // Return an error code indicating failure to receive ACK
-    print_time("ERROR: Failed to receive ACK after %d attempts!\n", MAX_ATTEMPTS);
-    return -2; 
+    return rudp_exchange(conn, packet, packet_size, ACK, MAX_ATTEMPTS, packetType, NULL, NULL);
 }
 
 /********************************************************/
-/* Function to send an ACK packet back to the sender    */
+/* Function to send an ACK packet back to the sender of */
+/* connection "connection_id", protected by CRC32C if   */
+/* the connection agreed on it                          */
 /********************************************************/
-void rudp_sendack(int socket, const struct sockaddr_in *addr, int packet_type, int run)
+void rudp_sendack(int socket, const struct sockaddr_in *addr, uint32_t connection_id, char crc32c, int packet_type, int run, uint64_t offset)
 {
-    RUDP_Header ack_packet = {0};           // Initiate ACK packet struct
-    ack_packet.flags = ACK;                 // Set ACK flag
+    RUDP_Header ack_header = {0};           // Initiate ACK header
+    char ack_packet[RUDP_HEADER_SIZE];
+    ack_header.flags = crc32c ? (ACK | CRC32C_MODE) : ACK;     // Set ACK flag
+    ack_header.connectionId = connection_id;                    // Echo the connection ID
+    ack_header.offset = offset;                                 // Echo the acknowledged segment's offset (selective ACK)
     
-    // Checksum check
-    ack_packet.checksum = 0;               
-    ack_packet.checksum = rudp_compute_checksum(&ack_packet, sizeof(ack_packet));
+    // Checksum
+    rudp_header_encode(ack_packet, &ack_header);
+    rudp_packet_seal(ack_packet, sizeof(ack_packet), NULL, 0);
 
     // Try to send the ACK packet
-    if (sendto(socket, &ack_packet, sizeof(ack_packet), 0, (const struct sockaddr *)addr, sizeof(*addr)) < 0) 
+    if (sendto(socket, ack_packet, sizeof(ack_packet), 0, (const struct sockaddr *)addr, sizeof(*addr)) < 0) 
     {
-        print_time("ERROR: Failed to send ACK!\n");
+        log_error("ERROR: Failed to send ACK!\n");
     } 
     
     // Handle each of the scenarios
@@ -228,363 +450,1695 @@ void rudp_sendack(int socket, const struct sockaddr_in *addr, int packet_type, i
     {
         switch (packet_type) 
         {
-            case DATA:                                                 // ~~INTERNAL NOTE: Since thousands of segements received 
-            //     print_time("ACK for DATA packet sent.\n");          // for each txt file, INTERNAL NOTE: Since thousands of segments received for     
-                break;                                                 // each txt file, this case shut down for printing to terminal ~~ // 
+            case DATA:                                                 // Thousands per run: sampled
+                log_ratelimited(LOG_DEBUG, LOG_SEGMENT_INTERVAL_MS, "ACK for DATA packet #%ld sent.\n", RUDP_OFFSET_SEGMENT(offset));
+                break;
             case LAST_PACKET:
-                print_time("ACK for all DATA segments in run #%d sent.\n", run);
+                log_info("ACK for all DATA segments in run #%d sent.\n", run);
                 break;
             case FIN:
-                print_time("ACK for FIN packet sent\n");
+                log_info("ACK for FIN packet sent\n");
                 break;
             default:
-                print_time("ACK sent for packet type %d.\n", packet_type);
+                log_info("ACK sent for packet type %d.\n", packet_type);
                 break;
         }
     }
 }
 
 /********************************************************/
-/* Function to receive a RUDP packet (SYN, FIN & ACK)   */
+/* Queue an ACK for a data segment in an ACK batch; the */
+/* batch is flushed with one sendmmsg(2) once full. The */
+/* ACK echoes the segment's offset, connection ID and   */
+/* CRC32C flag. The Receiver queues it only once the    */
+/* segment is stored: an ACKed segment is never resent  */
 /********************************************************/
-int rudp_recv(int socket, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen, int run)
-{   
-    // Attempt to receive a packet
-    int recv_bytes = recvfrom(socket, buf, len, flags, src_addr, addrlen);
-    if (recv_bytes < 0)
+void rudp_queue_ack(int socket, RUDP_Batch *acks, const struct sockaddr_in *addr, const RUDP_Header *segment, RUDP_IO_Stats *io)
+{
+    if (acks->count == acks->capacity)
+        rudp_batch_flush(socket, acks, io);
+
+    char *ack_packet = acks->buffers + (size_t)acks->count * acks->slotSize;
+    RUDP_Header ack_header = {0};
+    ack_header.flags = ACK | (segment->flags & CRC32C_MODE);    // Set ACK flag
+    ack_header.offset = segment->offset;                        // Echo the acknowledged segment's offset
+    ack_header.connectionId = segment->connectionId;
+    rudp_header_encode(ack_packet, &ack_header);
+    rudp_packet_seal(ack_packet, RUDP_HEADER_SIZE, NULL, 0);
+
+    acks->iovs[2 * acks->count].iov_len = RUDP_HEADER_SIZE;
+    acks->addrs[acks->count] = *addr;
+    acks->count++;
+}
+
+/********************************************************/
+/* Validate a received packet, decode its header into  */
+/* "header" and respond to it by its flag. DATA         */
+/* segments are ACKed right away, unless the caller     */
+/* batches its ACKs in "acks": it then queues them with */
+/* rudp_queue_ack() once it has stored the segments     */
+/********************************************************/
+static int rudp_handle_packet(int socket, const void *packet, int recv_bytes, RUDP_Header *header, const struct sockaddr_in *src_addr, int run, RUDP_Batch *acks, RUDP_IO_Stats *io)
+{
+    if (recv_bytes < RUDP_HEADER_SIZE)
     {
-        print_time("ERROR: Receive failed!\n");
-        return -1;
+        log_ratelimited(LOG_WARN, LOG_SEGMENT_INTERVAL_MS, "Received a packet shorter than the RUDP header (%d bytes)!\n", recv_bytes);
+        return -2;
     }
-    
-    // printf("Bytes received: %d \n", recv_bytes);            // ~~INTERNAL CHECK: print the bytes received for each segment ~~ //
-    
-    RUDP_Header *packet = (RUDP_Header *)buf;        // Set the received buffer as an RUDP packet
-    
+
+    rudp_header_decode(packet, header);
+    if (header->version != RUDP_VERSION || header->length != (uint32_t)(recv_bytes - RUDP_HEADER_SIZE))
+    {
+        log_ratelimited(LOG_WARN, LOG_SEGMENT_INTERVAL_MS, "Received a malformed packet (version %u, length %u of %d bytes)!\n",
+                        header->version, header->length, recv_bytes);
+        return -2;
+    }
+
     // Checksum check
-    int original_checksum = packet->checksum; 
-    packet->checksum = 0; 
-    int calculated_checksum = rudp_compute_checksum(packet, recv_bytes); 
+    unsigned short int calculated_checksum = rudp_packet_checksum(packet, recv_bytes); 
 
     // Validite checksum received
-    if (original_checksum != calculated_checksum)
+    if (header->checksum != calculated_checksum)
     {
-        print_time("ERROR: Checksum mismatch: original %hu, calculated %hu!\n", original_checksum, calculated_checksum);
-        return -1; 
+        log_ratelimited(LOG_WARN, LOG_SEGMENT_INTERVAL_MS, "Checksum mismatch: original %hu, calculated %hu!\n", header->checksum, calculated_checksum);
+        if (io)     io->checksumFailures++;
+        return -2;      // Drop the corrupted packet; the Sender retransmits it after a timeout
     }
-    
-    // print_time("Original checksum: %d; Calculated checksum: %d\n", original_checksum, calculated_checksum);     // ~~INTERNAL CHECK: print checksum comparisons ~~ //
-    // print_time("Packet flags: %u\n", packet->flags);        // ~~INTERNAL CHECK: print the packet type by its flag(1, 2, 4, etc.) ~~ //
+
 
     // Handle the received packet by its flag
-    switch(packet->flags)
+    switch(header->flags & ~CRC32C_MODE)
     {
         case DATA:
-            // print_time("Data packet received from sender\n");                                                            // ~~INTERNAL CHECK: print received message for each segment ~~ //
-            // print_time("Checksum matches! original: %hu, calculated: %hu\n", original_checksum, calculated_checksum);    // ~~INTERNAL CHECK: print comparison between both checksums for each segment ~~ //
-            rudp_sendack(socket, (const struct sockaddr_in *)src_addr, DATA, run); // Send ACK for DATA packet
+            log_ratelimited(LOG_DEBUG, LOG_SEGMENT_INTERVAL_MS, "Data packet #%ld received from sender (%d bytes, checksum %hu)\n",
+                            RUDP_OFFSET_SEGMENT(header->offset), recv_bytes, header->checksum);
+            if (!acks)  rudp_sendack(socket, src_addr, header->connectionId, header->flags & CRC32C_MODE, DATA, run, header->offset);
             break;
 
         case SYN:
-            print_time("SYN packet received, processing...\n");
-            rudp_send_synack(socket, src_addr);                              // Send SYN-ACK in response to SYN
+            log_info("SYN packet received, processing...\n");
+            rudp_send_synack(socket, (const struct sockaddr *)src_addr, header->connectionId, header->flags & CRC32C_MODE);       // Send SYN-ACK in response to SYN
+            rudp_print_checksum_mode(header->flags & CRC32C_MODE ? CHECKSUM_CRC32C : CHECKSUM_INTERNET);
             break;
 
         case FIN:
-            print_time("FIN packet received, processing...\n");
+            log_info("FIN packet received, processing...\n");
             break;
 
         case ACK:
-            print_time("ACK packet received, processing...\n");
+            log_info("ACK packet received, processing...\n");
             break; 
 
         case LAST_PACKET:
-            print_time("Last data segment within run #%d received, indicating the all the segments received successfully\n", run);
-            rudp_sendack(socket, (const struct sockaddr_in *)src_addr, DATA, run); // Treat LAST_PACKET similar to DATA for ACK
+            log_info("Last data segment (#%ld) of a run received\n", RUDP_OFFSET_SEGMENT(header->offset));
+            if (!acks)  rudp_sendack(socket, src_addr, header->connectionId, header->flags & CRC32C_MODE, DATA, run, header->offset);
             break;
 
         default:
             // Handle other packet types or invalid packets
-            print_time("Received an unknown or invalid packet type!\n");
+            log_ratelimited(LOG_WARN, LOG_SEGMENT_INTERVAL_MS, "Received an unknown or invalid packet type (flags %u)!\n", header->flags);
             return -2;
     }
     return recv_bytes; 
 }
 
-
 /********************************************************/
-/* Send a SYN-ACK packet over a socket to a specified   */
-/* address. This function used for the 3-way handshake  */
-/* in a RUDP protocol to acknowledge a SYN packet and   */
-/* indicate readiness for data transmission             */
+/* Function to receive a RUDP packet (SYN, FIN & ACK)   */
 /********************************************************/
-void rudp_send_synack(int sock, const struct sockaddr *src_addr)
-{
-    RUDP_Header syn_ack_packet = {0};   // Initialize ACK packet structure to zero
-    syn_ack_packet.flags = SYN | ACK;   // Set tboth SYN and ACK flags to indicate this is that kind of packet  
-    syn_ack_packet.checksum = 0;        // Zero out the checksum for accurate calculation
-    syn_ack_packet.checksum = rudp_compute_checksum(&syn_ack_packet, sizeof(syn_ack_packet));            // Compute the packet's checksum for integrity verification
-    
-    // Send the SYN-ACK packet to the source address
-    sendto(sock, &syn_ack_packet, sizeof(syn_ack_packet), 0, src_addr, sizeof(struct sockaddr_in));
-    
-    print_time("SYN-ACK sent\n");
+int rudp_recv(int socket, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen, int run)
+{   
+    // Attempt to receive a packet
+    int recv_bytes = recvfrom(socket, buf, len, flags, src_addr, addrlen);
+    if (recv_bytes < 0)
+    {
+        log_error("ERROR: Receive failed!\n");
+        return -1;
+    }
+
+    RUDP_Header header;
+    return rudp_handle_packet(socket, buf, recv_bytes, &header, (const struct sockaddr_in *)src_addr, run, NULL, NULL);
 }
 
 /********************************************************/
-/* Initiate closure of an RUDP connection by sending    */
-/* a FIN packet to the Receiver and waiting for an ACK  */
-/* to ensures the connection is properly closed         */
+/* Receive the next RUDP packet through a batch: when   */
+/* the batch is drained, the pending ACKs are flushed   */
+/* with one sendmmsg(2) and the batch is refilled with  */
+/* one recvmmsg(2). With GRO, every received datagram   */
+/* is split back into its RUDP segments. "packet"       */
+/* points into the batch and stays valid until the      */
+/* next call; its header is decoded into "header".      */
+/* DATA segments are not ACKed here: the caller queues  */
+/* their ACKs in "acks" with rudp_queue_ack() once they */
+/* are stored. Returns -3 if the batch has a timeout    */
+/* and no packet arrived in time                        */
 /********************************************************/
-int rudp_close(int sock, const struct sockaddr_in *server_addr, int isSender)
+int rudp_recv_batched(int socket, RUDP_Batch *batch, RUDP_Batch *acks, void **packet, RUDP_Header *header, struct sockaddr_in *src_addr, int run, RUDP_IO_Stats *io)
 {
-    RUDP_Header fin_packet = {0};                       // Initialize FIN packet structures to zero
-    struct timeval timeout = {TIMEOUT, 0};              // Set Timeout structure for select
-
-    int socket = sock;
-    fd_set read_fds;             // Set of file descriptors for select
-    FD_ZERO(&read_fds);          // Clear the file descriptor set
-    FD_SET(sock, &read_fds);     // Add the socket file descriptor to the set
-
-    if(isSender == 1)     // Only the Sender sends FIN
+    if (batch->next == batch->count && batch->ring)
     {
-        fin_packet.flags = FIN;     // Set FIN flag 
-        
-        // Checksum check
-        fin_packet.checksum = 0;   
-        fin_packet.checksum = rudp_compute_checksum(&fin_packet, sizeof(fin_packet));   
-
-        // Try to send the FIN packet and signal connection closure.
-        if(sendto(socket, &fin_packet, sizeof(fin_packet), 0, (const struct sockaddr *)server_addr, sizeof(*server_addr)) < 0)
-        {
-            print_time("ERROR: Failed to send FIN packet!\n");
+        // One io_uring_enter(2) sends the pending ACKs, re-posts the drained slots and waits for data
+        if (acks->count > 0 && rudp_uring_post_sends(socket, acks, acks->msgs, acks->count, io) < 0)
             return -1;
-        }
-        print_time("FIN sent\n");
-
-        // Wait for an ACK response to the FIN packet within the timeout period.
-        if (select(socket + 1, &read_fds, NULL, NULL, &timeout) > 0)
+        batch->count = batch->next = 0;
+        batch->offset = 0;
+        if (rudp_uring_post_recvs(socket, batch) < 0)
+            return -1;
+        long deadline = rudp_now_us() + batch->timeoutUs;
+        while (batch->count == 0 || acks->pending > 0)          // The ACK slots are reused once their sends completed
         {
-            RUDP_Header ack_packet = {0};   // Initialize a structure to store the received ACK packet
-            
-            // Check for receiving ACK
-            if (recvfrom(socket, &ack_packet, sizeof(ack_packet), 0, NULL, NULL) >= 0) 
-            {   
-                // Validate the ACK flag
-                if (ack_packet.flags & ACK)
-                {
-                    print_time("ACK for FIN received, closing connection...\n");
-                    return close(socket);     
-                }
+            long wait_us = -1;
+            if (batch->timeoutUs > 0 && acks->pending == 0)
+            {
+                wait_us = deadline - rudp_now_us();
+                if (wait_us <= 0)
+                    return -3;          // The posted receives stay armed for the next call
             }
-            
-            else
+            if (rudp_uring_enter(batch->ring, 1, wait_us, io) < 0 || acks->failed)
             {
-                print_time("ERROR: Failed to receive ACK for FIN!\n");
-                return -1;    
+                log_error("ERROR: Receive failed!\n");
+                acks->failed = 0;
+                return -1;
             }
         }
+        io->datagramsReceived += batch->count;
+    }
+    else if (batch->next == batch->count)
+    {
+        // ACK everything handed out so far before blocking for more data
+        if (acks->count > 0 && rudp_batch_flush(socket, acks, io) < 0)
+            return -1;
 
-        // Timeout scenario
-        else
+        for (int i = 0; i < batch->capacity; i++)
+        {
+            batch->iovs[2 * i].iov_len = batch->slotSize;
+            batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            if (batch->gro || batch->timestamps)
+                batch->msgs[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+        }
+
+        int received = recvmmsg(socket, batch->msgs, batch->capacity, MSG_WAITFORONE, NULL);
+        io->recvCalls++;
+        if (received < 0)
+        {
+            batch->count = batch->next = 0;
+            if (batch->timeoutUs > 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return -3;              // SO_RCVTIMEO expired
+            log_error("ERROR: Receive failed!\n");
+            return -1;
+        }
+        io->datagramsReceived += received;
+        batch->count = received;
+        batch->next = 0;
+        batch->offset = 0;
+    }
+
+    int i = batch->ring ? batch->order[batch->next] : batch->next;
+    int length = batch->msgs[i].msg_len;
+    batch->arrival = timing_now_ns();
+
+    // A coalesced datagram carries its segment size in a UDP_GRO control message, a stamped one its arrival time
+    if (batch->gro || batch->timestamps)
+    {
+        struct msghdr *hdr = &batch->msgs[i].msg_hdr;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg))
         {
-            print_time("Timeout waiting for ACK for FIN, closing connection...\n");
-            return close(socket); 
+            if (batch->timestamps && timing_rx_timestamp(cmsg, batch->arrival, &batch->arrival))
+                continue;
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+            {
+                int segment_size;
+                memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+                if (segment_size > 0 && length - batch->offset > segment_size)
+                    length = batch->offset + segment_size;
+            }
         }
     }
 
-    // Close Receiver socket
-    if(isSender == 0)       return close(socket);
+    *packet = batch->buffers + (size_t)i * batch->slotSize + batch->offset;
+    length -= batch->offset;
+    batch->offset += length;
+    if (batch->offset >= (int)batch->msgs[i].msg_len)
+    {
+        batch->next++;
+        batch->offset = 0;
+    }
 
-    return 0;       // successfully closure
+    *src_addr = batch->addrs[i];
+    return rudp_handle_packet(socket, *packet, length, header, src_addr, run, acks, io);
 }
 
 /********************************************************/
-/* Computes the checksum for a given block of data      */
+/* Allocate a batch of "capacity" packet buffers, each  */
+/* wired to its own message header and address slot     */
 /********************************************************/
-unsigned short int rudp_compute_checksum(void *data, unsigned int bytes)
+int rudp_batch_init(RUDP_Batch *batch, int capacity)
 {
-    unsigned short int *data_pointer = (unsigned short int *)data;      // Cast data pointer to short int for 16-bit processing
-    unsigned int total_sum = 0;                                         // Initialize sum to 0
-    
-    // Main loop: Sum 16-bit words together, handling overflow by wrapping around
-    while (bytes > 1)
+    memset(batch, 0, sizeof(*batch));
+    batch->slotSize = MAX_PACKET_SIZE;
+    batch->buffers = malloc((size_t)capacity * batch->slotSize);
+    batch->control = calloc(capacity, CONTROL_SIZE);
+    batch->msgs = calloc(capacity, sizeof(struct mmsghdr));
+    batch->iovs = calloc(2 * capacity, sizeof(struct iovec));
+    batch->addrs = calloc(capacity, sizeof(struct sockaddr_in));
+    if (!batch->buffers || !batch->control || !batch->msgs || !batch->iovs || !batch->addrs)
     {
-        total_sum += *data_pointer++;       // Add 16-bit word to sum and move pointer
-        bytes -= 2;                         // Decrement byte count by the size of a short int
+        rudp_batch_free(batch);
+        return -1;
     }
+    batch->capacity = capacity;
 
-    // If there is a left-over byte, add it to the sum
-    if (bytes > 0)
-        total_sum += *((unsigned char *)data_pointer);
-
-    // Fold 32-bit sum to 16 bits: add carry to the result itself
-    while (total_sum >> 16)
-        total_sum = (total_sum & 0xFFFF) + (total_sum >> 16);   // Keep folding until sum is reduced to 16 bits
-
-    return (~((unsigned short int)total_sum));
+    // Every datagram owns two I/O vectors: its slot, and an optional payload kept outside the batch
+    for (int i = 0; i < capacity; i++)
+    {
+        batch->iovs[2 * i].iov_base = batch->buffers + (size_t)i * batch->slotSize;
+        batch->iovs[2 * i].iov_len = batch->slotSize;
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[2 * i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+        batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+        batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    return 0;
 }
 
 /********************************************************/
-/* This fucntions shows time while printing to terminal */
+/* Let the kernel slice consecutive full-size datagrams */
+/* of the batch out of one send (UDP_SEGMENT). Returns  */
+/* 0 on success and -1 if allocation failed             */
 /********************************************************/
-void print_time(const char *format, ...)
+int rudp_batch_enable_gso(RUDP_Batch *batch, int segment_size)
 {
-    char formatted_time[9];                 // Buffer for HH:MM:SS format
-    va_list args;
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);   // Measure the current time
-
-    strftime(formatted_time, sizeof(formatted_time), "%H:%M:%S", tm_info);      // Format current time to HH:MM:SS
-
-    va_start(args, format);          // Start processing variable arguments
-    printf("[%s] ", formatted_time); // Print the current time prefix
-    vprintf(format, args);           // Print the rest of the message with format and args
-    va_end(args);                    // Clean up
+    batch->gsoMsgs = calloc(batch->capacity, sizeof(struct mmsghdr));
+    if (batch->gsoMsgs == NULL)
+        return -1;
+    batch->gsoSize = segment_size;
+    return 0;
 }
 
 /********************************************************/
-/* This fucntions prints statistics after closure       */
+/* Let the kernel coalesce datagrams of the same flow   */
+/* into one receive (UDP_GRO); the slots grow to hold a */
+/* full 64KB datagram. Returns 0 on success, -1 if GRO  */
+/* is unsupported or allocation failed                  */
 /********************************************************/
-void print_statistics(double *run_times, double *run_speeds, int runs, int totalDataSize)
+int rudp_batch_enable_gro(int socket, RUDP_Batch *batch)
 {
-    if (runs <  0 || totalDataSize <= 0)
+    int enable = 1;
+    if (setsockopt(socket, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) < 0)
     {
-        printf("No data to calculate statistics.\n");
-        return;
+        perror("setsockopt: UDP_GRO");
+        return -1;
     }
-    
-    double total_time_ms = 0.0;
-    double totalDataSizeMB = totalDataSize / (1024.0 * 1024.0);     // Convert total bytes to MB
 
-    printf("--------------------------------------------\n");
-    printf("Detailed Run Statistics:\n");
+    char *buffers = malloc((size_t)batch->capacity * GRO_BUFFER_SIZE);
+    if (buffers == NULL)
+        return -1;
+    free(batch->buffers);
+    batch->buffers = buffers;
+    batch->slotSize = GRO_BUFFER_SIZE;
+    batch->gro = 1;
 
-    for (int i = 0; i < runs + 1; i++)
+    for (int i = 0; i < batch->capacity; i++)
     {
-        total_time_ms += run_times[i];
-        printf("Run #%d:\t RTT: %.3f ms; Speed: %.3f Mbps\n", i + 1, run_times[i], run_speeds[i]);
+        batch->iovs[2 * i].iov_base = batch->buffers + (size_t)i * batch->slotSize;
+        batch->msgs[i].msg_hdr.msg_control = batch->control + (size_t)i * CONTROL_SIZE;
+        batch->msgs[i].msg_hdr.msg_controllen = CONTROL_SIZE;
     }
-
-    double avg_throughput_MB_s = totalDataSizeMB / (total_time_ms / 1000.0); // Average throughput in Mpss
-
-    printf("--------------------------------------------\n");
-    printf("Overall Summary Statistics:\n");
-    printf("Number of RTT samples: %d\n", runs + 1);
-    printf("Overall Data Received: %.3f MB\n", totalDataSizeMB);
-    printf("Average RTT: %.3f ms\n", total_time_ms / (runs + 1));
-    printf("Average Throughput: %.3f Mbps\n", avg_throughput_MB_s);
-    printf("Total Time: %.3f ms\n", total_time_ms);
-    printf("--------------------------------------------\n");
+    return 0;
 }
 
 /********************************************************/
+/* Have the kernel stamp every datagram of the batch as */
+/* it arrives (SO_TIMESTAMPING), so batch->arrival      */
+/* excludes the time it waited for the receiving        */
+/* thread. Returns 0 on success, -1 if unsupported      */
 /********************************************************/
-/**                                                    **/
-/**        Functions exclusively used by Sender        **/
-/**                                                    **/
-/********************************************************/
-/********************************************************/
-
-/********************************************************/
-/* Utility function to generate random data as txt      */
-/********************************************************/
-void util_generate_random_data_file(const char* filename, unsigned int size)
+int rudp_batch_enable_timestamps(int socket, RUDP_Batch *batch)
 {
-    FILE* file = fopen(filename, "wb");
-    if (!file) {
-        perror("Failed to open file");
-        exit(1);        // Exit if file cannot be opened
-    }
+    if (timing_enable_rx_timestamps(socket) < 0)
+        return -1;
+    batch->timestamps = 1;
 
-    srand(time(NULL));  // Randomize seed for the random number generator
-    for (unsigned int i = 0; i < size; i++)     // Generate random data
+    for (int i = 0; i < batch->capacity; i++)
     {
-        unsigned char random_byte = rand() % 256;
-        fwrite(&random_byte, 1, 1, file);
+        batch->msgs[i].msg_hdr.msg_control = batch->control + (size_t)i * CONTROL_SIZE;
+        batch->msgs[i].msg_hdr.msg_controllen = CONTROL_SIZE;
     }
-
-    fclose(file);
+    return 0;
 }
 
 /********************************************************/
+/* Make rudp_recv_batched() give up after "timeout_us"  */
+/* microseconds without data (0 = wait forever), so the */
+/* caller gets to run periodic work on an idle socket   */
 /********************************************************/
-/**                                                    **/
-/**       Functions exclusively used by Receiver       **/
-/**                                                    **/
-/********************************************************/
-/********************************************************/
-
-/********************************************************/
-/* This function saves the transmitted data to file     */
-/********************************************************/
-void save_data_as_txt(const char *data, int size, int run_number)
+int rudp_batch_set_timeout(int socket, RUDP_Batch *batch, long timeout_us)
 {
-    char filename[50];
-    sprintf(filename, "Received_Data_Run_%d.txt", run_number);
-    FILE *file = fopen(filename, "a");
-    if (!file)
+    struct timeval timeout = {timeout_us / 1000000, timeout_us % 1000000};
+    if (setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0)
     {
-        perror("Failed to open file");
-        return;
+        perror("setsockopt: SO_RCVTIMEO");
+        return -1;
     }
-    fwrite(data, 1, size, file);
-    fclose(file);
-    print_time("Data from Run %d saved to %s\n", run_number, filename);
+    batch->timeoutUs = timeout_us;
+    return 0;
 }
 
 /********************************************************/
-/* This function calculates elapsed milliseconds        */
-/* between two time points                              */
+/* Release the buffers of a batch                       */
 /********************************************************/
-long time_diff(struct timeval start, struct timeval end) 
+void rudp_batch_free(RUDP_Batch *batch)
 {
-    long sec_diff = end.tv_sec - start.tv_sec;
-    long usec_diff = end.tv_usec - start.tv_usec;
-    if (usec_diff < 0) 
-    {
-        sec_diff -= 1;
-        usec_diff += 1000000;                   // Adjust microseconds
-    }
-    return sec_diff * 1000 + usec_diff / 1000;  // Convert to milliseconds
+    free(batch->buffers);
+    free(batch->control);
+    free(batch->msgs);
+    free(batch->iovs);
+    free(batch->addrs);
+    free(batch->gsoMsgs);
+    free(batch->order);
+    free(batch->posted);
+    memset(batch, 0, sizeof(*batch));
 }
 
 /********************************************************/
-/* This function compare two files:                     */
-/* file1 = Sender's file; file2 = Rececived data        */
+/* Size of the datagram queued in slot "i" of a batch,  */
+/* including a payload kept outside the batch           */
 /********************************************************/
-int compare_files(const char *file1, const char *file2) 
+static size_t rudp_batch_datagram_size(const RUDP_Batch *batch, int i)
 {
-    FILE *fp1 = fopen(file1, "rb");
-    FILE *fp2 = fopen(file2, "rb");
-    if (fp1 == NULL || fp2 == NULL) 
-    {
-        if (fp1) fclose(fp1);
-        if (fp2) fclose(fp2);
-        return -1; 
-    }
+    size_t size = batch->iovs[2 * i].iov_len;
+    if (batch->msgs[i].msg_hdr.msg_iovlen == 2)
+        size += batch->iovs[2 * i + 1].iov_len;
+    return size;
+}
 
-    int isIdentical = 1;                    // A flag to identity
-    char ch1, ch2;
-    while (!feof(fp1) && !feof(fp2)) 
+/********************************************************/
+/* Group the queued datagrams into GSO sends: a group   */
+/* is a run of consecutive full-size datagrams to the   */
+/* same address, optionally closed by one shorter one.  */
+/* Every datagram is two I/O vectors (header, payload), */
+/* so a group is the I/O vectors of its datagrams back  */
+/* to back. Returns the number of groups built in       */
+/* batch->gsoMsgs                                       */
+/********************************************************/
+static int rudp_batch_build_gso(RUDP_Batch *batch)
+{
+    int groups = 0;
+    for (int i = 0; i < batch->count; groups++)
     {
-        fread(&ch1, sizeof(char), 1, fp1);
-        fread(&ch2, sizeof(char), 1, fp2);
-
-        if (ch1 != ch2) 
+        int first = i;
+        while (i < batch->count && i - first < GSO_MAX_SEGMENTS)
         {
-            isIdentical = 0;                // Files are not identical
-            break;
+            if (i > first && memcmp(&batch->addrs[i], &batch->addrs[first], sizeof(struct sockaddr_in)) != 0)
+                break;
+            i++;
+            if (rudp_batch_datagram_size(batch, i - 1) != (size_t)batch->gsoSize)      // Only the last datagram of a group may be shorter
+                break;
+        }
+
+        // Datagrams built whole in their slot leave the payload vector unused; empty it
+        for (int j = first; j < i; j++)
+        {
+            if (batch->msgs[j].msg_hdr.msg_iovlen == 1)
+                batch->iovs[2 * j + 1].iov_len = 0;
+        }
+
+        struct msghdr *hdr = &batch->gsoMsgs[groups].msg_hdr;
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->msg_iov = &batch->iovs[2 * first];
+        hdr->msg_iovlen = 2 * (i - first);
+        hdr->msg_name = &batch->addrs[first];
+        hdr->msg_namelen = sizeof(struct sockaddr_in);
+
+        if (i - first > 1)
+        {
+            char *control = batch->control + (size_t)groups * CONTROL_SIZE;
+            hdr->msg_control = control;
+            hdr->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = batch->gsoSize;
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        }
+    }
+    return groups;
+}
+
+/********************************************************/
+/* Send every datagram queued in a batch, with as few   */
+/* sendmmsg(2) calls as the kernel allows               */
+/********************************************************/
+int rudp_batch_flush(int socket, RUDP_Batch *batch, RUDP_IO_Stats *io)
+{
+    struct mmsghdr *msgs = batch->msgs;
+    int count = batch->count;
+    if (batch->gsoSize > 0)
+    {
+        msgs = batch->gsoMsgs;
+        count = rudp_batch_build_gso(batch);
+    }
+
+    // io_uring: one submission for all, then wait until the kernel is done with the buffers
+    if (batch->ring)
+    {
+        if (rudp_uring_post_sends(socket, batch, msgs, count, io) < 0)
+            return -1;
+        while (batch->pending > 0)
+        {
+            if (rudp_uring_enter(batch->ring, batch->pending, -1, io) < 0)
+                return -1;
+        }
+        if (batch->failed)
+        {
+            log_error("ERROR: io_uring send failed!\n");
+            batch->failed = 0;
+            return -1;
+        }
+        return 0;
+    }
+
+    int sent = 0;
+    while (sent < count)
+    {
+        int result = sendmmsg(socket, msgs + sent, count - sent, 0);
+        io->sendCalls++;
+        if (result < 0)
+        {
+            if (errno == EINTR)     continue;
+            log_error("ERROR: sendmmsg(2) failed!\n");
+            batch->count = 0;
+            return -1;
+        }
+        sent += result;
+    }
+    io->datagramsSent += batch->count;
+    batch->count = 0;
+    return 0;
+}
+
+/********************************************************/
+/* Move a batch through an io_uring instead of          */
+/* sendmmsg(2)/recvmmsg(2); several batches may share   */
+/* one ring. Returns 0 on success, -1 if allocation     */
+/* failed                                               */
+/********************************************************/
+int rudp_batch_enable_uring(RUDP_Batch *batch, IO_Uring *ring)
+{
+    batch->order = calloc(batch->capacity, sizeof(int));
+    batch->posted = calloc(batch->capacity, sizeof(char));
+    if (batch->order == NULL || batch->posted == NULL)
+    {
+        free(batch->order);
+        free(batch->posted);
+        batch->order = NULL;
+        batch->posted = NULL;
+        return -1;
+    }
+    batch->ring = ring;
+    return 0;
+}
+
+/********************************************************/
+/* Apply a completion to the batch and slot named by    */
+/* its user_data: a received datagram is appended to    */
+/* the batch's completion order, a finished send        */
+/* releases its slot                                    */
+/********************************************************/
+static void rudp_uring_complete(const struct io_uring_cqe *cqe)
+{
+    if (cqe->user_data == 0)
+        return;         // Cancel requests carry no batch
+
+    RUDP_Batch *batch = (RUDP_Batch *)(uintptr_t)(cqe->user_data & ((1ULL << URING_SLOT_SHIFT) - 1));
+    int slot = (cqe->user_data & ~URING_RECV_TAG) >> URING_SLOT_SHIFT;
+    if (cqe->user_data & URING_RECV_TAG)
+    {
+        batch->posted[slot] = 0;
+        if (cqe->res < 0)
+            return;     // Canceled or failed: the slot is simply posted again
+        batch->msgs[slot].msg_len = cqe->res;
+        batch->order[batch->count++] = slot;
+    }
+    else
+    {
+        batch->pending--;
+        if (cqe->res < 0)
+            batch->failed = 1;
+    }
+}
+
+/********************************************************/
+/* Submit everything prepared and wait for "wait_for"   */
+/* completions (at most "timeout_us" microseconds when  */
+/* it is not negative) in one io_uring_enter(2), then   */
+/* apply every completion available                     */
+/********************************************************/
+static int rudp_uring_enter(IO_Uring *ring, unsigned wait_for, long timeout_us, RUDP_IO_Stats *io)
+{
+    long before = ring->enterCalls;
+    int result = (timeout_us >= 0) ? uring_submit_timeout(ring, wait_for, timeout_us) : uring_submit(ring, wait_for);
+    io->ringCalls += ring->enterCalls - before;
+    if (result < 0)
+        return -1;
+
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(ring)) != NULL)
+    {
+        rudp_uring_complete(cqe);
+        uring_cqe_seen(ring);
+    }
+    return 0;
+}
+
+/********************************************************/
+/* Prepare a send for every message of a batch without  */
+/* entering the kernel; the slots stay in use until the */
+/* batch's pending count drops back to 0                */
+/********************************************************/
+static int rudp_uring_post_sends(int socket, RUDP_Batch *batch, struct mmsghdr *msgs, int count, RUDP_IO_Stats *io)
+{
+    for (int i = 0; i < count; i++)
+    {
+        struct io_uring_sqe *sqe = uring_get_sqe(batch->ring);
+        if (sqe == NULL)
+        {
+            log_error("ERROR: io_uring submission queue is full!\n");
+            return -1;
+        }
+        uring_prep_sendmsg(sqe, socket, &msgs[i].msg_hdr, 0);
+        sqe->user_data = URING_TAG(batch, i, 0);
+        batch->pending++;
+    }
+    io->datagramsSent += batch->count;
+    batch->count = 0;
+    return 0;
+}
+
+/********************************************************/
+/* Prepare a receive for every slot of a batch that has */
+/* none posted (all of them have been handed out)       */
+/********************************************************/
+static int rudp_uring_post_recvs(int socket, RUDP_Batch *batch)
+{
+    for (int i = 0; i < batch->capacity; i++)
+    {
+        if (batch->posted[i])
+            continue;
+
+        struct msghdr *hdr = &batch->msgs[i].msg_hdr;
+        batch->iovs[2 * i].iov_len = batch->slotSize;
+        hdr->msg_namelen = sizeof(struct sockaddr_in);
+        if (batch->gro || batch->timestamps)
+        {
+            memset(hdr->msg_control, 0, CONTROL_SIZE);      // No stale UDP_GRO size or stamp if none is delivered
+            hdr->msg_controllen = CONTROL_SIZE;
+        }
+
+        struct io_uring_sqe *sqe = uring_get_sqe(batch->ring);
+        if (sqe == NULL)
+        {
+            log_error("ERROR: io_uring submission queue is full!\n");
+            return -1;
+        }
+        uring_prep_recvmsg(sqe, socket, hdr, 0);
+        sqe->user_data = URING_TAG(batch, i, 1);
+        batch->posted[i] = 1;
+    }
+    return 0;
+}
+
+/********************************************************/
+/* Cancel the receives posted for a batch and wait for  */
+/* them, so blocking calls see the next datagrams       */
+/********************************************************/
+static int rudp_uring_cancel_recvs(RUDP_Batch *batch, RUDP_IO_Stats *io)
+{
+    int posted = 0;
+    for (int i = 0; i < batch->capacity; i++)
+    {
+        if (!batch->posted[i])
+            continue;
+        struct io_uring_sqe *sqe = uring_get_sqe(batch->ring);
+        if (sqe == NULL)
+            return -1;
+        uring_prep_cancel(sqe, URING_TAG(batch, i, 1));
+        posted++;
+    }
+
+    while (posted > 0)
+    {
+        if (rudp_uring_enter(batch->ring, 1, -1, io) < 0)
+            return -1;
+        posted = 0;
+        for (int i = 0; i < batch->capacity; i++)
+            posted += batch->posted[i];
+    }
+    batch->count = batch->next = 0;
+    return 0;
+}
+
+/********************************************************/
+/* Send a SYN-ACK packet over a socket to a specified   */
+/* address. This function used for the 3-way handshake  */
+/* in a RUDP protocol to acknowledge a SYN packet and   */
+/* indicate readiness for data transmission. A CRC32C   */
+/* request of the Sender is accepted by echoing it, as  */
+/* is the connection ID                                 */
+/********************************************************/
+void rudp_send_synack(int sock, const struct sockaddr *src_addr, uint32_t connection_id, char crc32c)
+{
+    RUDP_Header syn_ack_header = {0};   // Initialize ACK header to zero
+    char syn_ack_packet[RUDP_HEADER_SIZE];
+    syn_ack_header.flags = SYN | ACK;   // Set tboth SYN and ACK flags to indicate this is that kind of packet  
+    syn_ack_header.connectionId = connection_id;
+    if (crc32c)
+        syn_ack_header.flags |= CRC32C_MODE;
+    rudp_header_encode(syn_ack_packet, &syn_ack_header);
+    rudp_packet_seal(syn_ack_packet, sizeof(syn_ack_packet), NULL, 0);             // Compute the packet's checksum for integrity verification
+    
+    // Send the SYN-ACK packet to the source address
+    sendto(sock, syn_ack_packet, sizeof(syn_ack_packet), 0, src_addr, sizeof(struct sockaddr_in));
+    
+    log_info("SYN-ACK sent\n");
+}
+
+/********************************************************/
+/* Initiate closure of an RUDP connection by sending    */
+/* a FIN packet to the Receiver and waiting for an ACK  */
+/* to ensures the connection is properly closed         */
+/********************************************************/
+int rudp_close(RUDP_Connection *conn, int isSender)
+{
+    RUDP_Header fin_header = {0};                       // Initialize FIN header to zero
+    char fin_packet[RUDP_HEADER_SIZE];
+
+    if(isSender == 1)     // Only the Sender sends FIN
+    {
+        fin_header.flags = FIN;                                     // Set FIN flag 
+        fin_header.offset = RUDP_SEGMENT_OFFSET(conn->nextSegment); // The Receiver echoes it in the FIN's ACK
+        fin_header.connectionId = conn->id;
+        if (conn->checksumMode == CHECKSUM_CRC32C)
+            fin_header.flags |= CRC32C_MODE;
+        
+        // Checksum
+        rudp_header_encode(fin_packet, &fin_header);
+        rudp_packet_seal(fin_packet, sizeof(fin_packet), NULL, 0);
+
+        // Try to send the FIN packet and wait for its ACK (retransmitted on RTO)
+        log_info("FIN sent\n");
+        int result = rudp_exchange(conn, fin_packet, sizeof(fin_packet), ACK, MAX_CONTROL_ATTEMPTS, "FIN packet", NULL, NULL);
+        if (result == 0)
+        {
+            log_info("ACK for FIN received, closing connection...\n");
+        }
+        else if (result == -2)
+        {
+            log_warn("Timeout waiting for ACK for FIN, closing connection...\n");
+        }
+        else
+        {
+            log_error("ERROR: Failed to receive ACK for FIN!\n");
+            if (conn->ring.fd >= 0)
+                uring_free(&conn->ring);
+            rudp_batch_free(&conn->sendBatch);
+            rudp_batch_free(&conn->recvBatch);
+            close(conn->sock);
+            return -1;
+        }
+    }
+
+    if (conn->ring.fd >= 0)
+        uring_free(&conn->ring);
+    rudp_batch_free(&conn->sendBatch);
+    rudp_batch_free(&conn->recvBatch);
+    return close(conn->sock);       // Close the socket (the Receiver closes without sending FIN)
+}
+
+
+/********************************************************/
+/* This fucntions prints statistics after closure: the  */
+/* duration of every run, and the percentiles of the    */
+/* per-segment samples ("samples", plus the samples of  */
+/* retransmitted segments kept apart in "inflated";     */
+/* either may be NULL)                                  */
+/********************************************************/
+void print_statistics(double *run_times, double *run_speeds, int runs, long totalDataSize, const char *samples_name, const Histogram *samples, const Histogram *inflated)
+{
+    if (runs <  0 || totalDataSize <= 0)
+    {
+        log_plain("No data to calculate statistics.\n");
+        return;
+    }
+    
+    double total_time_ms = 0.0;
+    double totalDataSizeMB = totalDataSize / (1024.0 * 1024.0);     // Convert total bytes to MB
+
+    log_plain("--------------------------------------------\n");
+    log_plain("Detailed Run Statistics:\n");
+
+    for (int i = 0; i < runs + 1; i++)
+    {
+        total_time_ms += run_times[i];
+        log_plain("Run #%d:\t Time: %.3f ms; Speed: %.3f Mbps\n", i + 1, run_times[i], run_speeds[i]);
+    }
+
+    double avg_throughput_MB_s = totalDataSizeMB / (total_time_ms / 1000.0); // Average throughput in Mpss
+
+    log_plain("--------------------------------------------\n");
+    log_plain("Overall Summary Statistics:\n");
+    log_plain("Number of runs: %d\n", runs + 1);
+    log_plain("Overall Data Received: %.3f MB\n", totalDataSizeMB);
+    log_plain("Average run time: %.3f ms\n", total_time_ms / (runs + 1));
+    log_plain("Average Throughput: %.3f Mbps\n", avg_throughput_MB_s);
+    log_plain("Total Time: %.3f ms\n", total_time_ms);
+    if (samples)
+        hist_print(samples_name, samples);
+    if (inflated)
+        hist_print("Retransmission-inflated samples", inflated);
+    log_plain("--------------------------------------------\n");
+}
+
+/********************************************************/
+/* This fucntions prints the data-path system calls     */
+/* spent per megabyte of payload                        */
+/********************************************************/
+void print_io_statistics(const RUDP_IO_Stats *io, long total_data)
+{
+    long syscalls = io->sendCalls + io->recvCalls + io->pollCalls + io->ringCalls;
+    double totalDataSizeMB = total_data / (1024.0 * 1024.0);
+
+    log_plain("System Calls: %ld (send: %ld, receive: %ld, select: %ld, io_uring_enter: %ld)\n", syscalls, io->sendCalls, io->recvCalls, io->pollCalls, io->ringCalls);
+    log_plain("Datagrams: %ld sent, %ld received\n", io->datagramsSent, io->datagramsReceived);
+    if (io->checksumFailures > 0)
+        log_plain("Checksum failures: %ld datagram(s) dropped\n", io->checksumFailures);
+    if (totalDataSizeMB > 0)
+        log_plain("System Calls per MB: %.1f\n", syscalls / totalDataSizeMB);
+}
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**        Functions exclusively used by Sender        **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+/********************************************************/
+/* Initialize the Sender's connection state after the   */
+/* handshake. A window size of 1 is STOP-and-WAIT. The  */
+/* window is clamped to what the socket buffers hold,   */
+/* so that it does not overflow them (the Receiver's    */
+/* are sized the same way)                              */
+/* Returns 0 on success, -1 if allocation failed        */
+/********************************************************/
+int rudp_connection_init(RUDP_Connection *conn, int sock, const struct sockaddr_in *peer, int window_size)
+{
+    int fits = rudp_socket_window(sock);
+    if (window_size > fits)
+    {
+        log_warn("Window clamped from %d to %d segments: the socket buffers hold no more\n", window_size, fits);
+        window_size = fits;
+    }
+
+    memset(conn, 0, sizeof(*conn));
+    conn->sock = sock;
+    conn->peer = *peer;
+    conn->windowSize = window_size;
+    conn->nextSegment = 1;          // Segment numbers start at 1 and continue across runs
+    conn->ring.fd = -1;             // Blocking sendmmsg(2)/recvmmsg(2) until rudp_set_uring()
+
+    // A random connection ID keeps this connection apart from the others on the Receiver, even from the same address
+    if (getrandom(&conn->id, sizeof(conn->id), 0) != sizeof(conn->id) || conn->id == 0)
+        conn->id = (uint32_t)getpid() ^ (uint32_t)rudp_now_us();
+    rudp_rtt_init(&conn->rtt);
+    rudp_set_congestion_control(conn, "none");
+    conn->metrics = metrics_claim(METRICS_RUDP_SENDER, "connection_id=\"%08x\"", conn->id);
+    return rudp_set_batch_size(conn, DEFAULT_BATCH_SIZE);
+}
+
+/********************************************************/
+/* Set how many datagrams the connection moves per      */
+/* sendmmsg(2)/recvmmsg(2) call (1 = one per syscall)   */
+/********************************************************/
+int rudp_set_batch_size(RUDP_Connection *conn, int batch_size)
+{
+    rudp_batch_free(&conn->sendBatch);
+    rudp_batch_free(&conn->recvBatch);
+    if (rudp_batch_init(&conn->sendBatch, batch_size) < 0 || rudp_batch_init(&conn->recvBatch, batch_size) < 0)
+    {
+        log_error("ERROR: Failed to allocate the datagram batches!\n");
+        rudp_batch_free(&conn->sendBatch);
+        return -1;
+    }
+    return 0;
+}
+
+/********************************************************/
+/* Hand full-size data segments to the kernel in 64KB   */
+/* sends that it slices into datagrams (UDP GSO)        */
+/********************************************************/
+int rudp_set_gso(RUDP_Connection *conn)
+{
+    if (rudp_batch_enable_gso(&conn->sendBatch, MAX_PACKET_SIZE) < 0)
+    {
+        log_error("ERROR: Failed to allocate the GSO batch!\n");
+        return -1;
+    }
+    return 0;
+}
+
+/********************************************************/
+/* Ask the Receiver during the handshake to protect the */
+/* packets with CRC32C instead of the Internet checksum */
+/********************************************************/
+void rudp_set_checksum_mode(RUDP_Connection *conn, int mode)
+{
+    conn->checksumMode = mode;
+}
+
+/********************************************************/
+/* Move the connection's data segments and ACKs through */
+/* an io_uring: sends are submitted together with the   */
+/* wait for ACKs, which have receives posted in advance */
+/* Must follow rudp_set_batch_size() and rudp_set_gso() */
+/********************************************************/
+int rudp_set_uring(RUDP_Connection *conn)
+{
+    if (uring_init(&conn->ring, URING_ENTRIES) < 0)
+    {
+        conn->ring.fd = -1;
+        return -1;
+    }
+    if (rudp_batch_enable_uring(&conn->sendBatch, &conn->ring) < 0 || rudp_batch_enable_uring(&conn->recvBatch, &conn->ring) < 0)
+    {
+        log_error("ERROR: Failed to allocate the io_uring batches!\n");
+        uring_free(&conn->ring);
+        return -1;
+    }
+    return 0;
+}
+
+/********************************************************/
+/* The bytes of segment "index" of the current run:     */
+/* straight from "data", or from the producer's ring    */
+/* slot that holds it (PIPE_SLOT_SEGMENTS per slot)     */
+/********************************************************/
+static const char *rudp_segment_data(const RUDP_Connection *conn, const char *data, int index)
+{
+    if (conn->sendRing == NULL)
+        return data + (size_t)index * MAX_SEGMENT_SIZE;
+    const char *slot = ring_slot(conn->sendRing, index / PIPE_SLOT_SEGMENTS, NULL);
+    return slot + (size_t)(index % PIPE_SLOT_SEGMENTS) * MAX_SEGMENT_SIZE;
+}
+
+/********************************************************/
+/* Payload bytes of the segment at "offset" of a run of */
+/* "size" bytes. The digest-only final segment of a run */
+/* whose last data segment has no room for the digest   */
+/* starts at or past the end of the data: it has none   */
+/********************************************************/
+static int rudp_segment_length(size_t size, size_t offset)
+{
+    if (offset >= size)
+        return 0;
+    return (size - offset < MAX_SEGMENT_SIZE) ? size - offset : MAX_SEGMENT_SIZE;
+}
+
+/********************************************************/
+/* Queue a data segment of a run in the next slot of    */
+/* the send batch; a full batch is flushed first. Only  */
+/* the header is written to the slot: the payload is    */
+/* sent straight from "data" (scatter-gather), which    */
+/* must stay valid until the batch is flushed. The      */
+/* run's final segment also carries the run digest      */
+/* right after its header                               */
+/********************************************************/
+static int rudp_queue_segment(RUDP_Connection *conn, const char *data, size_t size, long firstSegment, int index, int totalSegments)
+{
+    RUDP_Batch *batch = &conn->sendBatch;
+    if (batch->count == batch->capacity && rudp_batch_flush(conn->sock, batch, &conn->io) < 0)
+        return -1;
+
+    // io_uring: the slots may be refilled only once the previous sends completed
+    while (batch->pending > 0)
+    {
+        if (rudp_uring_enter(batch->ring, 1, -1, &conn->io) < 0)
+            return -1;
+    }
+
+    int slot = batch->count;
+    char *packet = batch->buffers + (size_t)slot * batch->slotSize;
+    size_t offset = (size_t)index * MAX_SEGMENT_SIZE;
+    int segment_data_size = rudp_segment_length(size, offset);
+    size_t header_size = RUDP_HEADER_SIZE;
+    const char *segment_data = (segment_data_size > 0) ? rudp_segment_data(conn, data, index) : NULL;
+
+    RUDP_Header header = {0};
+    header.offset = RUDP_SEGMENT_OFFSET(firstSegment + index);              // Position of the payload in the connection's sequence space
+    header.length = segment_data_size;
+    header.flags = (index == totalSegments - 1) ? LAST_PACKET : DATA;       // The run's final segment closes the run
+    if (conn->checksumMode == CHECKSUM_CRC32C)
+        header.flags |= CRC32C_MODE;
+    header.connectionId = conn->id;
+    if (header.flags & LAST_PACKET)
+    {
+        uint64_t digest = htobe64(conn->runDigest);
+        memcpy(packet + header_size, &digest, DIGEST_SIZE);
+        header_size += DIGEST_SIZE;
+        header.length += DIGEST_SIZE;
+    }
+
+    rudp_header_encode(packet, &header);
+    rudp_packet_seal(packet, header_size, segment_data, segment_data_size);
+
+    batch->iovs[2 * slot].iov_len = header_size;
+    batch->iovs[2 * slot + 1].iov_base = (void *)segment_data;
+    batch->iovs[2 * slot + 1].iov_len = segment_data_size;
+    batch->msgs[slot].msg_hdr.msg_iovlen = 2;
+    batch->addrs[slot] = conn->peer;
+    batch->count++;
+    return 0;
+}
+
+/********************************************************/
+/* Send what the send batch holds. With io_uring the    */
+/* sends are only prepared: they are submitted by the   */
+/* same io_uring_enter(2) that waits for the ACKs       */
+/********************************************************/
+static int rudp_send_flush(RUDP_Connection *conn)
+{
+    RUDP_Batch *batch = &conn->sendBatch;
+    if (batch->ring == NULL)
+        return rudp_batch_flush(conn->sock, batch, &conn->io);
+    if (batch->gsoSize > 0)
+        return rudp_uring_post_sends(conn->sock, batch, batch->gsoMsgs, rudp_batch_build_gso(batch), &conn->io);
+    return rudp_uring_post_sends(conn->sock, batch, batch->msgs, batch->count, &conn->io);
+}
+
+// Per-segment transmission state of a run
+typedef struct {
+    uint64_t firstSentAt;   // Time (ns) of the first transmission
+    uint64_t sentAt;        // Time (ns) of the latest transmission
+    int attempts;       // Number of transmissions so far
+    char acked;         // Set once the segment's ACK arrived
+} Segment_State;
+
+/********************************************************/
+/* Retransmit a segment considered lost, giving up      */
+/* after MAX_ATTEMPTS transmissions                     */
+/********************************************************/
+static int rudp_retransmit_segment(RUDP_Connection *conn, const char *data, size_t size, long firstSegment, int index, int totalSegments, Segment_State *state, uint64_t now)
+{
+    if (state[index].attempts >= MAX_ATTEMPTS)
+    {
+        log_error("Maximum retransmission attempts reached for segment #%ld...\n", firstSegment + index);
+        return -2;
+    }
+    if (rudp_queue_segment(conn, data, size, firstSegment, index, totalSegments) < 0)
+        return -1;
+
+    state[index].sentAt = now;
+    state[index].attempts++;
+    conn->retransmissions++;
+    metrics_add(conn->metrics, METRIC_RETRANSMISSIONS, 1);
+    return 0;
+}
+
+/********************************************************/
+/* Number of segments the sliding window may currently  */
+/* keep in flight: the configured window, further       */
+/* limited by the congestion window                     */
+/********************************************************/
+static int rudp_effective_window(const RUDP_Connection *conn)
+{
+    int cwnd = (int)conn->cc.cwnd;
+    if (cwnd < 1)                   cwnd = 1;
+    return (cwnd < conn->windowSize) ? cwnd : conn->windowSize;
+}
+
+/********************************************************/
+/* Store the RTT estimator and window state in the      */
+/* connection's live metrics                            */
+/********************************************************/
+static void rudp_publish_gauges(RUDP_Connection *conn, int in_flight)
+{
+    metrics_set(conn->metrics, METRIC_RTO, conn->rtt.rto);
+    metrics_set(conn->metrics, METRIC_SRTT, conn->rtt.srtt);
+    metrics_set(conn->metrics, METRIC_RTTVAR, conn->rtt.rttvar);
+    metrics_set(conn->metrics, METRIC_CWND, conn->cc.cwnd * 1000);
+    metrics_set(conn->metrics, METRIC_IN_FLIGHT, in_flight);
+}
+
+/********************************************************/
+/* Send one run of data with a selective-repeat sliding */
+/* window: up to windowSize segments are in flight,     */
+/* each one is acknowledged individually, and only the  */
+/* lost segments are retransmitted - either when their  */
+/* own timer expires or when DUP_ACK_THRESHOLD later    */
+/* segments were acknowledged before them               */
+/********************************************************/
+int rudp_send_run(RUDP_Connection *conn, const char *data, size_t size)
+{
+    if (size == 0)      return 0;
+
+    conn->runDigest = 0;
+    hist_reset(&conn->rttSamples);
+    hist_reset(&conn->inflatedSamples);
+    int totalSegments = (size + DIGEST_SIZE + MAX_SEGMENT_SIZE - 1) / MAX_SEGMENT_SIZE;    // Room for the digest in the final segment
+    long firstSegment = conn->nextSegment;
+    if (RUDP_SEGMENT_OFFSET(firstSegment + totalSegments) > RUDP_MAX_OFFSET)       // Checked once: the header encoding is branch-free
+    {
+        log_error("ERROR: The run does not fit in the connection's sequence space (%llu bytes)!\n", RUDP_MAX_OFFSET);
+        return -1;
+    }
+    Segment_State *state = calloc(totalSegments, sizeof(Segment_State));
+    if (state == NULL)
+    {
+        log_error("ERROR: Failed to allocate the sending window!\n");
+        return -1;
+    }
+
+    int base = 0;           // Oldest unacknowledged segment
+    int next = 0;           // Next segment to transmit for the first time
+    int highestAcked = -1;  // Highest acknowledged segment, used for loss detection
+    int result = 0;
+
+    while (base < totalSegments)
+    {
+        // Fill the window with new segments
+        while (next < totalSegments && next - base < rudp_effective_window(conn))
+        {
+            size_t offset = (size_t)next * MAX_SEGMENT_SIZE;
+
+            // Pipelined run: wait for the producer only with nothing in flight, otherwise go on handling ACKs
+            if (conn->sendRing && offset < size && !ring_ready(conn->sendRing, next / PIPE_SLOT_SEGMENTS) &&
+                (next > base || !ring_wait(conn->sendRing, next / PIPE_SLOT_SEGMENTS)))
+            {
+                if (next > base)
+                    break;
+                log_error("ERROR: The producer stopped before the end of the run!\n");
+                result = -1;
+                goto done;
+            }
+
+            // Hashed once, on first transmission: the final segment carries the sum (empty segments add nothing)
+            int length = rudp_segment_length(size, offset);
+            if (length > 0)
+                conn->runDigest += digest_segment(rudp_segment_data(conn, data, next), length, offset);
+            if (rudp_queue_segment(conn, data, size, firstSegment, next, totalSegments) < 0)
+            {
+                result = -1;
+                goto done;
+            }
+            state[next].sentAt = state[next].firstSentAt = timing_now_ns();
+            state[next].attempts = 1;
+            conn->segmentsSent++;
+            metrics_add(conn->metrics, METRIC_SEGMENTS, 1);
+            metrics_add(conn->metrics, METRIC_BYTES, length);
+            next++;
+        }
+        if (rudp_send_flush(conn) < 0)
+        {
+            result = -1;
+            goto done;
+        }
+
+        // Wait for an ACK, at most until the earliest retransmission deadline in the window
+        long now = rudp_now_us();
+        long deadline = now + conn->rtt.rto;
+        for (int i = base; i < next; i++)
+        {
+            if (!state[i].acked && (long)(state[i].sentAt / 1000) + conn->rtt.rto < deadline)
+                deadline = (long)(state[i].sentAt / 1000) + conn->rtt.rto;
+        }
+        long wait_us = (deadline > now) ? deadline - now : 0;
+        RUDP_Batch *acks = &conn->recvBatch;
+        int selectResult;
+
+        if (acks->ring)
+        {
+            // One io_uring_enter(2) submits the queued segments and waits for ACKs on receives posted in advance
+            acks->count = acks->next = 0;
+            if (rudp_uring_post_recvs(conn->sock, acks) < 0)
+            {
+                result = -1;
+                goto done;
+            }
+            do
+            {
+                now = rudp_now_us();
+                if (rudp_uring_enter(acks->ring, 1, (deadline > now) ? deadline - now : 0, &conn->io) < 0 || conn->sendBatch.failed)
+                {
+                    log_error("ERROR: io_uring failed while waiting for ACK\n");
+                    result = -1;
+                    goto done;
+                }
+            } while (acks->count == 0 && rudp_now_us() < deadline);
+            selectResult = acks->count;
+        }
+        else
+        {
+            struct timeval timeout = {wait_us / 1000000, wait_us % 1000000};
+            fd_set read_fds;
+            FD_ZERO(&read_fds);
+            FD_SET(conn->sock, &read_fds);
+            selectResult = select(conn->sock + 1, &read_fds, NULL, NULL, &timeout);
+            conn->io.pollCalls++;
+            if (selectResult < 0 && errno != EINTR)
+            {
+                log_error("ERROR: select error while waiting for ACK\n");
+                result = -1;
+                goto done;
+            }
+        }
+
+        // Drain every ACK already queued on the socket, a batch per recvmmsg(2) (io_uring has them in hand already)
+        if (selectResult > 0)
+        {
+            int received;
+            do
+            {
+                if (acks->ring)
+                {
+                    received = acks->count;
+                    conn->io.datagramsReceived += received;
+                }
+                else
+                {
+                    for (int i = 0; i < acks->capacity; i++)
+                        acks->iovs[2 * i].iov_len = acks->slotSize;
+                    received = recvmmsg(conn->sock, acks->msgs, acks->capacity, MSG_DONTWAIT, NULL);
+                    conn->io.recvCalls++;
+                    if (received > 0)
+                        conn->io.datagramsReceived += received;
+                }
+
+                for (int j = 0; j < received; j++)
+                {
+                    int slot = acks->ring ? acks->order[j] : j;
+                    const char *ack_packet = acks->buffers + (size_t)slot * acks->slotSize;
+                    if (acks->msgs[slot].msg_len != RUDP_HEADER_SIZE)
+                        continue;
+
+                    RUDP_Header ack_header;
+                    rudp_header_decode(ack_packet, &ack_header);
+                    if (rudp_packet_checksum(ack_packet, RUDP_HEADER_SIZE) != ack_header.checksum)
+                    {
+                        conn->io.checksumFailures++;
+                        metrics_add(conn->metrics, METRIC_CHECKSUM_FAILURES, 1);
+                        continue;
+                    }
+                    if (ack_header.version != RUDP_VERSION || !(ack_header.flags & ACK) || ack_header.connectionId != conn->id)
+                        continue;
+
+                    long index = RUDP_OFFSET_SEGMENT(ack_header.offset) - firstSegment;
+                    if (index < 0 || index >= next || state[index].acked)      // Stale ACKs from earlier runs fall outside the range
+                        continue;
+
+                    state[index].acked = 1;
+                    uint64_t ackedAt = timing_now_ns();
+                    now = (long)(ackedAt / 1000);
+                    if (state[index].attempts == 1)         // Karn: retransmitted segments give ambiguous samples
+                    {
+                        rudp_rtt_sample(&conn->rtt, (long)((ackedAt - state[index].sentAt) / 1000));
+                        hist_record(&conn->rttSamples, ackedAt - state[index].sentAt);
+                    }
+                    else                                    // ... kept apart: what the loss cost the segment
+                    {
+                        hist_record(&conn->inflatedSamples, ackedAt - state[index].firstSentAt);
+                    }
+                    conn->cc.ops->on_ack(&conn->cc, now, conn->rtt.srtt);
+                    if (index > highestAcked)
+                        highestAcked = index;
+                }
+            } while (!acks->ring && received == acks->capacity);
+            while (base < next && state[base].acked)    // Slide the window past the acknowledged prefix
+                base++;
+            if (conn->sendRing)                         // Ring slots behind the window go back to the producer
+                ring_release(conn->sendRing, base / PIPE_SLOT_SEGMENTS);
+
+            // Fast retransmit: a segment sent before one that is DUP_ACK_THRESHOLD segments ahead and already ACKed is lost
+            uint64_t nowNs = timing_now_ns();
+            now = (long)(nowNs / 1000);
+            for (int i = base; highestAcked >= 0 && i + DUP_ACK_THRESHOLD <= highestAcked; i++)
+            {
+                if (state[i].acked || state[i].sentAt > state[highestAcked].sentAt)
+                    continue;
+
+                if (firstSegment + i >= conn->cc.recoveryPoint)         // One window reduction per loss event
+                {
+                    conn->cc.ops->on_loss(&conn->cc, now);
+                    conn->cc.recoveryPoint = firstSegment + next;
+                    conn->cc.lossEvents++;
+                }
+                if ((result = rudp_retransmit_segment(conn, data, size, firstSegment, i, totalSegments, state, nowNs)) < 0)
+                    goto done;
+            }
+        }
+
+        // Retransmit only the segments whose own timer expired; back off once per timeout event
+        uint64_t nowNs = timing_now_ns();
+        now = (long)(nowNs / 1000);
+        uint64_t rto = (uint64_t)conn->rtt.rto * 1000;
+        int expired = 0;
+        for (int i = base; i < next; i++)
+        {
+            if (state[i].acked || state[i].sentAt + rto > nowNs)
+                continue;
+
+            if (!expired++)
+            {
+                rudp_rtt_backoff(&conn->rtt);
+                conn->cc.ops->on_timeout(&conn->cc, now);
+                conn->cc.recoveryPoint = firstSegment + next;
+                conn->cc.timeouts++;
+                metrics_add(conn->metrics, METRIC_TIMEOUTS, 1);
+            }
+            log_ratelimited(LOG_WARN, LOG_SEGMENT_INTERVAL_MS, "Timeout waiting for ACK for segment #%ld, attempt %d/%d (RTO now %.3f ms)\n", firstSegment + i, state[i].attempts + 1, MAX_ATTEMPTS, conn->rtt.rto / 1000.0);
+            if ((result = rudp_retransmit_segment(conn, data, size, firstSegment, i, totalSegments, state, nowNs)) < 0)
+                goto done;
+        }
+
+        // Send the retransmissions queued by both loss detectors
+        if (rudp_send_flush(conn) < 0)
+        {
+            result = -1;
+            goto done;
+        }
+        rudp_publish_gauges(conn, next - base);
+    }
+
+done:
+    conn->sendBatch.count = 0;
+    conn->nextSegment = firstSegment + totalSegments;
+
+    // io_uring: hand the socket back to blocking calls (FIN exchange) with no receive posted or send unfinished
+    if (conn->recvBatch.ring)
+    {
+        if (rudp_uring_cancel_recvs(&conn->recvBatch, &conn->io) < 0)
+            result = -1;
+        while (result == 0 && conn->sendBatch.pending > 0)
+        {
+            if (rudp_uring_enter(conn->sendBatch.ring, 1, -1, &conn->io) < 0)
+                result = -1;
+        }
+    }
+    if (result == 0)
+        metrics_add(conn->metrics, METRIC_RUNS, 1);
+    free(state);
+    return result;
+}
+
+/********************************************************/
+/* Send one run of "size" bytes that a producer thread  */
+/* fills "ring" with (slots of PIPE_SLOT_SIZE bytes)    */
+/* while the window drains it: a slot is handed back    */
+/* once all of its segments were acknowledged           */
+/********************************************************/
+int rudp_send_run_ring(RUDP_Connection *conn, Ring *ring, size_t size)
+{
+    if (ring->slotSize != PIPE_SLOT_SIZE)
+    {
+        log_error("ERROR: Pipeline ring slots must hold %d segments!\n", PIPE_SLOT_SEGMENTS);
+        return -1;
+    }
+    conn->sendRing = ring;
+    int result = rudp_send_run(conn, NULL, size);
+    conn->sendRing = NULL;
+    return result;
+}
+
+/********************************************************/
+/* Congestion control "none": the window is limited by  */
+/* the configured window size only                      */
+/********************************************************/
+static void cc_none_init(RUDP_CC *cc)
+{
+    cc->cwnd = MAX_WINDOW_SIZE;
+    cc->ssthresh = MAX_WINDOW_SIZE;
+}
+
+static void cc_none_on_ack(RUDP_CC *cc, long now, long srtt)     {}
+static void cc_none_on_event(RUDP_CC *cc, long now)              {}
+
+/********************************************************/
+/* Congestion control "reno" (AIMD): slow start up to   */
+/* ssthresh, then one segment per RTT; halve the window */
+/* on loss and restart from one segment on timeout      */
+/********************************************************/
+static void cc_reno_init(RUDP_CC *cc)
+{
+    cc->cwnd = INITIAL_CWND;
+    cc->ssthresh = MAX_WINDOW_SIZE;
+}
+
+static void cc_reno_on_ack(RUDP_CC *cc, long now, long srtt)
+{
+    if (cc->cwnd < cc->ssthresh)    cc->cwnd += 1.0;                // Slow start: double every RTT
+    else                            cc->cwnd += 1.0 / cc->cwnd;     // Congestion avoidance: +1 segment every RTT
+    if (cc->cwnd > MAX_WINDOW_SIZE) cc->cwnd = MAX_WINDOW_SIZE;
+}
+
+static void cc_reno_on_loss(RUDP_CC *cc, long now)
+{
+    cc->ssthresh = (cc->cwnd / 2 > 2) ? cc->cwnd / 2 : 2;
+    cc->cwnd = cc->ssthresh;
+}
+
+static void cc_reno_on_timeout(RUDP_CC *cc, long now)
+{
+    cc->ssthresh = (cc->cwnd / 2 > 2) ? cc->cwnd / 2 : 2;
+    cc->cwnd = 1;
+}
+
+/********************************************************/
+/* Congestion control "cubic" (RFC 8312): after a loss  */
+/* the window follows W(t) = C(t - K)^3 + Wmax, never   */
+/* growing slower than an equivalent Reno flow          */
+/********************************************************/
+#define CUBIC_C 0.4             // CUBIC scaling constant
+#define CUBIC_BETA 0.7          // CUBIC multiplicative decrease factor
+
+static void cc_cubic_init(RUDP_CC *cc)
+{
+    cc->cwnd = INITIAL_CWND;
+    cc->ssthresh = MAX_WINDOW_SIZE;
+    cc->wMax = cc->wLastMax = cc->k = cc->wEst = 0;
+    cc->epochStart = 0;
+}
+
+static void cc_cubic_on_ack(RUDP_CC *cc, long now, long srtt)
+{
+    if (cc->cwnd < cc->ssthresh)
+    {
+        cc->cwnd += 1.0;                                        // Slow start as Reno
+    }
+    else
+    {
+        // Start a new growth epoch on the first ACK after a reduction
+        if (cc->epochStart == 0)
+        {
+            cc->epochStart = now;
+            cc->k = (cc->cwnd < cc->wMax) ? cbrt((cc->wMax - cc->cwnd) / CUBIC_C) : 0;
+            if (cc->cwnd > cc->wMax)    cc->wMax = cc->cwnd;
+            cc->wEst = cc->cwnd;
+        }
+
+        double t = (now - cc->epochStart + srtt) / 1000000.0;      // Seconds since the epoch, one RTT ahead
+        double target = CUBIC_C * (t - cc->k) * (t - cc->k) * (t - cc->k) + cc->wMax;
+
+        if (target > cc->cwnd)      cc->cwnd += (target - cc->cwnd) / cc->cwnd;
+        else                        cc->cwnd += 0.01 / cc->cwnd;
+
+        // TCP-friendly region: grow at least as fast as Reno would
+        cc->wEst += 3.0 * (1.0 - CUBIC_BETA) / (1.0 + CUBIC_BETA) / cc->cwnd;
+        if (cc->wEst > cc->cwnd)    cc->cwnd = cc->wEst;
+    }
+    if (cc->cwnd > MAX_WINDOW_SIZE) cc->cwnd = MAX_WINDOW_SIZE;
+}
+
+static void cc_cubic_on_loss(RUDP_CC *cc, long now)
+{
+    // Fast convergence: release bandwidth when the flow keeps losing below its previous maximum
+    if (cc->cwnd < cc->wLastMax)    cc->wMax = cc->cwnd * (1.0 + CUBIC_BETA) / 2.0;
+    else                            cc->wMax = cc->cwnd;
+    cc->wLastMax = cc->cwnd;
+
+    cc->cwnd *= CUBIC_BETA;
+    if (cc->cwnd < 2)               cc->cwnd = 2;
+    cc->ssthresh = cc->cwnd;
+    cc->epochStart = 0;
+}
+
+static void cc_cubic_on_timeout(RUDP_CC *cc, long now)
+{
+    cc_cubic_on_loss(cc, now);
+    cc->cwnd = 1;
+}
+
+// Table of the available congestion-control algorithms (the first one is the default)
+static const RUDP_CC_Ops rudp_cc_algorithms[] = {
+    {"none",  cc_none_init,  cc_none_on_ack,  cc_none_on_event,  cc_none_on_event},
+    {"reno",  cc_reno_init,  cc_reno_on_ack,  cc_reno_on_loss,   cc_reno_on_timeout},
+    {"cubic", cc_cubic_init, cc_cubic_on_ack, cc_cubic_on_loss,  cc_cubic_on_timeout},
+};
+
+/********************************************************/
+/* Select the connection's congestion-control algorithm */
+/* by name. Returns 0 on success, -1 if it is unknown   */
+/********************************************************/
+int rudp_set_congestion_control(RUDP_Connection *conn, const char *algo)
+{
+    for (size_t i = 0; i < sizeof(rudp_cc_algorithms) / sizeof(rudp_cc_algorithms[0]); i++)
+    {
+        if (strcmp(rudp_cc_algorithms[i].name, algo) == 0)
+        {
+            memset(&conn->cc, 0, sizeof(conn->cc));
+            conn->cc.ops = &rudp_cc_algorithms[i];
+            conn->cc.ops->init(&conn->cc);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**       Functions exclusively used by Receiver       **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+/********************************************************/
+/* Create a run's output file, preallocated to the      */
+/* expected size and mapped shared, so segments can be  */
+/* placed at their offsets in any order                 */
+/********************************************************/
+int rudp_output_open(RUDP_Output *out, const char *filename, size_t expected_size)
+{
+    memset(out, 0, sizeof(*out));
+    out->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out->fd < 0)
+    {
+        perror("open(2)");
+        return -1;
+    }
+    out->map = MAP_FAILED;
+    if (rudp_output_reserve(out, expected_size > 0 ? expected_size : MAX_SEGMENT_SIZE) < 0)
+    {
+        rudp_output_close(out);
+        return -1;
+    }
+    return 0;
+}
+
+/********************************************************/
+/* Grow the output file and its mapping to at least     */
+/* "size" bytes (doubling, to keep remaps rare)         */
+/********************************************************/
+int rudp_output_reserve(RUDP_Output *out, size_t size)
+{
+    if (size <= out->mapped)
+        return 0;
+
+    size_t newSize = out->mapped * 2;
+    if (newSize < size)     newSize = size;
+
+    // Reserve the blocks up front; fall back to a sparse file where fallocate(2) is unsupported
+    if (fallocate(out->fd, 0, 0, newSize) < 0 && ftruncate(out->fd, newSize) < 0)
+    {
+        perror("fallocate(2)");
+        return -1;
+    }
+
+    char *map = (out->map == MAP_FAILED) ? mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, out->fd, 0)
+                                         : mremap(out->map, out->mapped, newSize, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED)
+    {
+        perror("mmap(2)");
+        return -1;
+    }
+    out->map = map;
+    out->mapped = newSize;
+    return 0;
+}
+
+/********************************************************/
+/* Place "length" bytes at "offset" of the output file; */
+/* an empty write (the digest-only final segment, which */
+/* may start past the end of the run) leaves it as is   */
+/********************************************************/
+int rudp_output_write(RUDP_Output *out, size_t offset, const void *data, size_t length)
+{
+    if (length == 0)
+        return 0;
+    if (rudp_output_reserve(out, offset + length) < 0)
+        return -1;
+    memcpy(out->map + offset, data, length);
+    if (offset + length > out->size)
+        out->size = offset + length;
+    return 0;
+}
+
+/********************************************************/
+/* Unmap the output file and trim the preallocation to  */
+/* the furthest byte written                            */
+/********************************************************/
+int rudp_output_close(RUDP_Output *out)
+{
+    int result = 0;
+    if (out->map != MAP_FAILED && out->map != NULL)
+        munmap(out->map, out->mapped);
+    if (out->fd >= 0)
+    {
+        if (ftruncate(out->fd, out->size) < 0)
+        {
+            perror("ftruncate(2)");
+            result = -1;
         }
+        close(out->fd);
+    }
+    memset(out, 0, sizeof(*out));
+    out->fd = -1;
+    return result;
+}
+
+/********************************************************/
+/* Allocate an empty connection table with at least     */
+/* "buckets" chains (rounded up to a power of two)      */
+/* Returns 0 on success, -1 if allocation failed        */
+/********************************************************/
+int rudp_peer_table_init(RUDP_Peer_Table *table, int buckets)
+{
+    memset(table, 0, sizeof(*table));
+    table->bucketCount = 1;
+    while (table->bucketCount < buckets)
+        table->bucketCount *= 2;
+    table->buckets = calloc(table->bucketCount, sizeof(RUDP_Peer *));
+    return table->buckets ? 0 : -1;
+}
+
+/********************************************************/
+/* Drop every connection left in the table (closing     */
+/* unfinished runs) and release the table               */
+/********************************************************/
+void rudp_peer_table_free(RUDP_Peer_Table *table)
+{
+    for (int i = 0; table->buckets && i < table->bucketCount; i++)
+    {
+        while (table->buckets[i])
+            rudp_peer_remove(table, table->buckets[i]);
+    }
+    free(table->buckets);
+    memset(table, 0, sizeof(*table));
+}
+
+/********************************************************/
+/* Bucket of a connection ID (multiplicative hashing,   */
+/* in case an ID is not random)                         */
+/********************************************************/
+static RUDP_Peer **rudp_peer_bucket(RUDP_Peer_Table *table, uint32_t id)
+{
+    return &table->buckets[((id * 2654435761u) >> 8) & (table->bucketCount - 1)];
+}
+
+/********************************************************/
+/* Find a connection by its ID (NULL if unknown)        */
+/********************************************************/
+RUDP_Peer *rudp_peer_lookup(RUDP_Peer_Table *table, uint32_t id)
+{
+    for (RUDP_Peer *peer = *rudp_peer_bucket(table, id); peer != NULL; peer = peer->next)
+    {
+        if (peer->id == id)
+            return peer;
     }
+    return NULL;
+}
+
+/********************************************************/
+/* Add a connection in its initial state (no run open,  */
+/* segment numbers starting at 1). Returns the new      */
+/* entry, or NULL if allocation failed                  */
+/********************************************************/
+RUDP_Peer *rudp_peer_add(RUDP_Peer_Table *table, uint32_t id, const struct sockaddr_in *addr)
+{
+    RUDP_Peer *peer = calloc(1, sizeof(RUDP_Peer));
+    if (peer == NULL)
+        return NULL;
+    peer->id = id;
+    peer->addr = *addr;
+    peer->nextSegment = 1;
+    peer->runFirstSegment = 1;
+    peer->output.fd = -1;
+    peer->lastActivity = rudp_now_us();
+
+    RUDP_Peer **bucket = rudp_peer_bucket(table, id);
+    peer->next = *bucket;
+    *bucket = peer;
+    table->count++;
+    return peer;
+}
 
-    // Check for any remaining bytes in either file
-    if (!feof(fp1) || !feof(fp2)) {
-        isIdentical = 0;                    // Files are not identical
+/********************************************************/
+/* Remove a connection from the table, closing its run  */
+/* file if one is still open, and free it               */
+/********************************************************/
+void rudp_peer_remove(RUDP_Peer_Table *table, RUDP_Peer *peer)
+{
+    for (RUDP_Peer **link = rudp_peer_bucket(table, peer->id); *link != NULL; link = &(*link)->next)
+    {
+        if (*link == peer)
+        {
+            *link = peer->next;
+            table->count--;
+            break;
+        }
     }
+    rudp_output_close(&peer->output);
+    free(peer);
+}
 
-    fclose(fp1);
-    fclose(fp2);
+/********************************************************/
+/* Steer the datagrams of a SO_REUSEPORT group by their */
+/* connection ID: a classic BPF program returns the ID  */
+/* modulo "workers", the index of the group's socket    */
+/* that receives the datagram (sockets are indexed in   */
+/* bind order). All packets of a connection thus reach  */
+/* the same worker, which alone holds its state         */
+/********************************************************/
+int rudp_reuseport_steer(int sock, int workers)
+{
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, WIRE_CONNECTION_ID),     // The program sees the UDP payload: the RUDP header (loads are big-endian)
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, workers),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_fprog program = {.len = sizeof(code) / sizeof(code[0]), .filter = code};
+
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0)
+    {
+        perror("setsockopt: SO_ATTACH_REUSEPORT_CBPF");
+        return -1;
+    }
+    return 0;
+}
 
-    return isIdentical;
-}
\ No newline at end of file
+/********************************************************/
+/* This function saves the transmitted data to file     */
+/********************************************************/
+void save_data_as_txt(const char *data, int size, int run_number)
+{
+    char filename[50];
+    sprintf(filename, "Received_Data_Run_%d.txt", run_number);
+    FILE *file = fopen(filename, "a");
+    if (!file)
+    {
+        perror("Failed to open file");
+        return;
+    }
+    fwrite(data, 1, size, file);
+    fclose(file);
+    log_info("Data from Run %d saved to %s\n", run_number, filename);
+}
@@ -3,53 +3,283 @@
 
 #include <stdint.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "RUDP_Checksum.h"
+#include "IO_Uring.h"
+#include "Digest.h"
+#include "Pipeline.h"
+#include "Histogram.h"
+#include "Timing.h"
+#include "Log.h"
+#include "Metrics.h"
 
 #define SERVER_IP "127.0.0.1" // Default RUDP's receiver IP address to connect to (overridden by command-line arguments)
 #define SERVER_PORT 12345     // Default RUDP's receiver port  to connect to (overridden by command-line arguments)
 #define BUFFER_SIZE 2097152   // Default size receiver's buffer (2MB in bytes)  2097152
 #define DATA_SIZE 2097152     // Default size of the data packet sent by the sender (2MB in bytes)
 #define MAX_SEGMENT_SIZE 1460 // Adjust based on your header size to fit within UDP payload limits
-#define MAX_CLIENTS 1         // Maximum senders to handle parallelly by RUDP receiver
+#define MAX_CLIENTS 64        // Buckets of each connection table of the RUDP receiver (senders handled in parallel)
 #define MAX_ATTEMPTS 1000     // Maximum attempts to send a packet
 #define MAX_RUNS 100          // Maximum number of processing requests one after the other
-#define TIMEOUT 10            // The maximum wait time for recvfrom(2) call until the sender drops
+#define MAX_WINDOW_SIZE 256   // Maximum number of unacknowledged segments in flight (size of the receiver's reorder window)
+#define DEFAULT_WINDOW_SIZE 1 // Default sender window (1 = STOP-and-WAIT)
+#define DEFAULT_BATCH_SIZE 32 // Default datagrams per sendmmsg(2)/recvmmsg(2) call
+#define MAX_BATCH_SIZE 256    // Maximum datagrams per sendmmsg(2)/recvmmsg(2) call
+#define INITIAL_CWND 10       // Initial congestion window in segments (as TCP's IW10)
+#define DUP_ACK_THRESHOLD 3   // Later segments ACKed before an unACKed one is declared lost (fast retransmit)
+#define TIMEOUT 10            // Upper bound (seconds) for the adaptive retransmission timeout
+#define INITIAL_RTO_US 1000000 // Retransmission timeout (us) before the first RTT sample is taken
+#define MIN_RTO_US 1000       // Lower bound (us) for the retransmission timeout
+#define MAX_CONTROL_ATTEMPTS 10 // Maximum attempts to send a SYN or FIN packet
 #define SYN 0x01              // Flag for SYN packets used in handshakes
 #define ACK 0x02              // Flag for ACK packets for acknowledgments
 #define FIN 0x04              // Flag for FIN packets to close connection
 #define DATA 0x08             // flag for data packets
 #define LAST_PACKET 0x10      // Flag to indicate the last packet of a run
+#define CRC32C_MODE 0x20      // Flag on SYN (request), SYN-ACK (accept) and every later packet protected by CRC32C
 
 
-// RUDP Packet Header struct
+#define RUDP_VERSION 1        // Version of the wire header (first byte of every packet)
+#define RUDP_HEADER_SIZE 16   // Bytes of the wire header
+#define RUDP_MAX_OFFSET ((1ULL << 48) - 1)  // Largest offset the wire header holds (256 TiB of sequence space)
+#define RUDP_MAX_LENGTH 0xFFFF              // Largest payload length the wire header holds (any UDP payload fits)
+
+/*
+ * Wire header, 16 bytes in network byte order, written by rudp_header_encode()
+ * and read by rudp_header_decode() - never through a C struct laid over the
+ * buffer:
+ *
+ *   0       1       2       4               8                           14      16
+ *   +-------+-------+-------+---------------+---------------------------+-------+
+ *   |version| flags |checksm| connection ID |   offset (48 bits)        |length |
+ *   +-------+-------+-------+---------------+---------------------------+-------+
+ *
+ * The offset is the byte position of the payload in the connection's sequence
+ * space: segment n of the connection starts at n * MAX_SEGMENT_SIZE (segments
+ * are numbered from 1 across runs, and a run starts on a segment boundary), so
+ * transfers of any size up to RUDP_MAX_OFFSET are addressed without wrapping.
+ * ACKs echo the offset of the segment they acknowledge
+ */
 typedef struct {
-    int segmentSize;                    // Size of the current segment
-    int segmentNumber;                  // Segment number for ordering
-    unsigned short int totalSize;       // Total data size, if needed
-    unsigned short int checksum;        // Checksum for error checking
-    char flags;                         // Flags to indicate SYN, ACK, FIN, DATA, and LAST_PACKET
-    char __padding[3];
+    uint64_t offset;                    // Byte offset of the payload in the connection's sequence space
+    uint32_t length;                    // Payload bytes after the header (LAST_PACKET's digest included)
+    uint32_t connectionId;              // Chosen by the Sender and echoed by the Receiver (key of its connection table)
+    uint16_t checksum;                  // Checksum of the packet, its own field excluded
+    uint8_t flags;                      // Flags to indicate SYN, ACK, FIN, DATA, LAST_PACKET and CRC32C_MODE
+    uint8_t version;                    // RUDP_VERSION (set by rudp_header_encode)
 } RUDP_Header;
 
+#define RUDP_SEGMENT_OFFSET(segment) ((uint64_t)(segment) * MAX_SEGMENT_SIZE)   // Offset of a segment's payload
+#define RUDP_OFFSET_SEGMENT(offset) ((long)((offset) / MAX_SEGMENT_SIZE))      // Segment number of an offset
+
+// Round-trip time estimator driving the retransmission timeout (RFC 6298)
+typedef struct {
+    long srtt;                          // Smoothed RTT in microseconds (0 until the first sample)
+    long rttvar;                        // RTT variance in microseconds
+    long rto;                           // Current retransmission timeout in microseconds, including backoff
+    long samples;                       // Number of RTT samples taken
+    long backoffs;                      // Number of times the RTO was doubled after a timeout
+} RUDP_RTT;
+
+#define MAX_PACKET_SIZE (RUDP_HEADER_SIZE + MAX_SEGMENT_SIZE)     // Largest RUDP datagram
+#define SKB_OVERHEAD 2        // Kernel memory charged per datagram against the socket buffers, relative to its size
+#define SOCKET_BUFFER_SIZE (MAX_WINDOW_SIZE * MAX_PACKET_SIZE * SKB_OVERHEAD)   // Socket buffers asked for: a full window of datagrams
+#define PIPE_SLOT_SEGMENTS 128 // Segments per ring slot of a pipelined run (a whole window spans at most 3 slots)
+#define PIPE_SLOT_SIZE (PIPE_SLOT_SEGMENTS * MAX_SEGMENT_SIZE)
+#define PIPE_SLOTS 8          // Ring slots of a pipelined run (a power of two)
+
+#define GSO_MAX_SEGMENTS 44   // Segments per UDP_SEGMENT send (44 * MAX_PACKET_SIZE fits a 64KB UDP datagram)
+#define GRO_BUFFER_SIZE 65536 // Receive buffer for one UDP_GRO coalesced datagram
+#define CONTROL_SIZE (CMSG_SPACE(sizeof(int)) + CMSG_SPACE(3 * sizeof(struct timespec)))   // Control messages of one slot (UDP_GRO size and SO_TIMESTAMPING stamps)
+#define URING_ENTRIES 1024    // Submission queue of the io_uring engine (sends, ACKs and posted receives of full batches)
+#define MAX_WORKERS 64        // Maximum receiver worker threads (one SO_REUSEPORT socket each)
+#define IDLE_TICK_US 100000   // Longest a receiver worker waits for data before checking for shutdown and idle connections
+
+// Datagram batch moved by a single sendmmsg(2) or recvmmsg(2) call
+typedef struct {
+    int capacity;                       // Maximum datagrams per call
+    int count;                          // Datagrams currently held in the batch
+    int next;                           // Next received datagram to hand out
+    int offset;                         // Read offset of the next segment inside a coalesced (GRO) datagram
+    size_t slotSize;                    // Bytes per buffer slot (MAX_PACKET_SIZE, or GRO_BUFFER_SIZE with GRO)
+    int gsoSize;                        // GSO: datagram size the kernel slices coalesced sends into (0 = off)
+    int gro;                            // GRO: set when received datagrams may hold several segments
+    int timestamps;                     // Set when the kernel stamps every received datagram (SO_TIMESTAMPING)
+    uint64_t arrival;                   // Receive: arrival (timing_now_ns clock) of the packet handed out last
+    char *buffers;                      // capacity packet buffers of slotSize bytes each
+    char *control;                      // One control-message buffer per slot (UDP_SEGMENT / UDP_GRO / SO_TIMESTAMPING)
+    struct mmsghdr *msgs;               // One message header per datagram
+    struct iovec *iovs;                 // Two I/O vectors per datagram: its slot and an optional external payload
+    struct sockaddr_in *addrs;          // Destination or source address of every datagram
+    struct mmsghdr *gsoMsgs;            // GSO: one message header per coalesced send
+    IO_Uring *ring;                     // io_uring engine moving the batch (NULL: sendmmsg(2)/recvmmsg(2))
+    int *order;                         // io_uring: slots of the received datagrams, in completion order
+    char *posted;                       // io_uring: set for every slot with a receive posted
+    int pending;                        // io_uring: sends submitted whose completion was not reaped yet
+    int failed;                         // io_uring: set when a send of the batch failed
+    long timeoutUs;                     // Receive: longest wait for data in microseconds (0 = wait forever)
+} RUDP_Batch;
+
+// Data-path system call counters
+typedef struct {
+    long sendCalls;                     // sendto(2)/sendmmsg(2) calls
+    long recvCalls;                     // recvfrom(2)/recvmmsg(2) calls
+    long pollCalls;                     // select(2) calls
+    long ringCalls;                     // io_uring_enter(2) calls (sends, receives and waits together)
+    long datagramsSent;                 // Datagrams handed to the kernel
+    long datagramsReceived;             // Datagrams read from the kernel
+    long checksumFailures;              // Datagrams dropped by the integrity check
+} RUDP_IO_Stats;
+
+struct RUDP_CC;
+
+// Congestion-control algorithm plugged into the sliding window (selected by name, as TCP_CONGESTION)
+typedef struct {
+    const char *name;                                           // Algorithm name given to -algo
+    void (*init)(struct RUDP_CC *cc);                           // Reset the algorithm's state
+    void (*on_ack)(struct RUDP_CC *cc, long now, long srtt);    // A new segment was acknowledged
+    void (*on_loss)(struct RUDP_CC *cc, long now);              // A loss was detected by later ACKs (once per window)
+    void (*on_timeout)(struct RUDP_CC *cc, long now);           // A retransmission timeout fired
+} RUDP_CC_Ops;
+
+// Congestion-control state of a connection
+typedef struct RUDP_CC {
+    const RUDP_CC_Ops *ops;             // The selected algorithm
+    double cwnd;                        // Congestion window in segments
+    double ssthresh;                    // Slow-start threshold in segments
+    double wMax;                        // CUBIC: window just before the last reduction
+    double wLastMax;                    // CUBIC: previous wMax (fast convergence)
+    double k;                           // CUBIC: time (s) the cubic takes to grow back to wMax
+    double wEst;                        // CUBIC: Reno-friendly window estimate
+    long epochStart;                    // CUBIC: start (us) of the current growth epoch, 0 if none
+    long recoveryPoint;                 // Losses below this segment belong to an already handled loss event
+    long lossEvents;                    // Window reductions after fast retransmit
+    long timeouts;                      // Window reductions after a retransmission timeout
+} RUDP_CC;
+
+// RUDP connection state kept by the Sender across runs
+typedef struct {
+    int sock;                           // The RUDP socket
+    struct sockaddr_in peer;            // The Receiver's address
+    RUDP_RTT rtt;                       // RTT estimator shared by the handshake, data and FIN exchanges
+    RUDP_CC cc;                         // Congestion control limiting the sliding window
+    RUDP_Batch sendBatch;               // Data segments waiting for one sendmmsg(2)
+    RUDP_Batch recvBatch;               // ACKs read by one recvmmsg(2)
+    RUDP_IO_Stats io;                   // System calls spent on the connection
+    IO_Uring ring;                      // io_uring engine of both batches (fd -1 when blocking calls are used)
+    uint32_t id;                        // Connection ID carried by every packet
+    int windowSize;                     // Maximum number of unacknowledged segments in flight
+    int checksumMode;                   // Integrity check requested, then agreed on by the handshake (CHECKSUM_*)
+    long nextSegment;                   // Next segment number to assign (continues across runs)
+    uint64_t runDigest;                 // Digest of the current run's segments transmitted so far (sent in LAST_PACKET)
+    Ring *sendRing;                     // Producer's ring the current run is read from (NULL: the run is in memory)
+    long segmentsSent;                  // Data segments transmitted for the first time
+    long retransmissions;               // Data segments transmitted again (timeout or fast retransmit)
+    Histogram rttSamples;               // Send-to-ACK time of the current run's segments sent once (ns)
+    Histogram inflatedSamples;          // First-send-to-ACK time of the current run's retransmitted segments (ns)
+    Metrics_Block *metrics;             // Live counters of the connection (-metrics)
+} RUDP_Connection;
+
+// Receive-window slot of a segment already placed in the output file ahead of the in-order frontier
+typedef struct {
+    int length;                         // Payload length in bytes
+    char flags;                         // The segment's flags (DATA or LAST_PACKET)
+    char present;                       // Set while the segment is placed but not yet in order
+} RUDP_Slot;
+
+// Receiver's output file, written by byte offset through a shared mapping
+typedef struct {
+    int fd;                             // The output file (-1 when closed)
+    char *map;                          // Shared mapping of the file
+    size_t mapped;                      // Bytes preallocated and mapped
+    size_t size;                        // End of the furthest byte written (the final file size)
+} RUDP_Output;
+
+// Receiver's state of one connection: an entry of the connection table
+typedef struct RUDP_Peer {
+    uint32_t id;                        // Connection ID chosen by the Sender
+    int number;                         // Connection number on the Receiver, in handshake order
+    struct sockaddr_in addr;            // The Sender's address
+    int checksumMode;                   // Integrity check agreed on by the handshake (CHECKSUM_*)
+    int handshakeCompleted;             // Set once the handshake's final ACK arrived
+    RUDP_Slot window[MAX_WINDOW_SIZE];  // Segments placed ahead of a gap until the gap is filled
+    long nextSegment;                   // Next in-order segment to write (continues across runs)
+    long runFirstSegment;               // Number of the current run's first segment
+    long runData;                       // Bytes of the current run in order so far
+    uint64_t runDigest;                 // Digest of the current run's segments placed so far
+    uint64_t sentDigest;                // The run digest carried by the Sender's LAST_PACKET
+    uint64_t runStart;                  // Arrival (ns) of the current run's first segment
+    RUDP_Output output;                 // The current run's file, written by segment offset
+    int runs;                           // Runs completed
+    double runTimes[MAX_RUNS];          // Duration (ms) of every completed run
+    double runSpeeds[MAX_RUNS];         // Throughput of every completed run
+    long totalData;                     // Bytes received across all runs
+    Histogram arrivalGaps;              // Time between consecutive data segments of a run, across all runs (ns)
+    uint64_t lastArrival;               // Arrival time (ns) of the current run's latest data segment (0: none yet)
+    long lastActivity;                  // Arrival time (us) of the connection's latest packet
+    struct RUDP_Peer *next;             // Next entry of the same bucket
+} RUDP_Peer;
+
+// Receiver's connection table: a hash of the connections keyed by connection ID
+typedef struct {
+    RUDP_Peer **buckets;                // Chains of entries
+    int bucketCount;                    // Number of buckets (a power of two)
+    int count;                          // Connections in the table
+} RUDP_Peer_Table;
+
 // Functions for RUDP operations
 int rudp_socket(int domain, int type, int protocol);
-int rudp_connect(int sock, const struct sockaddr_in *server_addr);
-int rudp_send(int socket, RUDP_Header *packet, size_t packet_size, const struct sockaddr_in *dest_addr);
-void rudp_send_synack(int socket, const struct sockaddr *src_addr);
-void rudp_sendack(int socket, const struct sockaddr_in *addr, int packet_type, int run);
+int rudp_socket_window(int sock);
+int rudp_connect(RUDP_Connection *conn);
+int rudp_send(RUDP_Connection *conn, void *packet, size_t packet_size);
+void rudp_send_synack(int socket, const struct sockaddr *src_addr, uint32_t connection_id, char crc32c);
+void rudp_sendack(int socket, const struct sockaddr_in *addr, uint32_t connection_id, char crc32c, int packet_type, int run, uint64_t offset);
 int rudp_recv(int socket, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen, int run);
-int rudp_close(int socket, const struct sockaddr_in *server_addr, int isSender);
-unsigned short int rudp_compute_checksum(void *data, unsigned int bytes);
+void rudp_queue_ack(int socket, RUDP_Batch *acks, const struct sockaddr_in *addr, const RUDP_Header *segment, RUDP_IO_Stats *io);
+int rudp_recv_batched(int socket, RUDP_Batch *batch, RUDP_Batch *acks, void **packet, RUDP_Header *header, struct sockaddr_in *src_addr, int run, RUDP_IO_Stats *io);
+int rudp_batch_init(RUDP_Batch *batch, int capacity);
+void rudp_batch_free(RUDP_Batch *batch);
+int rudp_batch_flush(int socket, RUDP_Batch *batch, RUDP_IO_Stats *io);
+int rudp_batch_enable_gso(RUDP_Batch *batch, int segment_size);
+int rudp_batch_enable_gro(int socket, RUDP_Batch *batch);
+int rudp_batch_enable_timestamps(int socket, RUDP_Batch *batch);
+int rudp_batch_enable_uring(RUDP_Batch *batch, IO_Uring *ring);
+int rudp_batch_set_timeout(int socket, RUDP_Batch *batch, long timeout_us);
+int rudp_close(RUDP_Connection *conn, int isSender);
+void rudp_header_encode(void *wire, const RUDP_Header *header);
+void rudp_header_decode(const void *wire, RUDP_Header *header);
+unsigned short int rudp_packet_checksum(const void *packet, unsigned int bytes);
+unsigned short int rudp_segment_checksum(const void *header, unsigned int header_size, const void *payload, unsigned int payload_size);
+void rudp_packet_seal(void *header, unsigned int header_size, const void *payload, unsigned int payload_size);
+long rudp_now_us(void);
+void rudp_rtt_init(RUDP_RTT *rtt);
+void rudp_rtt_sample(RUDP_RTT *rtt, long sample);
+void rudp_rtt_backoff(RUDP_RTT *rtt);
 
 // Sender's unique functions declarations
-void util_generate_random_data_file(const char* filename, unsigned int size);
+int rudp_connection_init(RUDP_Connection *conn, int sock, const struct sockaddr_in *peer, int window_size);
+int rudp_send_run(RUDP_Connection *conn, const char *data, size_t size);
+int rudp_send_run_ring(RUDP_Connection *conn, Ring *ring, size_t size);
+int rudp_set_congestion_control(RUDP_Connection *conn, const char *algo);
+int rudp_set_batch_size(RUDP_Connection *conn, int batch_size);
+int rudp_set_gso(RUDP_Connection *conn);
+int rudp_set_uring(RUDP_Connection *conn);
+void rudp_set_checksum_mode(RUDP_Connection *conn, int mode);
 
 // Receiver's unique functions declarations
-long time_diff(struct timeval start, struct timeval end);
 void save_data_as_txt(const char *data, int size, int run_number);
-void print_statistics(double *run_times, double *run_speeds, int runs, int total_data);
-
-// Auxiliary functions declarations
-int compare_files(const char *file1, const char *file2);
-void print_time(const char *format, ...);
+int rudp_output_open(RUDP_Output *out, const char *filename, size_t expected_size);
+int rudp_output_reserve(RUDP_Output *out, size_t size);
+int rudp_output_write(RUDP_Output *out, size_t offset, const void *data, size_t length);
+int rudp_output_close(RUDP_Output *out);
+int rudp_peer_table_init(RUDP_Peer_Table *table, int buckets);
+void rudp_peer_table_free(RUDP_Peer_Table *table);
+RUDP_Peer *rudp_peer_lookup(RUDP_Peer_Table *table, uint32_t id);
+RUDP_Peer *rudp_peer_add(RUDP_Peer_Table *table, uint32_t id, const struct sockaddr_in *addr);
+void rudp_peer_remove(RUDP_Peer_Table *table, RUDP_Peer *peer);
+int rudp_reuseport_steer(int sock, int workers);
+void print_statistics(double *run_times, double *run_speeds, int runs, long total_data, const char *samples_name, const Histogram *samples, const Histogram *inflated);
+void print_io_statistics(const RUDP_IO_Stats *io, long total_data);
 
 #endif
\ No newline at end of file
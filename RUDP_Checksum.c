@@ -0,0 +1,285 @@
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>      // For the SSE2, AVX2 and SSE4.2 intrinsics
+#define RUDP_X86 1
+#endif
+#include "RUDP_Checksum.h"
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                 Internet checksum                  **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+/********************************************************/
+/* Fold a 32-bit sum of 16-bit words into the final     */
+/* one's complement checksum. Every kernel accumulates  */
+/* the words modulo 2^32, so all of them reach the same */
+/* sum regardless of the order they add the words in    */
+/********************************************************/
+unsigned short int rudp_checksum_fold(uint32_t total_sum)
+{
+    // Fold 32-bit sum to 16 bits: add carry to the result itself
+    while (total_sum >> 16)
+        total_sum = (total_sum & 0xFFFF) + (total_sum >> 16);   // Keep folding until sum is reduced to 16 bits
+
+    return (~((unsigned short int)total_sum));
+}
+
+/********************************************************/
+/* Sum the trailing words (and a left-over byte) that   */
+/* do not fill a whole vector                           */
+/********************************************************/
+static uint32_t rudp_checksum_tail(const unsigned char *data, unsigned int bytes, uint32_t total_sum)
+{
+    // Main loop: Sum 16-bit words together, handling overflow by wrapping around
+    while (bytes > 1)
+    {
+        uint16_t word;
+        memcpy(&word, data, sizeof(word));      // The buffer may be unaligned
+        total_sum += word;
+        data += 2;
+        bytes -= 2;
+    }
+
+    // If there is a left-over byte, add it to the sum
+    if (bytes > 0)
+        total_sum += *data;
+
+    return total_sum;
+}
+
+/********************************************************/
+/* Portable kernel: one 16-bit word per iteration       */
+/********************************************************/
+static uint32_t rudp_sum_scalar(const void *data, unsigned int bytes)
+{
+    return rudp_checksum_tail(data, bytes, 0);
+}
+
+#ifdef RUDP_X86
+/********************************************************/
+/* SSE2 kernel: widens eight words per 16-byte load to  */
+/* 32-bit lanes and adds them in four accumulators      */
+/********************************************************/
+__attribute__((target("sse2")))
+static uint32_t rudp_sum_sse2(const void *data, unsigned int bytes)
+{
+    const unsigned char *p = data;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128();
+
+    for (; bytes >= 16; p += 16, bytes -= 16)
+    {
+        __m128i words = _mm_loadu_si128((const __m128i *)p);
+        sum = _mm_add_epi32(sum, _mm_unpacklo_epi16(words, zero));
+        sum = _mm_add_epi32(sum, _mm_unpackhi_epi16(words, zero));
+    }
+
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, sum);
+    uint32_t total_sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return rudp_checksum_tail(p, bytes, total_sum);
+}
+
+/********************************************************/
+/* AVX2 kernel: sixteen words per 32-byte load, with    */
+/* two independent accumulators to hide add latency     */
+/********************************************************/
+__attribute__((target("avx2")))
+static uint32_t rudp_sum_avx2(const void *data, unsigned int bytes)
+{
+    const unsigned char *p = data;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum0 = _mm256_setzero_si256();
+    __m256i sum1 = _mm256_setzero_si256();
+
+    for (; bytes >= 32; p += 32, bytes -= 32)
+    {
+        __m256i words = _mm256_loadu_si256((const __m256i *)p);
+        sum0 = _mm256_add_epi32(sum0, _mm256_unpacklo_epi16(words, zero));
+        sum1 = _mm256_add_epi32(sum1, _mm256_unpackhi_epi16(words, zero));
+    }
+
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi32(sum0, sum1));
+    uint32_t total_sum = 0;
+    for (int i = 0; i < 8; i++)
+        total_sum += lanes[i];
+    return rudp_checksum_tail(p, bytes, total_sum);
+}
+#else
+static uint32_t rudp_sum_sse2(const void *data, unsigned int bytes)   { return rudp_sum_scalar(data, bytes); }
+static uint32_t rudp_sum_avx2(const void *data, unsigned int bytes)   { return rudp_sum_scalar(data, bytes); }
+#endif
+
+unsigned short int rudp_checksum_scalar(const void *data, unsigned int bytes)   { return rudp_checksum_fold(rudp_sum_scalar(data, bytes)); }
+unsigned short int rudp_checksum_sse2(const void *data, unsigned int bytes)     { return rudp_checksum_fold(rudp_sum_sse2(data, bytes)); }
+unsigned short int rudp_checksum_avx2(const void *data, unsigned int bytes)     { return rudp_checksum_fold(rudp_sum_avx2(data, bytes)); }
+
+typedef uint32_t (*Checksum_Kernel)(const void *data, unsigned int bytes);
+static Checksum_Kernel checksum_kernel = NULL;       // Selected on the first call
+static const char *checksum_kernel_name = "scalar";
+
+/********************************************************/
+/* Pick the widest Internet checksum kernel the CPU     */
+/* supports                                             */
+/********************************************************/
+static void rudp_checksum_select(void)
+{
+    checksum_kernel = rudp_sum_scalar;
+#ifdef RUDP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        checksum_kernel = rudp_sum_avx2;
+        checksum_kernel_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        checksum_kernel = rudp_sum_sse2;
+        checksum_kernel_name = "sse2";
+    }
+#endif
+}
+
+/********************************************************/
+/* Computes the checksum for a given block of data      */
+/********************************************************/
+unsigned short int rudp_compute_checksum(void *data, unsigned int bytes)
+{
+    return rudp_checksum_fold(rudp_checksum_add(0, data, bytes));
+}
+
+/********************************************************/
+/* Add a block to a running 32-bit sum, so a packet in  */
+/* several pieces (e.g. header + payload) is summed in  */
+/* place; all pieces but the last must have even length */
+/********************************************************/
+uint32_t rudp_checksum_add(uint32_t sum, const void *data, unsigned int bytes)
+{
+    if (checksum_kernel == NULL)
+        rudp_checksum_select();
+    return sum + checksum_kernel(data, bytes);
+}
+
+/********************************************************/
+/* Name of the Internet checksum kernel in use          */
+/********************************************************/
+const char *rudp_checksum_kernel(void)
+{
+    if (checksum_kernel == NULL)
+        rudp_checksum_select();
+    return checksum_kernel_name;
+}
+
+
+/********************************************************/
+/********************************************************/
+/**                                                    **/
+/**                       CRC32C                       **/
+/**                                                    **/
+/********************************************************/
+/********************************************************/
+
+#define CRC32C_POLY 0x82F63B78      // Reflected Castagnoli polynomial
+
+static uint32_t crc32c_table[256];  // Byte-at-a-time table for the software kernel
+static int crc32c_table_ready = 0;
+
+/********************************************************/
+/* Software kernel: one table lookup per byte. Like the  */
+/* other CRC32C functions it continues "crc", the CRC   */
+/* of the preceding data (0 for none)                   */
+/********************************************************/
+uint32_t rudp_crc32c_sw(uint32_t crc, const void *data, size_t bytes)
+{
+    const unsigned char *p = data;
+
+    if (!crc32c_table_ready)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+            crc32c_table[i] = crc;
+        }
+        crc32c_table_ready = 1;
+    }
+
+    crc = ~crc;
+    while (bytes--)
+        crc = crc32c_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+#if defined(__x86_64__)
+/********************************************************/
+/* Hardware kernel: the SSE4.2 crc32 instruction, eight */
+/* bytes at a time                                      */
+/********************************************************/
+__attribute__((target("sse4.2")))
+uint32_t rudp_crc32c_hw(uint32_t crc, const void *data, size_t bytes)
+{
+    const unsigned char *p = data;
+    uint64_t crc64 = ~crc;
+
+    for (; bytes >= 8; p += 8, bytes -= 8)
+    {
+        uint64_t chunk;
+        memcpy(&chunk, p, sizeof(chunk));
+        crc64 = _mm_crc32_u64(crc64, chunk);
+    }
+    while (bytes--)
+        crc64 = _mm_crc32_u8((uint32_t)crc64, *p++);
+    return ~(uint32_t)crc64;
+}
+#else
+uint32_t rudp_crc32c_hw(uint32_t crc, const void *data, size_t bytes)   { return rudp_crc32c_sw(crc, data, bytes); }
+#endif
+
+typedef uint32_t (*CRC32C_Kernel)(uint32_t crc, const void *data, size_t bytes);
+static CRC32C_Kernel crc32c_kernel = NULL;           // Selected on the first call
+static const char *crc32c_kernel_name = "table";
+
+/********************************************************/
+/* Use the crc32 instruction when the CPU has SSE4.2    */
+/********************************************************/
+static void rudp_crc32c_select(void)
+{
+    crc32c_kernel = rudp_crc32c_sw;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        crc32c_kernel = rudp_crc32c_hw;
+        crc32c_kernel_name = "sse4.2";
+    }
+#endif
+}
+
+/********************************************************/
+/* Computes the CRC32C of a given block of data,        */
+/* continuing "crc" (0 to start a new one)              */
+/********************************************************/
+uint32_t rudp_crc32c(uint32_t crc, const void *data, size_t bytes)
+{
+    if (crc32c_kernel == NULL)
+        rudp_crc32c_select();
+    return crc32c_kernel(crc, data, bytes);
+}
+
+/********************************************************/
+/* Name of the CRC32C kernel in use                     */
+/********************************************************/
+const char *rudp_crc32c_kernel(void)
+{
+    if (crc32c_kernel == NULL)
+        rudp_crc32c_select();
+    return crc32c_kernel_name;
+}
@@ -0,0 +1,31 @@
+#ifndef RUDP_CHECKSUM_H
+#define RUDP_CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHECKSUM_INTERNET 0   // 16-bit one's complement sum (the default integrity check)
+#define CHECKSUM_CRC32C 1     // CRC32C (Castagnoli), negotiated during the handshake
+
+
+// Internet checksum: the fastest kernel the CPU supports, selected on first use
+unsigned short int rudp_compute_checksum(void *data, unsigned int bytes);
+uint32_t rudp_checksum_add(uint32_t sum, const void *data, unsigned int bytes);
+unsigned short int rudp_checksum_fold(uint32_t sum);
+
+// Internet checksum kernels; all of them return identical results
+unsigned short int rudp_checksum_scalar(const void *data, unsigned int bytes);
+unsigned short int rudp_checksum_sse2(const void *data, unsigned int bytes);
+unsigned short int rudp_checksum_avx2(const void *data, unsigned int bytes);
+
+// CRC32C: the SSE4.2 crc32 instruction when present, a lookup table otherwise.
+// "crc" is the CRC32C of the preceding data, 0 to start a new one
+uint32_t rudp_crc32c(uint32_t crc, const void *data, size_t bytes);
+uint32_t rudp_crc32c_hw(uint32_t crc, const void *data, size_t bytes);
+uint32_t rudp_crc32c_sw(uint32_t crc, const void *data, size_t bytes);
+
+// Names of the kernels rudp_compute_checksum() and rudp_crc32c() dispatch to
+const char *rudp_checksum_kernel(void);
+const char *rudp_crc32c_kernel(void);
+
+#endif
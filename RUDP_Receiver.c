@@ -7,8 +7,43 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <time.h>
+#include <pthread.h>        // For the worker threads
+#include <endian.h>         // For the run digest in network byte order
 #include "RUDP_API.h"
-
+#include "Payload.h"
+#include "Bench.h"
+
+
+// A receiver worker: one SO_REUSEPORT socket with its own batches, ring and connection table
+typedef struct {
+    int index;                          // Worker number (the socket's index in the SO_REUSEPORT group)
+    int sock;                           // The worker's socket
+    pthread_t thread;                   // The worker's thread
+    RUDP_Batch recvBatch;               // Received packets (one recvmmsg(2))
+    RUDP_Batch ackBatch;                // Their ACKs (one sendmmsg(2)), or both in one io_uring_enter(2)
+    IO_Uring ring;                      // io_uring engine of both batches (fd -1 when blocking calls are used)
+    RUDP_IO_Stats io;                   // System calls spent by the worker
+    RUDP_Peer_Table peers;              // Connections steered to the worker
+    int connections;                    // Connections the worker closed
+    long totalData;                     // Bytes received on those connections
+    Metrics_Block *metrics;             // Live counters of the worker (-metrics)
+} Receiver_Worker;
+
+static int clients = 1;                 // Connections to close before exiting (0 = serve forever)
+static int connectionsOpened = 0;       // Numbers the connections in handshake order (shared by the workers)
+static int connectionsClosed = 0;       // Connections closed by all workers
+static int stopping = 0;                // Set once "clients" connections were closed
+static uint64_t verifySeed;             // The senders' payload seed (-seed), to verify runs without their files
+static int verifySeeded = 0;            // Set if -seed was given
+static Bench bench;                     // Warm-up runs and the per-run report (-warmup, -report, -format)
+
+
+// Declaration of auxiliary functions (see full implementation below)
+void *receiver_worker(void *arg);
+void receiver_handle_packet(Receiver_Worker *worker, const RUDP_Header *header, const char *packet, const struct sockaddr_in *sender);
+void receiver_place_segment(Receiver_Worker *worker, RUDP_Peer *peer, const RUDP_Header *header, const char *packet);
+void receiver_finish_run(Receiver_Worker *worker, RUDP_Peer *peer);
+void receiver_close_connection(Receiver_Worker *worker, RUDP_Peer *peer);
 
 
 /*Main function for RUDP receiver.*/
@@ -20,272 +55,462 @@ int main(int argc, char *argv[])
     /*    Validate Command-Line Arguments     */
     /*----------------------------------------*/
 
-    if (argc != 3)
+    if (argc < 3 || argc % 2 == 0)
     {
-        print_time("ERROR! Usage: -p <PORT NUMBER>\n");
+        log_error("ERROR! Usage: -p <PORT NUMBER> [-b <BATCH>] [-gro 0|1] [-uring 0|1] [-timestamps 0|1] [-workers <WORKERS>] [-clients <CLIENTS>] [-seed <SEED>] [-warmup <N>] [-report <FILE>] [-format csv|json] [-log <LEVEL>] [-metrics 0|1]\n");
         return -1;
     }
 
-    int port = SERVER_PORT;
+    int port = 0;
+    int batch_size = DEFAULT_BATCH_SIZE;
+    int gro = 0;
+    int timestamps = 0;
+    int uring = 0;
+    int workers = 1;
+    int applied;
+    bench_init(&bench, DATA_SIZE);
 
     // Parsing command-line arguments
-    if (strcmp(argv[1], "-p") == 0)
-        port = atoi(argv[2]);
-    else
+    for (int i = 1; i < argc; i += 2)
     {
-        print_time("Error! Usage: -p <PORT NUMBER>\n");
-        return -1;
+        if (strcmp(argv[i], "-p") == 0)
+            port = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-b") == 0)
+            batch_size = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-gro") == 0)
+            gro = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-uring") == 0)
+            uring = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-timestamps") == 0)
+            timestamps = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-workers") == 0)
+            workers = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-clients") == 0)
+            clients = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-seed") == 0)
+        {
+            verifySeed = strtoull(argv[i + 1], NULL, 0);
+            verifySeeded = 1;
+        }
+        else if ((applied = bench_option(&bench, argv[i], argv[i + 1])) != 0 || (applied = log_option(argv[i], argv[i + 1])) != 0 ||
+                 (applied = metrics_option(argv[i], argv[i + 1])) != 0)
+        {
+            if (applied < 0)
+                return -1;
+        }
+        else
+        {
+            log_error("Error! Usage: -p <PORT NUMBER> [-b <BATCH>] [-gro 0|1] [-uring 0|1] [-timestamps 0|1] [-workers <WORKERS>] [-clients <CLIENTS>] [-seed <SEED>] [-warmup <N>] [-report <FILE>] [-format csv|json] [-log <LEVEL>] [-metrics 0|1]\n");
+            return -1;
+        }
     }
 
     // Validate that the port number has been properly assigned
     if (port <= 0)
     {
-        print_time("ERROR: Invalid port number\n");
+        log_error("ERROR: Invalid port number\n");
+        return 1;
+    }
+
+    // Validate the number of datagrams moved per system call
+    if (batch_size < 1 || batch_size > MAX_BATCH_SIZE)
+    {
+        log_error("ERROR: Batch size must be between 1 and %d\n", MAX_BATCH_SIZE);
+        return 1;
+    }
+
+    // Validate the number of workers and connections to serve
+    if (workers < 1 || workers > MAX_WORKERS || clients < 0)
+    {
+        log_error("ERROR: Workers must be between 1 and %d, and clients at least 0\n", MAX_WORKERS);
         return 1;
     }
 
-    printf("\n");
-    print_time("Arguments for connection were received successfully\n");
-    // print_time("Port number set to %d\n", port);             // ~~INTERNAL CHECK: Port number validity ~~ //
+    if (bench_open(&bench) < 0 || metrics_open(argv[0]) < 0)
+        return 1;
+    log_plain("\n");
+    log_info("Arguments for connection were received successfully\n");
+    // log_info("Port number set to %d\n", port);             // ~~INTERNAL CHECK: Port number validity ~~ //
 
     /*----------------------------------------*/
     /*                Main Code               */
     /*----------------------------------------*/
 
-    // Create a RUDP socket (IPv4, datagram-based, default protocol)
-    int sock = -1;
-    sock = rudp_socket(AF_INET, SOCK_DGRAM, 0);
-    print_time("Receiver's RUDP socket opened successfully\n");
+    Receiver_Worker *pool = calloc(workers, sizeof(Receiver_Worker));
+    if (pool == NULL)
+    {
+        log_error("ERROR: Failed to allocate the workers!\n");
+        return 1;
+    }
+    for (int w = 0; w < workers; w++)
+    {
+        pool[w].index = w;
+        pool[w].sock = -1;
+        pool[w].ring.fd = -1;
+        pool[w].metrics = metrics_claim(METRICS_RUDP_RECEIVER, "worker=\"%d\"", w);
+    }
 
- 
-    // Initialize structures for receiver and sender addresses
+    // Initialize the receiver's address
     struct sockaddr_in receiver;            // A variable that stores the receiver's address information
-    struct sockaddr_in sender;              // A variable that stores the sender's address information
-    socklen_t sender_len = sizeof(sender);  // A variable that stores the sender's structure length
     memset(&receiver, 0, sizeof(receiver)); // Reset the receiver structures to zeros
-    memset(&sender, 0, sender_len);         // Reset the sender structures to zeros
 
     receiver.sin_family = AF_INET;                // Set the receiver's address family to AF_INET (IPv4)
     receiver.sin_addr.s_addr = htonl(INADDR_ANY); // Set the receiver's address to "0.0.0.0"
     receiver.sin_port = htons(port);              // Set the receiver's port to the specified port
 
-    // Bind the socket to IP address and port
-    if (bind(sock, (struct sockaddr *)&receiver, sizeof(receiver)) < 0)
+    int result = 0;
+    for (int w = 0; w < workers && result == 0; w++)
     {
-        perror("bind(2)");
-        close(sock);
-        return 1;
-    }
-    print_time("RUDP receiver's socket binds successfully\n");
-    print_time("Listening to RUDP incoming connections on port %d\n", port);
+        Receiver_Worker *worker = &pool[w];
 
-    // Variables for run statistics
-    double *run_times = malloc(sizeof(double));
-    double *run_speeds = malloc(sizeof(double));
-    if (!run_times || !run_speeds)
-    {
-        print_time("ERROR: Failed to allocate memory for run statistics!\n");
-        free(run_times);
-        free(run_speeds);
-        close(sock);
-        return 1;
-    }
+        // Create a RUDP socket (IPv4, datagram-based, default protocol); every worker binds its own to the same port
+        worker->sock = rudp_socket(AF_INET, SOCK_DGRAM, 0);
+        int reuse = 1;
+        if (worker->sock < 0 || setsockopt(worker->sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0 ||
+            bind(worker->sock, (struct sockaddr *)&receiver, sizeof(receiver)) < 0)
+        {
+            perror("bind(2)");
+            result = 1;
+            break;
+        }
 
-    memset(run_times, 0, sizeof(double));
-    memset(run_speeds, 0, sizeof(double));
+        // Datagram batches: received packets (one recvmmsg(2)) and their ACKs (one sendmmsg(2)), or both in one io_uring_enter(2)
+        if (rudp_batch_init(&worker->recvBatch, batch_size) < 0 || rudp_batch_init(&worker->ackBatch, batch_size) < 0 ||
+            (gro && rudp_batch_enable_gro(worker->sock, &worker->recvBatch) < 0) ||
+            (timestamps && rudp_batch_enable_timestamps(worker->sock, &worker->recvBatch) < 0) ||
+            (uring && (uring_init(&worker->ring, URING_ENTRIES) < 0 || rudp_batch_enable_uring(&worker->recvBatch, &worker->ring) < 0 || rudp_batch_enable_uring(&worker->ackBatch, &worker->ring) < 0)) ||
+            rudp_batch_set_timeout(worker->sock, &worker->recvBatch, IDLE_TICK_US) < 0 ||
+            rudp_peer_table_init(&worker->peers, MAX_CLIENTS) < 0)
+        {
+            log_error("ERROR: Failed to allocate the datagram batches!\n");
+            result = 1;
+        }
+    }
+    if (result == 0 && rudp_socket_window(pool[0].sock) < MAX_WINDOW_SIZE)
+        log_warn("The receive buffers hold only %d segments: larger sender windows overflow them (raise net.core.rmem_max)\n", rudp_socket_window(pool[0].sock));
+    log_info("Receiver's RUDP socket(s) opened successfully\n");
 
-    int runs = 0;                                   // A counter for the number of runs
-    long totalDataReceived = 0;                     // A counter for total data received
-    int isRunning = 1;                              // A flag for exiting after FIN has sent
-    
+    // Spread the connections over the workers by connection ID
+    if (result == 0 && workers > 1 && rudp_reuseport_steer(pool[0].sock, workers) < 0)
+        result = 1;
 
-    // Main loop for "runs" made by the Sender
-    while (isRunning && runs < MAX_RUNS)
+    // Start the workers; each one serves the connections steered to its socket
+    int started = 0;
+    if (result == 0)
     {
-        RUDP_Header recv_packet;            // Struct for received packet header
-        char recv_buffer[DATA_SIZE];        // Buffer for receiving data
-        memset(recv_buffer, 0, DATA_SIZE);  // Zero the buffer
-        
-        // Dynamically allocate memory for the statistic arrays
-        double *temp_run_times = realloc(run_times, (runs + 1) * sizeof(double));
-        double *temp_run_speeds = realloc(run_speeds, (runs + 1) * sizeof(double));
-        if (!temp_run_times || !temp_run_speeds) 
+        log_info("RUDP receiver's socket binds successfully\n");
+        log_info("Listening to RUDP incoming connections on port %d (%d worker(s))\n", port, workers);
+        log_info("Timing clock: %s%s\n", timing_source(), timestamps ? ", with kernel receive timestamps" : "");
+        for (; started < workers; started++)
         {
-            print_time("ERROR: Failed to resize memory for run statistics!\n");
-            free(run_times);
-            free(run_speeds);
-            close(sock); 
-            isRunning = 0;  
-            return 1; 
-        }
-        run_times = temp_run_times;
-        run_speeds = temp_run_speeds;
-
-        // File received initializations
-        char filename[20];
-        snprintf(filename, sizeof(filename), "Received_Run_%d.txt", runs + 1);  // Create "filename" to be saved
-        FILE *file = NULL;                                                      // Initiate file pointer
-        
-        // Variables to monitor the connection
-        long runDataReceived = 0;       // A counter for data received in current run
-        int lastSegmentReceived = 0;    // A flag for last packet received
-        int segmentNumber = 1;          // Segment number within the current run
-        int handshakeCompleted = 0;     // A flag to keep track if in connection succeeded
-        
-        // Structs for storing start and end times
-        struct timeval start_time, end_time;
-        gettimeofday(&start_time, NULL);        // Record start time         
-
-        if(runs >= 1)                    printf("--------------------------------------------\n");
-
-        // Secondary loop for receiving data (segments) from Sender
-        while (!lastSegmentReceived)
-        {
-            // Prepare a receiving packet
-            memset(&recv_packet, 0, sizeof(recv_packet));   // Reset the received packet structures to zeros
-            socklen_t sender_len = sizeof(sender);          // Store the size of the sender's address struct
-            
-            // Try to receive data
-            int bytes_received = rudp_recv(sock, recv_buffer, BUFFER_SIZE, 0, (struct sockaddr *)&sender, &sender_len, runs + 1);
-
-            // Check if the sender failed to send data; If so - close both file and socket
-            if (bytes_received < 0)     
+            if (pthread_create(&pool[started].thread, NULL, receiver_worker, &pool[started]) != 0)
             {
-                perror("recv(2)");
-                if (file)      fclose(file);              
-                close(sock);
+                log_error("ERROR: Failed to start worker #%d!\n", started);
+                __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+                result = 1;
                 break;
             }
+        }
+    }
+    for (int w = 0; w < started; w++)
+        pthread_join(pool[w].thread, NULL);
+
+    // After processing all connections
+    RUDP_IO_Stats io = {0};
+    long totalDataReceived = 0;
+    log_plain("--------------------------------------------\n");
+    for (int w = 0; w < started; w++)
+    {
+        if (workers > 1)
+            log_info("Worker #%d: %d connection(s), %ld bytes received\n", w, pool[w].connections, pool[w].totalData);
+        if (pool[w].peers.count > 0)
+            log_info("Worker #%d: %d unfinished connection(s) dropped\n", w, pool[w].peers.count);
+        io.sendCalls += pool[w].io.sendCalls;
+        io.recvCalls += pool[w].io.recvCalls;
+        io.pollCalls += pool[w].io.pollCalls;
+        io.ringCalls += pool[w].io.ringCalls;
+        io.datagramsSent += pool[w].io.datagramsSent;
+        io.datagramsReceived += pool[w].io.datagramsReceived;
+        io.checksumFailures += pool[w].io.checksumFailures;
+        totalDataReceived += pool[w].totalData;
+    }
+    if (started > 0)
+        print_io_statistics(&io, totalDataReceived);
 
-            RUDP_Header* recv_packet = (RUDP_Header*) recv_buffer;
-            
-            // Check if ACK received within the 3-way handshake process
-            if (recv_packet->flags & ACK && !handshakeCompleted) 
-            {
-                print_time("*** 3-way handshake completed ***\n");
-                print_time("Ready for receiving data...\n");
-                printf("--------------------------------------------\n");
-                handshakeCompleted = 1; 
-                continue; 
-            }
-           
-            // Check if the received bytes are greater than the header -> data to be processed
-            if (bytes_received > sizeof(RUDP_Header)) 
-            {
-                if (!file)                              // Ensure that the file is open for writing
-                { 
-                    file = fopen(filename, "wb"); 
-                    if (!file) 
-                    {
-                        print_time("ERROR: Failed to open file!");
-                        return 1; 
-                    }
-                }
-                fwrite(((char*)recv_packet) + sizeof(RUDP_Header), 1, bytes_received - sizeof(RUDP_Header), file); 
-                runDataReceived += bytes_received - sizeof(RUDP_Header);                    // Update the run data received counter
-                segmentNumber++;                                                            // Increment segment number for the next loop iteration
-            }
+    // Clean-up
+    log_info("Closing connection and cleaning up...\n");
+    for (int w = 0; w < workers; w++)
+    {
+        if (pool[w].ring.fd >= 0)
+            uring_free(&pool[w].ring);      // Before the batches: the ring may still hold receives into them
+        rudp_batch_free(&pool[w].recvBatch);
+        rudp_batch_free(&pool[w].ackBatch);
+        rudp_peer_table_free(&pool[w].peers);
+        if (pool[w].sock >= 0)
+            close(pool[w].sock);            // The Receiver closes without sending FIN
+    }
+    free(pool);
 
-            // Check if the received packet signals the end of transmission
-            if (recv_packet->flags & FIN || lastSegmentReceived || bytes_received == 0 || recv_packet->flags & LAST_PACKET)  // Check if this is the final packet 
-            {
+    bench_close(&bench);
+    log_info("Receiver end.\n");
 
-                rudp_sendack(sock, &sender, recv_packet->flags, runs + 1);      // Send an acknowledgment for the FIN packet
-
-                if (recv_packet->flags & LAST_PACKET)
-                {
-                    lastSegmentReceived = 1;                // Mark the last segment to exit the loop
-                }
-                
-                if(recv_packet->flags & FIN)                // Handle the case of closing connection
-                {
-                    if (file) 
-                    {
-                        fclose(file);
-                        file = NULL;        // Reset file pointer
-                    }
-                    isRunning = 0;
-                    break;
-                }
-            }
+    return result;
+}
+
+
+/*----------------------------------------*/
+/*          Auxiliary functions           */
+/*----------------------------------------*/
+
+/* Worker thread: receives the packets steered to its socket until enough connections were closed */
+void *receiver_worker(void *arg)
+{
+    Receiver_Worker *worker = arg;
+
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+    {
+        // Try to receive data; an idle socket returns every IDLE_TICK_US to check for shutdown
+        void *recv_buffer = NULL;
+        RUDP_Header header;
+        struct sockaddr_in sender;
+        int bytes_received = rudp_recv_batched(worker->sock, &worker->recvBatch, &worker->ackBatch, &recv_buffer, &header, &sender, 0, &worker->io);
+
+        // Drop corrupted or unknown packets; the Sender retransmits them
+        if (bytes_received == -2 || bytes_received == -3)
+        {
+            metrics_set(worker->metrics, METRIC_CHECKSUM_FAILURES, worker->io.checksumFailures);
+            continue;
         }
 
-        // Break the loop if FIN sent
-        if (!isRunning)
+        // Check if the receive failed; If so - stop the worker
+        if (bytes_received < 0)
+        {
+            perror("recv(2)");
             break;
+        }
 
-        // Store run statistics
-        gettimeofday(&end_time, NULL);          // Record the end time
-        // printf("run #%d\n", runs);           // ~~INTERNAL CHECK: print run number ~~ //       
-        
-        if (file)                               // Ensure that the file closed
+        receiver_handle_packet(worker, &header, recv_buffer, &sender);
+    }
+
+    rudp_batch_flush(worker->sock, &worker->ackBatch, &worker->io);
+    return NULL;
+}
+
+/* Apply a validated packet, whose header was decoded into "header", to the state of its connection, looked up by connection ID */
+void receiver_handle_packet(Receiver_Worker *worker, const RUDP_Header *header, const char *packet, const struct sockaddr_in *sender)
+{
+    RUDP_Peer *peer = rudp_peer_lookup(&worker->peers, header->connectionId);
+
+    // A SYN opens the connection (rudp_recv_batched already answered it; a retransmitted SYN finds it open)
+    if (header->flags & SYN)
+    {
+        if (peer != NULL)
+            return;
+        peer = rudp_peer_add(&worker->peers, header->connectionId, sender);
+        if (peer == NULL)
         {
-            fclose(file);
-            file = NULL;
+            log_error("ERROR: Failed to allocate a connection!\n");
+            return;
         }
+        peer->number = __atomic_add_fetch(&connectionsOpened, 1, __ATOMIC_RELAXED);
+        peer->checksumMode = (header->flags & CRC32C_MODE) ? CHECKSUM_CRC32C : CHECKSUM_INTERNET;
+        log_info("Connection #%d (ID %08x) from %s:%d, served by worker #%d\n", peer->number, peer->id, inet_ntoa(sender->sin_addr), ntohs(sender->sin_port), worker->index);
+        return;
+    }
 
-        // Calculate the time difference between start and end times
-        double diff = ((end_time.tv_sec - start_time.tv_sec)*1000) + (((double)(end_time.tv_usec - start_time.tv_usec))/1000);
-            
-        // Update the run statistics with the calculated time difference and speed
-        run_times[runs] = diff;
-        run_speeds[runs] = ((double)runDataReceived / 1024 / 1024) / (diff / 1000.0);
-        totalDataReceived += runDataReceived;
-        
-        runs++;
-
-        // ~~INTERNAL CHECK: ensure data gathered correctly ~~ //
-        // printf("Up to now:\n");               
-        // for (int i = 0; i < runs; ++i) 
-        // {
-        //     printf("Run #%d: Time: %.3f ms, Speed: %.3f Mbps\n", i + 1, run_times[i], run_speeds[i]);
-        // }
-    
-        print_time("Interim summury (Run %d): %d bytes Sent/%d bytes received by %d segments\n", runs , totalDataReceived / (runs), runDataReceived, segmentNumber);
-
-        // Reset the start and end time structs for the next measurement    
-        memset(&start_time, 0, sizeof(start_time));
-        memset(&end_time, 0, sizeof(end_time));
-
-        // ~~INTERNAL CHECK: After receiving and saving a run, compare it to the generated file ~~ //
-        char generatedFileName[64];
-        snprintf(generatedFileName, sizeof(generatedFileName), "Generate_File_%d.txt", runs);
-        char receivedFileName[64];
-        snprintf(receivedFileName, sizeof(receivedFileName), "Received_Run_%d.txt", runs);
-        
-        int filesIdentical = compare_files(receivedFileName, generatedFileName);
-        if (filesIdentical == 1) 
-        {
-            print_time("Identity files check (sent vs. received) for Run %d: Files are identical.\n", runs);
-        } 
-        else if (filesIdentical == 0) 
+    if (peer == NULL)
+    {
+        // A FIN of a connection already closed: its ACK was lost, so send it again
+        if (header->flags & FIN)
         {
-            print_time("ERROR! Run %d: Files are not identical.\n", runs);
-        } 
-        else 
+            rudp_sendack(worker->sock, sender, header->connectionId, header->flags & CRC32C_MODE, FIN, 0, header->offset);
+            worker->io.sendCalls++;
+        }
+        return;         // Packets of unknown connections are dropped
+    }
+    peer->addr = *sender;
+
+    // Check if ACK received within the 3-way handshake process
+    if (header->flags & ACK && !peer->handshakeCompleted)
+    {
+        log_info("*** Connection #%d: 3-way handshake completed ***\n", peer->number);
+        log_info("Ready for receiving data...\n");
+        log_plain("--------------------------------------------\n");
+        peer->handshakeCompleted = 1;
+        return;
+    }
+
+    // Check if the packet carries a payload -> data to be processed
+    if (header->length > 0 && header->flags & (DATA | LAST_PACKET))
+    {
+        receiver_place_segment(worker, peer, header, packet);
+        return;
+    }
+
+    // Check if the received packet signals the end of the connection
+    if (header->flags & FIN)
+    {
+        rudp_sendack(worker->sock, sender, peer->id, peer->checksumMode == CHECKSUM_CRC32C, FIN, peer->runs + 1, header->offset);      // Send an acknowledgment for the FIN packet
+        worker->io.sendCalls++;
+        receiver_close_connection(worker, peer);
+    }
+}
+
+/* Place a data segment at its offset in the connection's current run, whatever order it arrived in, and ACK it once stored.
+   A segment that cannot be stored is left unACKed, so the Sender retransmits it */
+void receiver_place_segment(Receiver_Worker *worker, RUDP_Peer *peer, const RUDP_Header *header, const char *packet)
+{
+    long segment = RUDP_OFFSET_SEGMENT(header->offset);
+    const char *data = packet + RUDP_HEADER_SIZE;
+    int length = header->length;
+
+    // Duplicates of delivered segments are ACKed again (their ACK may have been lost)
+    if (segment < peer->nextSegment)
+    {
+        rudp_queue_ack(worker->sock, &worker->ackBatch, &peer->addr, header, &worker->io);
+        return;
+    }
+    if (segment >= peer->nextSegment + MAX_WINDOW_SIZE)
+        return;
+
+    if (peer->output.fd < 0)                      // Ensure that the run's file is open for writing
+    {
+        char filename[64];
+        snprintf(filename, sizeof(filename), "Received_Conn_%d_Run_%d.txt", peer->number, peer->runs + 1);  // Create "filename" to be saved
+        if (rudp_output_open(&peer->output, filename, DATA_SIZE) < 0)
         {
-            // Error handling if files couldn't be opened
-            print_time("ERROR! Run %d: Could not open files for comparison.\n", runs);
+            log_ratelimited(LOG_ERROR, LOG_SEGMENT_INTERVAL_MS, "ERROR: Connection #%d: Failed to open file!\n", peer->number);
+            return;
         }
+        peer->runStart = worker->recvBatch.arrival;   // Record start time
+        if (peer->runs >= 1)                      log_plain("--------------------------------------------\n");
+    }
 
-        print_time("Waiting to further incoming requests...\n");
+    RUDP_Slot *slot = &peer->window[segment % MAX_WINDOW_SIZE];
+    if (slot->present)
+    {
+        rudp_queue_ack(worker->sock, &worker->ackBatch, &peer->addr, header, &worker->io);
+        return;
     }
-    
-    // After processing all packets
-    if (runs + 1 > 0)   print_statistics(run_times, run_speeds, runs - 1, totalDataReceived); 
-    else                print_time("No complete data runs received.\n");
-    
-    // Clean-up
-    free(run_times);
-    free(run_speeds);
-    print_time("Closing connection and cleaning up...\n");
+    if (header->flags & LAST_PACKET)            // The run's final segment leads with the Sender's run digest
+    {
+        if (length < DIGEST_SIZE)
+            return;
+        uint64_t digest;
+        memcpy(&digest, data, DIGEST_SIZE);
+        peer->sentDigest = be64toh(digest);
+        data += DIGEST_SIZE;
+        length -= DIGEST_SIZE;
+    }
+    size_t offset = header->offset - RUDP_SEGMENT_OFFSET(peer->runFirstSegment);
+    if (rudp_output_write(&peer->output, offset, data, length) < 0)
+    {
+        log_ratelimited(LOG_ERROR, LOG_SEGMENT_INTERVAL_MS, "ERROR: Connection #%d: Failed to write segment #%ld!\n", peer->number, segment);
+        return;
+    }
+    if (length > 0)                             // Like the Sender, an empty (digest-only) segment adds nothing
+        peer->runDigest += digest_segment(data, length, offset);     // Segments are hashed as they are placed, in any order
+    uint64_t now = worker->recvBatch.arrival;
+    if (now < peer->lastArrival)                // Kernel stamps moved onto the clock may be off by a few ns
+        now = peer->lastArrival;
+    if (peer->lastArrival)
+        hist_record(&peer->arrivalGaps, now - peer->lastArrival);
+    peer->lastArrival = now;
+    slot->length = length;
+    slot->flags = header->flags;
+    slot->present = 1;
+    rudp_queue_ack(worker->sock, &worker->ackBatch, &peer->addr, header, &worker->io);
+
+    // Advance the in-order frontier over every segment now in place
+    while (peer->window[peer->nextSegment % MAX_WINDOW_SIZE].present)
+    {
+        slot = &peer->window[peer->nextSegment % MAX_WINDOW_SIZE];
+        slot->present = 0;
+        peer->runData += slot->length;          // Update the run data received counter
+        peer->nextSegment++;
+        metrics_add(worker->metrics, METRIC_BYTES, slot->length);
+        metrics_add(worker->metrics, METRIC_SEGMENTS, 1);
+
+        if (slot->flags & LAST_PACKET)
+        {
+            rudp_batch_flush(worker->sock, &worker->ackBatch, &worker->io);
+            rudp_sendack(worker->sock, &peer->addr, peer->id, peer->checksumMode == CHECKSUM_CRC32C, LAST_PACKET, peer->runs + 1, RUDP_SEGMENT_OFFSET(peer->nextSegment - 1));
+            worker->io.sendCalls++;
+            receiver_finish_run(worker, peer);
+            break;
+        }
+    }
+}
 
-    int isSender = 0;
-    rudp_close(sock, &receiver, isSender);         // Force the Receiver to close sock without sending FIN
+/* Close the connection's run file, record the run's statistics and verify the file */
+void receiver_finish_run(Receiver_Worker *worker, RUDP_Peer *peer)
+{
+    // Store run statistics: from the arrival of the run's first segment to that of the one completing it
+    double diff = timing_ms(peer->runStart, worker->recvBatch.arrival);
+    rudp_output_close(&peer->output);           // Trim the file to the run's size and close it
 
-    print_time("Receiver end.\n");
+    // Update the run statistics with the calculated time difference and speed
+    if (peer->runs < MAX_RUNS)
+    {
+        peer->runTimes[peer->runs] = diff;
+        peer->runSpeeds[peer->runs] = ((double)peer->runData / 1024 / 1024) / (diff / 1000.0);
+    }
+    peer->totalData += peer->runData;
+    peer->runs++;
+    metrics_add(worker->metrics, METRIC_RUNS, 1);
+
+    bench_record(&bench, &(Bench_Record){.role = "receiver", .protocol = "rudp", .variant = peer->checksumMode == CHECKSUM_CRC32C ? "crc32c" : "internet",
+                                         .connection = peer->number, .run = peer->runs, .warmup = bench_is_warmup(&bench, peer->runs),
+                                         .bytes = peer->runData, .ms = diff, .rttMs = -1, .rttP50Ms = -1, .rttP99Ms = -1, .segments = peer->nextSegment - peer->runFirstSegment,
+                                         .retransmissions = -1, .syscalls = -1, .cpuMs = -1});
+    log_info("Connection #%d: Interim summury (Run %d): %ld bytes Sent/%ld bytes received by %ld segments (#%ld-#%ld)\n", peer->number, peer->runs, peer->totalData / peer->runs, peer->runData,
+             peer->nextSegment - peer->runFirstSegment, peer->runFirstSegment, peer->nextSegment - 1);
+
+    // End-to-end check: the digest of the placed segments against the one the Sender put in LAST_PACKET
+    int filesIdentical = (peer->runDigest == peer->sentDigest);
+    if (!filesIdentical)
+        log_error("ERROR! Connection #%d, Run %d: Digest mismatch (sent %016llx, received %016llx)\n", peer->number, peer->runs,
+                  (unsigned long long)peer->sentDigest, (unsigned long long)peer->runDigest);
+    else if (verifySeeded)                      // With the seed, the file itself is checked against the regenerated payload too
+    {
+        char receivedFileName[64];
+        snprintf(receivedFileName, sizeof(receivedFileName), "Received_Conn_%d_Run_%d.txt", peer->number, peer->runs);
+        filesIdentical = payload_verify_file(receivedFileName, peer->runData, payload_run_seed(verifySeed, peer->runs));
+    }
+    if (filesIdentical == 1)
+    {
+        log_info("Connection #%d: Identity files check (sent vs. received) for Run %d: Files are identical.\n", peer->number, peer->runs);
+    }
+    else if (filesIdentical == 0)
+    {
+        log_error("ERROR! Connection #%d, Run %d: Files are not identical.\n", peer->number, peer->runs);
+    }
+    else
+    {
+        // Error handling if the file couldn't be opened
+        log_error("ERROR! Connection #%d, Run %d: Could not open the file for verification.\n", peer->number, peer->runs);
+    }
 
-    return 0;
+    // The next run starts right after this one
+    peer->runData = 0;
+    peer->runDigest = 0;
+    peer->lastArrival = 0;                      // The pause between runs is not a gap
+    peer->runFirstSegment = peer->nextSegment;
+    log_info("Waiting to further incoming requests...\n");
 }
 
+/* Print the statistics of a connection closed by its FIN, drop it and stop once enough connections closed */
+void receiver_close_connection(Receiver_Worker *worker, RUDP_Peer *peer)
+{
+    log_plain("--------------------------------------------\n");
+    log_info("Connection #%d closed after %d run(s)\n", peer->number, peer->runs);
+    if (peer->runs > 0)     print_statistics(peer->runTimes, peer->runSpeeds, (peer->runs < MAX_RUNS ? peer->runs : MAX_RUNS) - 1, peer->totalData, "Segment arrival gaps", &peer->arrivalGaps, NULL);
+    else                    log_info("No complete data runs received.\n");
+
+    worker->connections++;
+    worker->totalData += peer->totalData;
+    rudp_peer_remove(&worker->peers, peer);     // An unfinished run's file is closed as is
 
+    if (__atomic_add_fetch(&connectionsClosed, 1, __ATOMIC_ACQ_REL) == clients)
+        __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+}
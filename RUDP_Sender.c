@@ -8,7 +8,11 @@
 #include <netinet/in.h>
 #include <time.h>
 #include <sys/time.h>       // For tv struct
+#include <sys/mman.h>       // For mapping the file to send
+#include <sys/resource.h>   // For the CPU time of every run
 #include "RUDP_API.h"
+#include "Payload.h"
+#include "Bench.h"
 
 
 
@@ -21,14 +25,26 @@ int main(int argc, char *argv[])
     /*    Validate Command-Line Arguments     */
     /*----------------------------------------*/
 
-    if (argc != 5)
+    if (argc < 5 || argc % 2 == 0)
     {
-        print_time("Usage: %s -ip IP -p PORT\n", argv[0]);
+        log_error("Usage: %s -ip IP -p PORT [-w WINDOW] [-algo ALGO] [-b BATCH] [-gso 0|1] [-crc 0|1] [-uring 0|1] [-pipe 0|1] [-seed SEED]"
+                  " [-size BYTES] [-runs N] [-warmup N] [-duration SECONDS] [-report FILE] [-format csv|json] [-log LEVEL] [-metrics 0|1]\n", argv[0]);
         return -1;
     }
 
     const char *receiver_ip = NULL;
     int receiver_port = 0;
+    int window_size = 0;
+    const char *algo = NULL;
+    int batch_size = DEFAULT_BATCH_SIZE;
+    int gso = 0;
+    int crc = 0;
+    int uring = 0;
+    int pipelined = 0;
+    uint64_t seed = payload_random_seed();  // Seeds the payload of every run (a receiver given it verifies on its own)
+    int applied;                            // 1 if a shared option parser took the flag, -1 if it rejected the value
+    Bench bench;                            // Run size, number of runs and report
+    bench_init(&bench, DATA_SIZE);
 
     // Parsing command-line arguments
     for (int i = 1; i < argc; i += 2)
@@ -37,16 +53,65 @@ int main(int argc, char *argv[])
             receiver_ip = argv[i + 1];
         else if (strcmp(argv[i], "-p") == 0)
             receiver_port = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-w") == 0)
+            window_size = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-algo") == 0)
+            algo = argv[i + 1];
+        else if (strcmp(argv[i], "-b") == 0)
+            batch_size = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-gso") == 0)
+            gso = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-crc") == 0)
+            crc = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-uring") == 0)
+            uring = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-pipe") == 0)
+            pipelined = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-seed") == 0)
+            seed = strtoull(argv[i + 1], NULL, 0);
+        else if ((applied = bench_option(&bench, argv[i], argv[i + 1])) != 0 || (applied = log_option(argv[i], argv[i + 1])) != 0 ||
+                 (applied = metrics_option(argv[i], argv[i + 1])) != 0)
+        {
+            if (applied < 0)
+                return -1;
+        }
+        else
+        {
+            log_error("Usage: %s -ip IP -p PORT [-w WINDOW] [-algo ALGO] [-b BATCH] [-gso 0|1] [-crc 0|1] [-uring 0|1] [-pipe 0|1] [-seed SEED]"
+                      " [-size BYTES] [-runs N] [-warmup N] [-duration SECONDS] [-report FILE] [-format csv|json] [-log LEVEL] [-metrics 0|1]\n", argv[0]);
+            return -1;
+        }
     }
 
+    // Without -w the window is STOP-and-WAIT, unless a congestion controller is to size it
+    if (window_size == 0)
+        window_size = algo ? MAX_WINDOW_SIZE : DEFAULT_WINDOW_SIZE;
+
     // Validate that both server_ip and server_port have been properly assigned
     if (receiver_ip == NULL || receiver_port <= 0)
     {
-        print_time("Usage: %s -ip IP -p PORT\n", argv[0]);
+        log_error("Usage: %s -ip IP -p PORT [-w WINDOW] [-algo ALGO] [-b BATCH] [-gso 0|1] [-crc 0|1] [-uring 0|1] [-pipe 0|1] [-seed SEED]"
+                  " [-size BYTES] [-runs N] [-warmup N] [-duration SECONDS] [-report FILE] [-format csv|json] [-log LEVEL] [-metrics 0|1]\n", argv[0]);
+        return -1;
+    }
+
+    // Validate the sliding window size (1 = STOP-and-WAIT)
+    if (window_size < 1 || window_size > MAX_WINDOW_SIZE)
+    {
+        log_error("ERROR: Window size must be between 1 and %d\n", MAX_WINDOW_SIZE);
+        return -1;
+    }
+
+    // Validate the number of datagrams moved per system call
+    if (batch_size < 1 || batch_size > MAX_BATCH_SIZE)
+    {
+        log_error("ERROR: Batch size must be between 1 and %d\n", MAX_BATCH_SIZE);
         return -1;
     }
-    printf("\n");
-    print_time("Arguments for connection were received successfully\n");
+    if (bench_open(&bench) < 0 || metrics_open(argv[0]) < 0)
+        return -1;
+    log_plain("\n");
+    log_info("Arguments for connection were received successfully\n");
 
 
     /*----------------------------------------*/
@@ -56,8 +121,8 @@ int main(int argc, char *argv[])
     // Create a RUDP socket (IPv4, datagram-based, default protocol)
     int sock = -1;
     sock = rudp_socket(AF_INET, SOCK_DGRAM, 0);
-    print_time("Sender's RUDP socket opened successfully\n");
-    print_time("Initiating connecting process to %s on port %d...\n", receiver_ip, receiver_port);
+    log_info("Sender's RUDP socket opened successfully\n");
+    log_info("Initiating connecting process to %s on port %d...\n", receiver_ip, receiver_port);
 
     // Initialize receiver address structure
     struct sockaddr_in receiver;              // A struct to store the receiver's address
@@ -74,130 +139,207 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    // Initialize the connection state (RTT estimator and sliding window)
+    RUDP_Connection conn;
+    if (rudp_connection_init(&conn, sock, &receiver, window_size) < 0 || rudp_set_batch_size(&conn, batch_size) < 0 ||
+        (gso && rudp_set_gso(&conn) < 0) || (uring && rudp_set_uring(&conn) < 0))
+    {
+        close(sock);
+        return 1;
+    }
+
+    // Set congestion control algorithm
+    if (algo != NULL && rudp_set_congestion_control(&conn, algo) != 0)
+    {
+        log_error("ERROR: Unknown congestion control algorithm '%s' (available: none, reno, cubic)\n", algo);
+        close(sock);
+        return 1;
+    }
+
+    // Request CRC32C integrity checks (the Receiver confirms it during the handshake)
+    if (crc)
+        rudp_set_checksum_mode(&conn, CHECKSUM_CRC32C);
+
     // Perform RUDP handshake to establish connection
-    if (rudp_connect(sock, &receiver) < 0)
+    if (rudp_connect(&conn) < 0)
     {
-        fprintf(stderr, "RUDP connection failed.\n");
+        log_error("RUDP connection failed.\n");
         close(sock);
         return 1;
     }
+    log_info("Sliding window size: %d segment(s)%s; CC Algorithm: %s; Batch size: %d; GSO: %s; Engine: %s\n", conn.windowSize, conn.windowSize == 1 ? " (STOP-and-WAIT)" : "", conn.cc.ops->name, batch_size, gso ? "on" : "off", uring ? "io_uring" : "sendmmsg/recvmmsg");
+    log_info("Payload seed: 0x%016llx (generator: %s); Producer: %s\n", (unsigned long long)seed, payload_kernel(),
+             pipelined ? "pipelined (generated while sending)" : "file (generated before sending)");
+    log_info("Run size: %llu bytes\n", (unsigned long long)bench.size);
+    if (!bench.interactive)
+    {
+        if (bench.duration > 0)
+            log_info("Benchmark mode: %d warm-up run(s), then %d run(s) or until %g s have passed\n", bench.warmup, bench.runs, bench.duration);
+        else
+            log_info("Benchmark mode: %d warm-up run(s), then %d run(s)\n", bench.warmup, bench.runs);
+    }
 
     // Initialize data variables
-    int totalDataSent = 0;                         // To store the total data received across all runs
-    int segmentNumber = 1;                         // Initialize segment number
+    long totalDataSent = 0;                        // To store the total data sent across all runs
     int runs = 0;                                  // Counter for the number of sending cycles
     
     int isSender = 1;                       // A flag to mark the Sender (used for sending FIN at the end of the connection)
+    Pipeline pipeline;                      // Producer thread and its ring (-pipe 1)
+    memset(&pipeline, 0, sizeof(pipeline));
+    static Histogram rttSamples, inflatedSamples;   // Per-segment samples of all runs
 
-    // Main loop for sending up to MAX_RUNS of data transmissions to Receiver
-    while(runs < MAX_RUNS)
+    // Main loop for sending up to MAX_RUNS of data transmissions to Receiver (any number in benchmark mode)
+    while(!bench.interactive || runs < MAX_RUNS)
     {
-        int totalSegmentsSent = 0;      // Initialize total segments sent counter
-        char filename[20];
-        sprintf(filename, "Generate_File_%d.txt", runs + 1);        // Create "filename" to be saved
-
-        // Generate random data to create file content
-        util_generate_random_data_file(filename, DATA_SIZE);
-        FILE *file = fopen(filename, "rb"); // Reopen the file in read mode to send its contents
-        if (file == NULL)                   // Check if file opend successfully
-        {
-            perror("ERROR: Failed to open file");
-            return 1;
-        }
-
-        // Get file size
-        fseek(file, 0, SEEK_END);
-        long fileSize = ftell(file);
-        double fileSizeInMB = fileSize / (1024.0 * 1024.0);     // Convert file size to MB
-        rewind(file);
-
-        printf("---------------------- run #%d ----------------------\n", runs + 1);
-        print_time("A %.2f MB file -- '%s' -- generated successfully.\n", fileSizeInMB, filename);
-
-        // Variables to keep tracking on the data transmitted
-        int left = DATA_SIZE;
-        int offset = 0;
-        
-        // Variables for sending data over RUDP
-        char buffer[MAX_SEGMENT_SIZE];
-        size_t bytesRead;
+        long firstSegment = conn.nextSegment;
+        long segmentsBefore = conn.segmentsSent;
+        long retransmissionsBefore = conn.retransmissions;
+        RUDP_IO_Stats ioBefore = conn.io;
+        long fileSize = bench.size;
+        int sendResult;
+        int warmup = bench_is_warmup(&bench, runs + 1);
+        uint64_t runStart, runEnd;
+        struct rusage usageBefore, usageAfter;
+        bench_run_started(&bench, runs + 1);
+        getrusage(RUSAGE_SELF, &usageBefore);
+        runStart = timing_now_ns();
 
-        while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) // Read file contents until the end of it
+        if (pipelined)
         {
-            int segment_data_size = bytesRead;                           
-            int packet_size = sizeof(RUDP_Header) + segment_data_size;   // NOTE: Total packet size equals to the RUDP header plus the data segment's size.
-
-            RUDP_Header *packet = malloc(packet_size);
-            if (packet == NULL) 
+            // No file: a producer thread generates the run into the ring while the sliding window drains it
+            log_plain("---------------------- run #%d%s ----------------------\n", runs + 1, warmup ? " (warm-up)" : "");
+            uint64_t start = timing_now_ns();
+            if (pipeline_start(&pipeline, PIPE_SLOTS, PIPE_SLOT_SIZE, payload_run_seed(seed, runs + 1), 0, fileSize) < 0)
             {
-                print_time("ERROR: Failed to allocate packet.\n");
-                break;
+                rudp_close(&conn, isSender);
+                return 1;
             }
+            sendResult = rudp_send_run_ring(&conn, &pipeline.ring, fileSize);
+            pipeline_finish(&pipeline);
+            log_info("Pipelined run: %.3f ms in total, of which the producer spent %.3f ms generating the payload\n",
+                     timing_ms(start, timing_now_ns()), pipeline.produceMs);
+        }
+        else
+        {
+            char filename[48];
+            sprintf(filename, "Generate_File_%d_%d.txt", (int)getpid(), runs + 1);     // Per process: another sender truncating a mapped file would crash this one
 
-            packet->segmentSize = htons(segment_data_size);      // Convert the segment data size to bytes 
-            packet->totalSize = htonl(DATA_SIZE);                // Convert the total data size to bytes
-            packet->segmentNumber = htonl(segmentNumber);        // Convert the segment number to bytes
-            packet->flags = (feof(file) ? LAST_PACKET : DATA);   // Set the packet's flags field (by the EOF function)
-            packet->checksum = 0;
-            packet->checksum = rudp_compute_checksum(packet, segment_data_size); // Set the original checksum
-            
-            memcpy(((char*)packet) + sizeof(RUDP_Header), buffer, bytesRead); // Ensure correct offset past the header, avoiding struct padding issues
-            // memcpy(packet + 1, buffer, bytesRead);               // Copy the data read from the file into the packet
-
-            // Send the packet to the receiver 
-            int sendResult = rudp_send(sock, packet, packet_size, &receiver); 
-            if (sendResult == -1) 
+            // Generate random data to create file content
+            if (payload_write_file(filename, fileSize, payload_run_seed(seed, runs + 1)) < 0)
             {
-                print_time("An error occurred while sending data. Exiting...\n");
-                fclose(file);
-                rudp_close(sock, &receiver, isSender); // Ensure the socket is closed properly
-                return 1; // Exit with an error code
-            } 
-            else if (sendResult == -2) 
+                rudp_close(&conn, isSender);
+                return 1;
+            }
+            FILE *file = fopen(filename, "rb"); // Reopen the file in read mode to send its contents
+            if (file == NULL)                   // Check if file opend successfully
             {
-                print_time("Failed to receive ACK after maximum attempts. Exiting...\n");
-                fclose(file);
-                rudp_close(sock, &receiver, isSender); // Ensure the socket is closed properly
-                return 1; // Exit with an error code indicating ACK failure
+                perror("ERROR: Failed to open file");
+                unlink(filename);
+                rudp_close(&conn, isSender);
+                return 1;
             }
-            else
+
+            // Get file size
+            fseek(file, 0, SEEK_END);
+            fileSize = ftell(file);
+            double fileSizeInMB = fileSize / (1024.0 * 1024.0);     // Convert file size to MB
+            rewind(file);
+
+            log_plain("---------------------- run #%d%s ----------------------\n", runs + 1, warmup ? " (warm-up)" : "");
+            log_info("A %.2f MB file -- '%s' -- generated successfully.\n", fileSizeInMB, filename);
+
+            // Map the whole file; the sliding window sends its segments straight from the mapping
+            char *data = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fileno(file), 0);
+            fclose(file);
+            unlink(filename);                   // The mapping keeps the data; the Receiver verifies the run by its digest
+            if (data == MAP_FAILED)
             {
-                // Update transmission variables
-                left -= bytesRead;
-                offset += bytesRead;
-                totalDataSent += bytesRead;
-                segmentNumber++;
-                totalSegmentsSent++;
-                free(packet); 
+                log_error("ERROR: Failed to map '%s'.\n", filename);
+                rudp_close(&conn, isSender);
+                return 1;
             }
+            madvise(data, fileSize, MADV_SEQUENTIAL);
+
+            // Send the run to the receiver (timed from here: the file was generated beforehand)
+            getrusage(RUSAGE_SELF, &usageBefore);
+            runStart = timing_now_ns();
+            sendResult = rudp_send_run(&conn, data, fileSize);
+            munmap(data, fileSize);
+        }
+        runEnd = timing_now_ns();
+        getrusage(RUSAGE_SELF, &usageAfter);
+        if (sendResult == -1) 
+        {
+            log_error("An error occurred while sending data. Exiting...\n");
+            rudp_close(&conn, isSender); // Ensure the socket is closed properly
+            return 1; // Exit with an error code
+        } 
+        else if (sendResult == -2) 
+        {
+            log_error("Failed to receive ACK after maximum attempts. Exiting...\n");
+            rudp_close(&conn, isSender); // Ensure the socket is closed properly
+            return 1; // Exit with an error code indicating ACK failure
         }
+        totalDataSent += fileSize;
 
-        fclose(file);
-        
         runs++;
+        long syscalls = (conn.io.sendCalls + conn.io.recvCalls + conn.io.pollCalls + conn.io.ringCalls) -
+                        (ioBefore.sendCalls + ioBefore.recvCalls + ioBefore.pollCalls + ioBefore.ringCalls);
+        double cpuMs = (usageAfter.ru_utime.tv_sec - usageBefore.ru_utime.tv_sec + usageAfter.ru_stime.tv_sec - usageBefore.ru_stime.tv_sec) * 1000.0 +
+                       (usageAfter.ru_utime.tv_usec - usageBefore.ru_utime.tv_usec + usageAfter.ru_stime.tv_usec - usageBefore.ru_stime.tv_usec) / 1000.0;
+        bench_record(&bench, &(Bench_Record){.role = "sender", .protocol = "rudp", .variant = conn.cc.ops->name, .connection = 1, .run = runs, .warmup = warmup,
+                                             .bytes = fileSize, .ms = timing_ms(runStart, runEnd),
+                                             .rttMs = conn.rtt.srtt / 1000.0,
+                                             .rttP50Ms = conn.rttSamples.total ? hist_percentile(&conn.rttSamples, 50) / 1e6 : -1,
+                                             .rttP99Ms = conn.rttSamples.total ? hist_percentile(&conn.rttSamples, 99) / 1e6 : -1,
+                                             .segments = conn.segmentsSent - segmentsBefore, .retransmissions = conn.retransmissions - retransmissionsBefore, .syscalls = syscalls, .cpuMs = cpuMs});
 
-        print_time("Data transmission for run #%d completed with ACK's.\n", runs);
-        print_time("Total segments sent: %d; Total data sent: %d (bytes); Last segment: #%d\n", totalSegmentsSent + 1, offset, segmentNumber);
+        log_info("Data transmission for run #%d completed with ACK's.\n", runs);
+        log_info("Total segments sent: %ld; Retransmissions: %ld; Total data sent: %ld (bytes); Segments: #%ld-#%ld\n",
+                 conn.segmentsSent - segmentsBefore, conn.retransmissions - retransmissionsBefore, fileSize, firstSegment, conn.nextSegment - 1);
+        log_info("SRTT: %.3f ms; RTTVAR: %.3f ms; RTO: %.3f ms (%ld RTT samples, %ld backoffs)\n",
+                 conn.rtt.srtt / 1000.0, conn.rtt.rttvar / 1000.0, conn.rtt.rto / 1000.0, conn.rtt.samples, conn.rtt.backoffs);
+        log_info("CC Algorithm: %s; cwnd: %.1f; ssthresh: %.1f (%ld loss events, %ld timeouts)\n",
+                 conn.cc.ops->name, conn.cc.cwnd, conn.cc.ssthresh, conn.cc.lossEvents, conn.cc.timeouts);
+        hist_print("Per-segment RTT", &conn.rttSamples);
+        if (conn.inflatedSamples.total > 0)
+            hist_print("Retransmission-inflated samples", &conn.inflatedSamples);
+        hist_merge(&rttSamples, &conn.rttSamples);
+        hist_merge(&inflatedSamples, &conn.inflatedSamples);
         
-        // An option to the sender to send more data
-        char decision;
-        print_time("Do you want to send data again? (y/n): ");
-        scanf(" %c", &decision);
-        if (decision == 'n' || decision == 'N')
+        // An option to the sender to send more data, unless the benchmark plan decides
+        if (bench.interactive && !warmup)
+        {
+            char decision;
+            log_info("Do you want to send data again? (y/n): ");
+            log_flush();                    // The question is on the terminal before the answer is read
+            scanf(" %c", &decision);
+            if (decision == 'n' || decision == 'N')
+            {
+                break;
+            }
+        }
+        else if (!bench_next(&bench, runs))
         {
             break;
         }
 
     }
     
-    printf("---------------- close connection ------------------\n");
+    log_plain("---------------- close connection ------------------\n");
+    log_info("Total data sent: %ld bytes in %d run(s); Total retransmissions: %ld\n", totalDataSent, runs, conn.retransmissions);
+    print_io_statistics(&conn.io, totalDataSent);
+    hist_print("Per-segment RTT (all runs)", &rttSamples);
+    hist_print("Retransmission-inflated samples (all runs)", &inflatedSamples);
 
     // Close RUDP connection and exit
-    if (rudp_close(sock, &receiver, isSender) != 0)       // Force the Sender to send FIN before closing socket
+    if (rudp_close(&conn, isSender) != 0)       // Force the Sender to send FIN before closing socket
     {
-        print_time("Failed to close the connection properly\n");
+        log_error("Failed to close the connection properly\n");
     }
-    print_time("Connection closed successfully\n");
+    pipeline_free(&pipeline);
+    bench_close(&bench);
+    log_info("Connection closed successfully\n");
 
     return 0;
 }
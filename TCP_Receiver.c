@@ -10,20 +10,185 @@
 #include <sys/time.h>       // For getting timestamps
 #include <time.h>           // For getting timestamps
 #include <stdbool.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>        // For the worker pool
+#include <sys/epoll.h>      // For multiplexing the connections
+#include <sys/eventfd.h>    // For the workers' "connection done" notifications
+#include <endian.h>
+#include "IO_Uring.h"
+#include "Payload.h"
+#include "Digest.h"
+#include "Bench.h"
+#include "Histogram.h"
+#include "Timing.h"
+#include "Log.h"
+#include "Metrics.h"
 
 
 // Define constants for the Receiver
 #define BUFFER_SIZE 2097152 // Default size of the data packet sent by the sender (2MB in bytes)
-#define MAX_CLIENTS 1       // Maximum senders to handle parallelly
+#define MAX_CLIENTS 64      // Backlog of connections waiting to be accepted
 #define MAX_RUNS 10         // Initial number of processing requests one after the other (we will use dynamic allocation if needed)
+#define MAX_EVENTS 64       // epoll(7) events handled per epoll_wait(2)
+#define READ_BUDGET 1048576 // Bytes read from one connection per event before the others get their turn
+#define SINK_BLOCK_SIZE 1048576 // Bytes coalesced into one write(2) by the workers (1MB, page-aligned)
+#define SINK_BLOCKS 16          // Blocks in flight between the event loop and the workers (shared by all connections)
+#define URING_CHUNK 262144      // Bytes per linked receive + write pair of the io_uring engine
+#define URING_DEPTH 4           // Registered buffers of the io_uring engine (writes in flight behind the receive)
+#define STRIPE_MAGIC "STRP"     // First bytes of the hello of a striped transfer's stream (sender's -P)
+#define SIZE_MAGIC "SIZE"       // First bytes of the hello announcing a run size other than BUFFER_SIZE (sender's -size)
+
+
+// Ways to move the received stream to disk
+typedef enum {
+    ENGINE_SINK,                // epoll(7) loop reads every connection into blocks the workers write
+    ENGINE_URING                // io_uring: a worker drives each connection, every receive linked to the write of its buffer
+} Recv_Engine;
+
+// io_uring engine of the receiver: the ring and its registered buffers
+typedef struct {
+    IO_Uring ring;
+    char *buffers;              // URING_DEPTH registered buffers of URING_CHUNK bytes
+} Recv_Uring;
+
+// Hello a sender's stream sends first in a striped transfer (-P N): which transfer, and which byte range of every run
+typedef struct {
+    char magic[4];              // STRIPE_MAGIC
+    uint32_t session;           // Random ID shared by the streams of one transfer
+    uint16_t index;             // The stream's number (0-based): it carries range "index" of every run
+    uint16_t count;             // Number of streams (ranges) the runs are split into
+} Stripe_Hello;
+
+// Hello a sender's stream sends first when its runs are not BUFFER_SIZE bytes (-size)
+typedef struct {
+    char magic[4];              // SIZE_MAGIC
+    uint32_t reserved;
+    uint64_t size;              // Bytes of every run (network byte order)
+} Size_Hello;
+
+// A run being written; the last holder (event loop or a job) closes and verifies its file
+typedef struct Run {
+    int connection;             // Number of the connection (or of the session's first stream) the run came from
+    int number;                 // Run number within the connection
+    long size;                  // Bytes of the run
+    int fd;                     // The run's file
+    int refs;                   // Holders of the run: the event loop while receiving (per stream, plus the session's), plus one per queued job
+    bool complete;              // Set when the whole run was received (an aborted run is not verified)
+    bool failed;                // Set if a write(2) failed
+    bool corrupt;               // Set if the digest the sender sent after its data (a stream's range) did not match
+    int stripesDone;            // Striped run: streams that received their whole range
+    uint64_t start;             // Striped run: arrival (ns) of its first byte on any stream
+    struct Run *next;           // Striped run: next run of the session still being received
+} Run;
+
+// Per-run statistics of a connection or a striped session
+typedef struct {
+    int runs;                   // Runs completed
+    int maxRuns;                // Capacity of the arrays
+    double *runTimes;           // Duration (ms) of every completed run
+    double *runSpeeds;          // Throughput of every completed run
+    long totalData;             // Bytes received across all runs
+    Histogram gaps;             // Time between consecutive chunks of a run (ns), across all runs
+} Run_Stats;
+
+// A striped transfer: the streams a sender opened with -P, reassembled by offset into one file per run
+typedef struct Session {
+    uint32_t key;               // The hello's session ID
+    int number;                 // Number of the session's first connection (names the files)
+    int streams;                // Number of streams
+    long runSize;               // Bytes of every run (all streams together)
+    int joined;                 // Streams connected so far
+    int closed;                 // Streams closed so far
+    Run *runs;                  // Runs not all streams finished yet (each holds one reference for the session)
+    Run_Stats stats;            // Aggregate statistics (all streams together)
+    struct Session *next;
+} Session;
+
+// A connection and its own run counters and statistics
+typedef struct {
+    int fd;                     // The connection's socket
+    int id;                     // Connection number, in accept order
+    struct sockaddr_in addr;    // The sender's address
+    Run *run;                   // Run being received (NULL between runs)
+    long runSize;               // Bytes of every run of the connection (of the whole run, for a stream)
+    long left;                  // Bytes left to receive to complete the current run
+    long fileSize;              // Bytes of the current run received so far
+    int recvCalls;              // recv(2) calls of the current run
+    uint64_t lastChunk;         // Arrival (ns) of the current run's latest chunk (0: none yet)
+    uint64_t start;             // Arrival (ns) of the current run's first byte
+    char *block;                // Block being filled (NULL if none)
+    size_t filled;              // Bytes already received into "block"
+    long blockOffset;           // File offset of "block"
+    Digest digest;              // Digest of the current run (or range), hashed as it arrives
+    unsigned char trailer[DIGEST_SIZE]; // The sender's digest, sent after the run's data
+    int trailerBytes;           // Bytes of the trailer received so far
+    bool identified;            // Set once the first bytes told a plain connection from a stream of a striped transfer
+    Session *session;           // Striped transfer the connection is a stream of (NULL if none)
+    int stripe;                 // The stream's number within its session
+    Run_Stats stats;            // Statistics of the connection's runs
+    Metrics_Block *metrics;     // Live counters of the connection (-metrics)
+} Connection;
+
+// Work handed to the pool
+typedef enum {
+    JOB_WRITE,                  // Write a block at its offset in a run's file
+    JOB_RELEASE,                // Drop the event loop's hold on a completed or aborted run
+    JOB_SERVE                   // Drive a whole connection with the io_uring engine
+} Job_Type;
+
+typedef struct Job {
+    Job_Type type;
+    Run *run;                   // JOB_WRITE, JOB_RELEASE: the run
+    char *block;                // JOB_WRITE: the block (returned to the pool once written)
+    size_t length;              // JOB_WRITE: bytes to write
+    long offset;                // JOB_WRITE: file offset of the block
+    Connection *conn;           // JOB_SERVE: the connection
+    struct Job *next;
+} Job;
+
+// Worker pool, sized to the core count: it writes and verifies the runs of every connection
+typedef struct {
+    pthread_t *threads;         // The workers
+    int workers;                // Number of workers
+    pthread_mutex_t lock;       // Protects everything below
+    pthread_cond_t notEmpty;    // Signaled when a job is queued (or on shutdown)
+    pthread_cond_t blockFree;   // Signaled when a worker returns a block
+    Job *head, *tail;           // FIFO of jobs
+    char *freeBlocks[SINK_BLOCKS];  // Blocks ready to be filled
+    int freeCount;              // Number of free blocks
+    bool stop;                  // Set to end the workers once the queue is empty
+    long writes;                // write(2) calls made by the workers
+    long received;              // Bytes of the completed runs of every closed connection
+    int doneFd;                 // eventfd(2) counting connections finished by the workers
+    const char *algo;           // Congestion control algorithm (for the statistics)
+} Worker_Pool;
+
+static uint64_t verify_seed;            // The senders' payload seed (-seed), to verify runs without their files
+static bool verify_seeded = false;      // Set if -seed was given
+static Bench bench;                     // Warm-up runs and the per-run report (-warmup, -report, -format)
 
 
 // Declaration of auxiliary functions (see full implementation below)
-double time_diff(struct timeval x, struct timeval y);
-void print_statistics(double *run_times, double *run_speeds, int runs, int totalDataSize, const char *algo);
-void save_data_as_txt(const char *data, int size, int run_number);
-void print_time(const char *format, ...);
-int compare_files(const char *file1, const char *file2);
+void record_gap(Histogram *gaps, uint64_t *last);
+void print_statistics(double *run_times, double *run_speeds, int runs, long totalDataSize, const char *algo, const Histogram *gaps);
+int pool_init(Worker_Pool *pool, int workers, const char *algo);
+void pool_submit(Worker_Pool *pool, Job job);
+char *pool_block(Worker_Pool *pool);
+void pool_destroy(Worker_Pool *pool);
+void run_release(Worker_Pool *pool, Run *run);
+Connection *connection_new(int fd, int id, const struct sockaddr_in *addr);
+int connection_read(Worker_Pool *pool, Connection *conn);
+bool connection_finish(Worker_Pool *pool, Connection *conn);
+static void connection_reset_run(Connection *conn);
+static void connection_end_run(Worker_Pool *pool, Connection *conn);
+int stats_init(Run_Stats *stats);
+bool stats_add(Run_Stats *stats, double dt, long size);
+void stats_free(Run_Stats *stats);
+void serve_connection_uring(Worker_Pool *pool, Connection *conn);
+int uring_engine_init(Recv_Uring *engine);
+void uring_engine_free(Recv_Uring *engine);
+int receive_run_uring(Recv_Uring *engine, int sock, const char *filename, long size, long *fileSize, int *receives, int *writes, Digest *digest, uint64_t *expected, Histogram *gaps, Metrics_Block *metrics);
 
 
 /*Main function for TCP receiver.*/
@@ -35,14 +200,19 @@ int main(int argc, char *argv[])
     /*    Validate Command-Line Arguments     */
     /*----------------------------------------*/
 
-    if (argc != 5)
+    if (argc < 5 || argc % 2 == 0)
     {
-        print_time("ERROR! Usage: %s -p PORT -algo ALGO\n", argv[0]);
+        log_error("ERROR! Usage: %s -p PORT -algo ALGO [-engine sink|uring] [-clients N] [-workers N] [-seed SEED] [-warmup N] [-report FILE] [-format csv|json] [-log LEVEL] [-metrics 0|1]\n", argv[0]);
         return 1;
     }
 
     const char *algo = NULL;        // To store the congestion control algorithm name
     int port;                       // To store the port number
+    const char *engine_name = "sink";   // How the received data reaches the disk
+    int clients = 1;                // Connections to serve before exiting (0 = serve forever)
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);    // Worker pool size (one per core by default)
+    int applied;                    // 1 if a shared option parser took the flag, -1 if it rejected the value
+    bench_init(&bench, BUFFER_SIZE);
 
     // Parsing command-line arguments to get port and algorithm
     for (int i = 1; i < argc; i += 2)
@@ -51,17 +221,55 @@ int main(int argc, char *argv[])
             port = atoi(argv[i + 1]);
         else if (strcmp(argv[i], "-algo") == 0)
             algo = argv[i + 1];
+        else if (strcmp(argv[i], "-engine") == 0)
+            engine_name = argv[i + 1];
+        else if (strcmp(argv[i], "-clients") == 0)
+            clients = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-workers") == 0)
+            workers = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-seed") == 0)
+        {
+            verify_seed = strtoull(argv[i + 1], NULL, 0);
+            verify_seeded = true;
+        }
+        else if ((applied = bench_option(&bench, argv[i], argv[i + 1])) != 0 || (applied = log_option(argv[i], argv[i + 1])) != 0 ||
+                 (applied = metrics_option(argv[i], argv[i + 1])) != 0)
+        {
+            if (applied < 0)
+                return 1;
+        }
+        else
+        {
+            log_error("ERROR! Usage: %s -p PORT -algo ALGO [-engine sink|uring] [-clients N] [-workers N] [-seed SEED] [-warmup N] [-report FILE] [-format csv|json] [-log LEVEL] [-metrics 0|1]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    Recv_Engine engine;
+    if (strcmp(engine_name, "sink") == 0)           engine = ENGINE_SINK;
+    else if (strcmp(engine_name, "uring") == 0)     engine = ENGINE_URING;
+    else
+    {
+        log_error("ERROR: Unknown engine '%s' (available: sink, uring)\n", engine_name);
+        return 1;
     }
 
     // Validate that server_port has been properly assigned
     if (port <= 0)
     {
-        print_time("ERROR: Invalid port number\n");         
+        log_error("ERROR: Invalid port number\n");         
+        return 1;
+    }
+    if (clients < 0 || workers < 1)
+    {
+        log_error("ERROR: Invalid number of clients or workers\n");
         return 1;
     }
-    printf("\n");
-    print_time("Arguments for connection were received successfully\n");
-    // print_time("Port number set to %d\n", port);                          // ~~INTERNAL CHECK: Port number validity ~~ //
+    if (bench_open(&bench) < 0 || metrics_open(argv[0]) < 0)
+        return 1;
+    log_plain("\n");
+    log_info("Arguments for connection were received successfully\n");
+    // log_info("Port number set to %d\n", port);                          // ~~INTERNAL CHECK: Port number validity ~~ //
 
     /*----------------------------------------*/
     /*                Main Code               */
@@ -69,15 +277,15 @@ int main(int argc, char *argv[])
 
     // Create a TCP socket (IPv4, stream-based, default protocol)
     int sock = -1;
-    sock = socket(AF_INET, SOCK_STREAM, 0);
+    sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
     if (sock < 0)
     {
         perror("socket(2)");
         return 1;
     }
-    print_time("Receiver's TCP socket opened successfully\n");
+    log_info("Receiver's TCP socket opened successfully\n");
 
-    // Set congestion control algorithm
+    // Set congestion control algorithm (accepted connections inherit it)
     if (algo != NULL)
     {
         if (setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, algo, strlen(algo) + 1) != 0)
@@ -88,12 +296,13 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Allow a quick restart while earlier connections linger in TIME_WAIT
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
     // Initialize structures for receiver and sender addresses
     struct sockaddr_in receiver;            // A variable to store the receiver's address
-    struct sockaddr_in sender;              // A variable to store the sender's address
-    socklen_t sender_len = sizeof(sender);  // A variable that stores the sender's structure length
     memset(&receiver, 0, sizeof(receiver)); // Reset the receiver structures to zeros
-    memset(&sender, 0, sender_len);         // Reset the sender structures to zeros
 
     // Set receiver address to accept any IP and the specified port
     receiver.sin_family = AF_INET;         // Set the receiver's address family to AF_INET (IPv4)
@@ -107,7 +316,7 @@ int main(int argc, char *argv[])
         close(sock);
         return 1;
     }
-    print_time("TCP receiver's socket binds successfully\n");
+    log_info("TCP receiver's socket binds successfully\n");
 
     // Listen for incoming connections
     if (listen(sock, MAX_CLIENTS) < 0)
@@ -116,173 +325,113 @@ int main(int argc, char *argv[])
         close(sock);
         return 1;
     }
-    print_time("Waiting for incoming TCP connection on port %d...\n", port);
 
-    // Accept a new connetion with a sender
-    int sender_sock = accept(sock, (struct sockaddr *)&sender, &sender_len);
-    if (sender_sock < 0)
+    // Start the worker pool that writes and verifies the runs of every connection
+    Worker_Pool pool;
+    if (pool_init(&pool, workers, algo) < 0)
     {
-        perror("accept(2)");
+        log_error("ERROR: Failed to start the worker pool!\n");
         close(sock);
         return 1;
     }
-    print_time("Connection established with Sender %s:%d using %s\n", inet_ntoa(sender.sin_addr), ntohs(sender.sin_port), algo);
 
-    // Allocate a buffer for incoming data
-    char *buffer = (char *)calloc(BUFFER_SIZE, sizeof(char));
-    if (buffer == NULL)
+    // One epoll instance watches the listening socket, every connection and the workers' notifications
+    int epfd = epoll_create1(0);
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};          // NULL: the listening socket
+    struct epoll_event done_event = {.events = EPOLLIN, .data.ptr = &pool};    // &pool: connections finished by workers
+    if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &event) < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, pool.doneFd, &done_event) < 0)
     {
-        print_time("Failed to allocate memory for buffer");
+        perror("epoll(7)");
+        pool_destroy(&pool);
         close(sock);
         return 1;
     }
-    memset(buffer, 0, BUFFER_SIZE);     // Zero the buffer
+    log_info("Waiting for incoming TCP connections on port %d (engine: %s, %d worker(s))...\n", port, engine_name, pool.workers);
 
-    // Initialize variables for receiving data and calculating statistics
-    struct timeval start_time, end_time;                // Variables to store start and end times of data reception
-    memset(&start_time, 0, sizeof(start_time));         // Zero the structs
-    memset(&end_time, 0, sizeof(end_time));
-    
-    // Statistics variables
-    int max_runs = MAX_RUNS;
-    double *run_times = (double *)malloc(max_runs * sizeof(double));
-    double *run_speeds = (double *)malloc(max_runs * sizeof(double));
-    if (!run_times || !run_speeds) 
+    int accepted = 0;               // Connections accepted so far (numbers them)
+    int finished = 0;               // Connections done
+    struct epoll_event events[MAX_EVENTS];
+
+    // Event loop: accept new senders and read every connection that has data
+    while (clients == 0 || finished < clients)
     {
-        print_time("ERROR: Failed to allocate memory for run statistics!\n");
-        close(sock);
-        free(buffer);
-        return 1;
-    }
-    
-    int bytes_received;                                 // The number of bytes received in each recv() cyrcle
-    long fileSize = 0;                                  // Tracks the size of the currently processed file 
-    long totalDataReceived = 0;                         // Accumulates total data received across all runs
-    int runs = 1;                                       // Counter for the number of receive cycles
-    bool exitFlag = false;                              // A flag to indicate if EXIT command is received
-
-    // Main loop for receiving up to MAX_RUNS of data transmissions from Sender
-    while (!exitFlag)
-    {   
-        // Check if reallocation in needed
-        if (runs >= max_runs - 1) 
-        { 
-            max_runs *= 2; 
-            run_times = (double *)realloc(run_times, max_runs * sizeof(double));
-            run_speeds = (double *)realloc(run_speeds, max_runs * sizeof(double));
-            if (!run_times || !run_speeds) 
-            {
-                print_time("ERROR: Failed to reallocate memory for run statistics!\n");
-                exitFlag = true;
-                break;
-            }
+        int ready = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (ready < 0)
+        {
+            if (errno == EINTR)     continue;
+            perror("epoll_wait(2)");
+            break;
         }
 
-        int left = BUFFER_SIZE;     // Bytes left to receive to complete the current file
-        int segmentNumber = 1;      // Segment number within the current run
-        bool exitFlag = false;      // A flag to indicate if EXIT command is received
-        fileSize = 0;               // Count the file size (ober all iteration)
-
-        printf("--------------------------------------------\n");
-        
-        gettimeofday(&start_time, NULL);        // Record start time 
-        while (left > 0)                        // Iterate until all data for the current file is received or an EXIT command is encountered
-        {   
-            
-            // Receive data
-            bytes_received = recv(sender_sock, buffer, BUFFER_SIZE, 0);
-            // print_time("Bytes received: %d\n", bytes_received);           // ~~INTERNAL CHECK: bytes received in that iteration ~ //
-            
-            // Check for disconnect or error
-            if (bytes_received <= 0)
+        for (int i = 0; i < ready; i++)
+        {
+            // Connections the workers drove to the end (io_uring engine)
+            if (events[i].data.ptr == &pool)
             {
-                if (bytes_received == 0) print_time("Sender disconnected.\n");
-                else perror("recv(2)");
-                goto cleanup;
+                uint64_t count;
+                if (read(pool.doneFd, &count, sizeof(count)) == sizeof(count))
+                    finished += count;
+                continue;
             }
 
-            // Check for Exit command
-            if (strncmp(buffer, "EXIT", 4) == 0) 
-            {
-                print_time("EXIT command received. Exiting...\n");
-                exitFlag = true;        // Set flag to break out of loops
-                break;
-            }            
-
-            // Handle the bytes received
-            if (bytes_received > 0)
+            // Accept every pending connection
+            if (events[i].data.ptr == NULL)
             {
-                // Update counters and totals with the received data
-                fileSize += bytes_received;             // Add to current file size
-                left -= bytes_received;                 // Decrease remaining data size for current file
-                totalDataReceived += bytes_received;    // Add to accumulates total data received across all runs
+                while (true)
+                {
+                    struct sockaddr_in sender;
+                    socklen_t sender_len = sizeof(sender);
+                    int sender_sock = accept4(sock, (struct sockaddr *)&sender, &sender_len, engine == ENGINE_SINK ? SOCK_NONBLOCK : 0);
+                    if (sender_sock < 0)
+                    {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK)
+                            perror("accept(2)");
+                        break;
+                    }
+                    Connection *conn = connection_new(sender_sock, ++accepted, &sender);
+                    if (conn == NULL)
+                    {
+                        log_error("ERROR: Failed to allocate connection #%d!\n", accepted);
+                        close(sender_sock);
+                        finished++;
+                        continue;
+                    }
+                    log_info("Connection #%d established with Sender %s:%d using %s\n", conn->id, inet_ntoa(sender.sin_addr), ntohs(sender.sin_port), algo);
 
-                // Print details about the received segment
-                print_time("Received: Segment #%d\n", segmentNumber);
-                print_time("This segement contains %d bytes from the Sender %s:%d\n", bytes_received, inet_ntoa(sender.sin_addr), ntohs(sender.sin_port));
-                print_time("The amount of data saved by the Receiver (so far): %d\n", fileSize);
-                print_time("Remaining data to send on this run: %d\n", left);
-
-                save_data_as_txt(buffer, bytes_received, runs);     // Save received segment to a file
-                printf("----------\n");
-
-                segmentNumber++;        // Increment segment number for the next loop iteration
+                    // The io_uring engine hands the whole connection to a worker
+                    if (engine == ENGINE_URING)
+                    {
+                        pool_submit(&pool, (Job){.type = JOB_SERVE, .conn = conn});
+                        continue;
+                    }
+                    struct epoll_event conn_event = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = conn};
+                    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sender_sock, &conn_event) < 0)
+                    {
+                        perror("epoll_ctl(2)");
+                        finished += connection_finish(&pool, conn);
+                    }
+                }
+                continue;
             }
 
-        } 
-        gettimeofday(&end_time, NULL);                       // Record end time 
-        
-        // Update statistics if data received
-        if (fileSize > 0) 
-        {
-            double dt = ((end_time.tv_sec - start_time.tv_sec)*1000) + (((double)(end_time.tv_usec - start_time.tv_usec))/1000);
-            run_times[runs - 1] = dt;
-            run_speeds[runs - 1] = ((double)fileSize / 1024 / 1024) / (dt / 1000.0);    
-            runs++;     
-        }
-        
-        if (exitFlag)           break; // If EXIT command was received, exit the loop
-
-        print_time("Interim summury (Run #%d): %d bytes Sent/%d bytes received\n", runs - 1, totalDataReceived / (runs - 1), fileSize);
-        
-        // ~~INTERNAL CHECK: After receiving and saving a run, compare it to the generated file ~~ //
-        char generatedFileName[64];
-        snprintf(generatedFileName, sizeof(generatedFileName), "Generate_File_%d.txt", runs - 1);
-        char receivedFileName[64];
-        snprintf(receivedFileName, sizeof(receivedFileName), "Received_Data_Run_%d.txt", runs - 1);
-                
-        int filesIdentical = compare_files(receivedFileName, generatedFileName);
-        if (filesIdentical == 1) 
-        {
-            print_time("Identity files check (sent vs. received) for Run #%d: Files are identical.\n", runs - 1);
-        } 
-        else if (filesIdentical == 0) 
-        {
-            print_time("ERROR! Run #%d: Files are not identical.\n", runs - 1);
-        } 
-        else 
-        {
-                // Error handling if files couldn't be opened
-                print_time("ERROR! Run #%d: Could not open files for comparison.\n", runs - 1);
+            // Read what the connection has; it is done after EXIT or a disconnect
+            Connection *conn = events[i].data.ptr;
+            if (connection_read(&pool, conn) <= 0)
+            {
+                epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+                finished += connection_finish(&pool, conn);
+            }
         }
-
-        printf("--------------------------------------------\n");
-        print_time("Waiting to further incoming connections to come...\n");
-        
-        memset(buffer, 0, BUFFER_SIZE);     // Clear the buffer for the next run
     }
-    
-    // Cleanup and print statistics
-    cleanup:
-    print_statistics(run_times, run_speeds, runs, totalDataReceived, algo);
-    print_time("Closing connection and cleaning up...\n");
-    print_time("Receiver end.\n");
-    close(sock);            // Close Receiver's socket
-    close(sender_sock);     // Close Sender's socket
 
-    free(run_times);
-    free(run_speeds);
-    free(buffer);
+    // Let the workers finish every write and verification before summing up
+    pool_destroy(&pool);
+    log_plain("--------------------------------------------\n");
+    log_info("Served %d sender(s); %ld bytes received; %ld write(2) calls by the workers\n", finished, pool.received, pool.writes);
+    log_info("Receiver end.\n");
+    close(epfd);
+    close(sock);            // Close Receiver's socket
+    bench_close(&bench);
 
     return 0;
 }
@@ -292,112 +441,981 @@ int main(int argc, char *argv[])
 /*          Auxiliary functions           */
 /*----------------------------------------*/
 
-/*Calculates elapsed milliseconds between two time points*/
-double time_diff(struct timeval start, struct timeval end)
+/*A chunk arrived: record the gap since the previous one of the run*/
+void record_gap(Histogram *gaps, uint64_t *last)
 {
-    return (double)(end.tv_sec - start.tv_sec) * 1000.0 + (double)(end.tv_usec - start.tv_usec) / 1000.0;
+    uint64_t now = timing_now_ns();
+    if (*last)
+        hist_record(gaps, now - *last);
+    *last = now;
 }
 
-void print_statistics(double *run_times, double *run_speeds, int runs, int totalDataSize, const char *algo)
+void print_statistics(double *run_times, double *run_speeds, int runs, long totalDataSize, const char *algo, const Histogram *gaps)
 {
     if (runs <= 0)
     {
-        printf("No data to calculate statistics.\n");
+        log_plain("No data to calculate statistics.\n");
         return;
     }
 
     double total_time_ms = 0;                                   // Total time in milliseconds
     double totalDataSizeMB = totalDataSize / (1024.0 * 1024.0); // Convert bytes to MB
     
-    printf("--------------------------------------------\n");
-    printf("Detailed Run Statistics:\n");
+    log_plain("--------------------------------------------\n");
+    log_plain("Detailed Run Statistics:\n");
 
     // This loop prints individual run statistics
     for (int i = 0; i < runs - 1; ++i)
     {
         
         total_time_ms += run_times[i];
-        printf("Run #%d: RTT: %.3lf ms; Speed: %.3lf Mbps\n", i + 1, run_times[i], run_speeds[i]);
+        log_plain("Run #%d: Time: %.3lf ms; Speed: %.3lf Mbps\n", i + 1, run_times[i], run_speeds[i]);
     }
 
     double avg_throughput_MB_s = totalDataSizeMB / (total_time_ms / 1000.0); // Average throughput in Mpss
 
-    printf("--------------------------------------------\n");
-    printf("Overall Summary Statistics:\n");
-    printf("CC Algorithm: %s\n", algo ? algo : "Default");
-    printf("Number of RTT samples: %d\n", runs - 1);
-    printf("Overall Data Received: %.3lf MB\n", totalDataSizeMB);
-    printf("Average RTT: %.3lf ms\n", total_time_ms / runs);
-    printf("Average Throughput: %.3lf Mbps\n", avg_throughput_MB_s);
-    printf("Total Time: %.3lf ms\n", total_time_ms);
-    printf("---------------------------------------------------------\n");
+    log_plain("--------------------------------------------\n");
+    log_plain("Overall Summary Statistics:\n");
+    log_plain("CC Algorithm: %s\n", algo ? algo : "Default");
+    log_plain("Number of runs: %d\n", runs - 1);
+    log_plain("Overall Data Received: %.3lf MB\n", totalDataSizeMB);
+    log_plain("Average run time: %.3lf ms\n", total_time_ms / (runs - 1));
+    log_plain("Average Throughput: %.3lf Mbps\n", avg_throughput_MB_s);
+    log_plain("Total Time: %.3lf ms\n", total_time_ms);
+    if (gaps)
+        hist_print("Chunk arrival gaps", gaps);
+    log_plain("---------------------------------------------------------\n");
 }
 
-/*This function gets data and saves it to a file (with append mode)*/
-void save_data_as_txt(const char *data, int size, int run_number)
+/* Worker: runs the queued jobs until the pool stops    */
+/* and its queue is empty                               */
+static void *pool_worker(void *arg)
 {
-    char filename[50];
-    sprintf(filename, "Received_Data_Run_%d.txt", run_number);
-    FILE *file = fopen(filename, "a");
-    if (!file)
+    Worker_Pool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true)
     {
-        perror("Failed to open file");
+        while (pool->head == NULL && !pool->stop)
+            pthread_cond_wait(&pool->notEmpty, &pool->lock);
+        if (pool->head == NULL)
+            break;
+        Job *job = pool->head;
+        pool->head = job->next;
+        if (pool->head == NULL)
+            pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (job->type == JOB_WRITE)
+        {
+            // Write the whole block at its offset; blocks of one run may be written by several workers at once
+            long writes = 0;
+            for (size_t done = 0; done < job->length; )
+            {
+                ssize_t written = pwrite(job->run->fd, job->block + done, job->length - done, job->offset + done);
+                writes++;
+                if (written < 0)
+                {
+                    perror("write(2)");
+                    job->run->failed = true;
+                    break;
+                }
+                done += written;
+            }
+
+            pthread_mutex_lock(&pool->lock);
+            pool->freeBlocks[pool->freeCount++] = job->block;
+            pool->writes += writes;
+            pthread_cond_signal(&pool->blockFree);
+            pthread_mutex_unlock(&pool->lock);
+            run_release(pool, job->run);
+        }
+        else if (job->type == JOB_RELEASE)
+        {
+            run_release(pool, job->run);
+        }
+        else
+        {
+            serve_connection_uring(pool, job->conn);
+        }
+        free(job);
+
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* Allocate the pool's aligned blocks and start its     */
+/* workers. Returns 0 on success, -1 on failure         */
+int pool_init(Worker_Pool *pool, int workers, const char *algo)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->algo = algo;
+    pool->doneFd = eventfd(0, EFD_NONBLOCK);
+    pool->threads = calloc(workers, sizeof(pthread_t));
+    if (pool->doneFd < 0 || pool->threads == NULL)
+    {
+        pool_destroy(pool);
+        return -1;
+    }
+    for (int i = 0; i < SINK_BLOCKS; i++)
+    {
+        if (posix_memalign((void **)&pool->freeBlocks[i], 4096, SINK_BLOCK_SIZE) != 0)
+        {
+            pool_destroy(pool);
+            return -1;
+        }
+        pool->freeCount++;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->notEmpty, NULL);
+    pthread_cond_init(&pool->blockFree, NULL);
+    for (int i = 0; i < workers; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0)
+        {
+            pool_destroy(pool);
+            return -1;
+        }
+        pool->workers++;
+    }
+    return 0;
+}
+
+/* Queue a job for the workers                          */
+void pool_submit(Worker_Pool *pool, Job job)
+{
+    Job *queued = malloc(sizeof(Job));
+    if (queued == NULL)
+    {
+        log_error("ERROR: Failed to queue a job!\n");
         return;
     }
-    fwrite(data, 1, size, file);
-    fclose(file);
-    print_time("Data from this segment for Run #%d appented and saved to %s\n", run_number, filename);
+    *queued = job;
+    queued->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail)     pool->tail->next = queued;
+    else                pool->head = queued;
+    pool->tail = queued;
+    pthread_cond_signal(&pool->notEmpty);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Take a free block, waiting for the workers if all of */
+/* them are queued                                      */
+char *pool_block(Worker_Pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->freeCount == 0)
+        pthread_cond_wait(&pool->blockFree, &pool->lock);
+    char *block = pool->freeBlocks[--pool->freeCount];
+    pthread_mutex_unlock(&pool->lock);
+    return block;
+}
+
+/* Return a block that was not handed to a job          */
+static void pool_return_block(Worker_Pool *pool, char *block)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->freeBlocks[pool->freeCount++] = block;
+    pthread_cond_signal(&pool->blockFree);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Run the queued jobs to the end, stop the workers and */
+/* release the blocks                                   */
+void pool_destroy(Worker_Pool *pool)
+{
+    if (pool->workers > 0)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pool->stop = true;
+        pthread_cond_broadcast(&pool->notEmpty);
+        pthread_mutex_unlock(&pool->lock);
+        for (int i = 0; i < pool->workers; i++)
+            pthread_join(pool->threads[i], NULL);
+        pool->workers = 0;
+    }
+    for (int i = 0; i < pool->freeCount; i++)
+        free(pool->freeBlocks[i]);
+    pool->freeCount = 0;
+    free(pool->threads);
+    pool->threads = NULL;
+    if (pool->doneFd >= 0)
+        close(pool->doneFd);
+    pool->doneFd = -1;
+}
+
+/* Print the verdict on a received run: the digests     */
+/* compared as it arrived, and, given the sender's      */
+/* seed, its file checked against the regenerated       */
+/* payload                                              */
+static void verify_run(int connection, int run, const char *receivedFileName, long size, bool corrupt)
+{
+    // ~~INTERNAL CHECK: After receiving and saving a run, compare it to what was sent ~~ //
+    int filesIdentical = !corrupt;
+    if (filesIdentical && verify_seeded)
+        filesIdentical = payload_verify_file(receivedFileName, size, payload_run_seed(verify_seed, run));
+    if (filesIdentical == 1)
+        log_info("Connection #%d: Identity files check (sent vs. received) for Run #%d: Files are identical.\n", connection, run);
+    else if (filesIdentical == 0)
+        log_error("ERROR! Connection #%d, Run #%d: Files are not identical.\n", connection, run);
+    else
+        log_error("ERROR! Connection #%d, Run #%d: Could not open the file for verification.\n", connection, run);
 }
 
-/*This fucntions helps to show time while printing to terminal*/
-void print_time(const char *format, ...)
+/* Name of the file a connection's run is saved to      */
+static void run_file_name(char *name, size_t size, int connection, int run)
 {
-    char formatted_time[9]; // Buffer for HH:MM:SS format
-    va_list args;
-    time_t now = time(NULL);
+    snprintf(name, size, "Received_Data_Conn_%d_Run_%d.txt", connection, run);
+}
 
-    struct tm *tm_info = localtime(&now); // Take current time
+/* Drop one hold on a run; the last holder closes its   */
+/* file and verifies it if the run was complete         */
+void run_release(Worker_Pool *pool, Run *run)
+{
+    if (__atomic_sub_fetch(&run->refs, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
 
-    strftime(formatted_time, sizeof(formatted_time), "%H:%M:%S", tm_info); // Format current time to HH:MM:SS
-    va_start(args, format);                                                // Start processing variable arguments
-    printf("[%s] ", formatted_time);                                       // Print the current time prefix
-    vprintf(format, args);                                                 // Print the rest of the message with format and args
-    va_end(args);                                                          // Clean up
+    if (close(run->fd) < 0)
+        run->failed = true;
+    if (run->failed)
+    {
+        log_error("ERROR: Failed to write the data of connection #%d, run #%d!\n", run->connection, run->number);
+    }
+    else if (run->complete)
+    {
+        char receivedFileName[64];
+        run_file_name(receivedFileName, sizeof(receivedFileName), run->connection, run->number);
+        verify_run(run->connection, run->number, receivedFileName, run->size, run->corrupt);
+    }
+    free(run);
 }
 
-/*This functions compares two txt files*/
-int compare_files(const char *file1, const char *file2) 
+/* Allocate the state of an accepted connection         */
+Connection *connection_new(int fd, int id, const struct sockaddr_in *addr)
 {
-    FILE *fp1 = fopen(file1, "rb");
-    FILE *fp2 = fopen(file2, "rb");
-    if (fp1 == NULL || fp2 == NULL) 
+    Connection *conn = calloc(1, sizeof(Connection));
+    if (conn == NULL)
+        return NULL;
+    conn->fd = fd;
+    conn->id = id;
+    conn->addr = *addr;
+    conn->runSize = BUFFER_SIZE;
+    connection_reset_run(conn);
+    if (stats_init(&conn->stats) < 0)
     {
-        if (fp1) fclose(fp1);
-        if (fp2) fclose(fp2);
-        return -1; 
+        free(conn);
+        return NULL;
+    }
+    conn->metrics = metrics_claim(METRICS_TCP_RECEIVER, "connection=\"%d\"", id);
+    return conn;
+}
+
+/* Set up empty run statistics                          */
+/* Returns 0 on success, -1 on failure                  */
+int stats_init(Run_Stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->maxRuns = MAX_RUNS;
+    stats->runTimes = malloc(stats->maxRuns * sizeof(double));
+    stats->runSpeeds = malloc(stats->maxRuns * sizeof(double));
+    if (!stats->runTimes || !stats->runSpeeds)
+    {
+        stats_free(stats);
+        return -1;
+    }
+    return 0;
+}
+
+/* Record a completed run in the statistics, growing    */
+/* them when needed                                     */
+bool stats_add(Run_Stats *stats, double dt, long size)
+{
+    if (stats->runs == stats->maxRuns)
+    {
+        double *times = realloc(stats->runTimes, 2 * stats->maxRuns * sizeof(double));
+        if (times)  stats->runTimes = times;
+        double *speeds = realloc(stats->runSpeeds, 2 * stats->maxRuns * sizeof(double));
+        if (speeds) stats->runSpeeds = speeds;
+        if (!times || !speeds)
+        {
+            log_error("ERROR: Failed to reallocate memory for run statistics!\n");
+            return false;
+        }
+        stats->maxRuns *= 2;
+    }
+    stats->runTimes[stats->runs] = dt;
+    stats->runSpeeds[stats->runs] = ((double)size / 1024 / 1024) / (dt / 1000.0);
+    stats->runs++;
+    stats->totalData += size;
+    return true;
+}
+
+/* Release the statistics' arrays                       */
+void stats_free(Run_Stats *stats)
+{
+    free(stats->runTimes);
+    free(stats->runSpeeds);
+    stats->runTimes = stats->runSpeeds = NULL;
+}
+
+static Session *sessions = NULL;    // Striped transfers with streams still open (used by the event loop only)
+
+/* Add a stream to its striped transfer, starting the   */
+/* session with its first stream                        */
+static Session *session_join(const Stripe_Hello *hello, int connection, long runSize)
+{
+    uint32_t key = ntohl(hello->session);
+    int streams = ntohs(hello->count);
+
+    for (Session *session = sessions; session; session = session->next)
+    {
+        if (session->key == key && session->streams == streams && session->runSize == runSize && session->joined < streams)
+        {
+            session->joined++;
+            return session;
+        }
+    }
+
+    Session *session = calloc(1, sizeof(Session));
+    if (session == NULL || stats_init(&session->stats) < 0)
+    {
+        free(session);
+        return NULL;
+    }
+    session->key = key;
+    session->number = connection;
+    session->streams = streams;
+    session->runSize = runSize;
+    session->joined = 1;
+    session->next = sessions;
+    sessions = session;
+    return session;
+}
+
+/* The session's run "number": the first of its streams */
+/* to get there opens the file, which all of them write */
+/* their ranges into. Takes a hold for the stream       */
+static Run *session_run(Session *session, int number)
+{
+    Run **link = &session->runs;
+    for (; *link; link = &(*link)->next)
+    {
+        if ((*link)->number == number)
+        {
+            __atomic_add_fetch(&(*link)->refs, 1, __ATOMIC_ACQ_REL);
+            return *link;
+        }
+    }
+
+    Run *run = calloc(1, sizeof(Run));
+    char receivedFileName[64];
+    run_file_name(receivedFileName, sizeof(receivedFileName), session->number, number);
+    if (run == NULL || (run->fd = open(receivedFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        perror("Failed to open file");
+        free(run);
+        return NULL;
     }
+    run->connection = session->number;
+    run->number = number;
+    run->size = session->runSize;
+    run->refs = 2;                  // The session's hold while the run is listed, and the stream's
+    run->start = timing_now_ns();
+    *link = run;
+    return run;
+}
+
+/* A stream received its whole range of a run; after    */
+/* the last one the run is complete and its aggregate   */
+/* throughput is recorded                               */
+static void session_stripe_done(Worker_Pool *pool, Session *session, Run *run, uint64_t end_time)
+{
+    if (++run->stripesDone < session->streams)
+        return;
+
+    double dt = timing_ms(run->start, end_time);
+    stats_add(&session->stats, dt, session->runSize);
+    log_info("Session #%d, Run #%d: %ld bytes over %d streams in %.3lf ms (aggregate %.3lf Mbit/s)\n", session->number, run->number, session->runSize, session->streams, dt,
+             dt > 0 ? session->runSize * 8 / 1e6 / (dt / 1000.0) : 0.0);
+    bench_record(&bench, &(Bench_Record){.role = "receiver", .protocol = "tcp", .variant = pool->algo, .connection = session->number, .run = run->number,
+                                         .warmup = bench_is_warmup(&bench, run->number), .bytes = session->runSize, .ms = dt,
+                                         .rttMs = -1, .rttP50Ms = -1, .rttP99Ms = -1, .segments = -1, .retransmissions = -1, .syscalls = -1, .cpuMs = -1});
 
-    int isIdentical = 1;                    // A flag to identity
-    char ch1, ch2;
-    while (!feof(fp1) && !feof(fp2)) 
+    for (Run **link = &session->runs; *link; link = &(*link)->next)
     {
-        fread(&ch1, sizeof(char), 1, fp1);
-        fread(&ch2, sizeof(char), 1, fp2);
+        if (*link == run)
+        {
+            *link = run->next;
+            break;
+        }
+    }
+    run->complete = true;
+    pool_submit(pool, (Job){.type = JOB_RELEASE, .run = run});
+}
 
-        if (ch1 != ch2) 
+/* A stream closed; after the last one the session's    */
+/* aggregate statistics are printed and it is freed.    */
+/* Returns true if the session is done                  */
+static bool session_leave(Worker_Pool *pool, Session *session)
+{
+    if (++session->closed < session->streams)
+        return false;
+
+    log_plain("--------------------------------------------\n");
+    log_info("Session #%d (%d streams) closed after %d run(s)\n", session->number, session->streams, session->stats.runs);
+    print_statistics(session->stats.runTimes, session->stats.runSpeeds, session->stats.runs + 1, session->stats.totalData, pool->algo, &session->stats.gaps);
+
+    // Runs some stream never finished are dropped
+    while (session->runs)
+    {
+        Run *run = session->runs;
+        session->runs = run->next;
+        pool_submit(pool, (Job){.type = JOB_RELEASE, .run = run});
+    }
+    for (Session **link = &sessions; *link; link = &(*link)->next)
+    {
+        if (*link == session)
         {
-            isIdentical = 0;                // Files are not identical
+            *link = session->next;
             break;
         }
     }
+    stats_free(&session->stats);
+    free(session);
+    return true;
+}
+
+/* Get ready for the connection's next run: a stream of */
+/* a striped transfer receives its own byte range only  */
+static void connection_reset_run(Connection *conn)
+{
+    long first = 0, last = conn->runSize;
+    if (conn->session)
+    {
+        first = conn->runSize * conn->stripe / conn->session->streams;
+        last = conn->runSize * (conn->stripe + 1) / conn->session->streams;
+    }
+    conn->run = NULL;
+    conn->left = last - first;
+    conn->blockOffset = first;
+    conn->fileSize = 0;
+    conn->recvCalls = 0;
+    conn->lastChunk = 0;
+    conn->trailerBytes = 0;
+    digest_init(&conn->digest, 0);
+}
+
+/* Compare the digest of what arrived with the one its  */
+/* sender computed; a mismatch is reported at once      */
+static bool digest_check(int connection, int run, uint64_t received, uint64_t sent)
+{
+    if (received == sent)
+        return true;
+    log_error("ERROR! Connection #%d, Run #%d: Digest mismatch (sent %016llx, received %016llx)\n", connection, run, (unsigned long long)sent, (unsigned long long)received);
+    return false;
+}
+
+/* Take a Size_Hello off the connection, if its first  */
+/* bytes are one (BUFFER_SIZE-byte runs otherwise).     */
+/* Returns 1 once it is known whether one was sent, 0   */
+/* while it is still incomplete and -1 on error         */
+static int connection_read_size(Connection *conn, int flags)
+{
+    Size_Hello hello;
+    ssize_t peeked = recv(conn->fd, &hello, sizeof(hello), MSG_PEEK | flags);
+    if (peeked < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)  return 0;
+        perror("recv(2)");
+        return -1;
+    }
+
+    size_t compared = peeked < 4 ? peeked : 4;
+    if (peeked == 0 || memcmp(hello.magic, SIZE_MAGIC, compared) != 0)
+        return 1;
+    if (peeked < (ssize_t)sizeof(hello))
+        return 0;
+
+    if (recv(conn->fd, &hello, sizeof(hello), 0) != sizeof(hello))
+        return -1;
+    uint64_t size = be64toh(hello.size);
+    if (size == 0 || size > BENCH_MAX_SIZE)
+    {
+        log_error("ERROR: Connection #%d: Invalid run size %llu\n", conn->id, (unsigned long long)size);
+        return -1;
+    }
+    conn->runSize = size;
+    connection_reset_run(conn);
+    log_info("Connection #%d: Runs of %ld bytes\n", conn->id, conn->runSize);
+    return 1;
+}
+
+/* Tell a plain connection from a stream of a striped   */
+/* transfer by its first bytes (a Stripe_Hello, after   */
+/* the Size_Hello, if any).                             */
+/* Returns 1 once identified, 0 while the hello is      */
+/* still incomplete and -1 on error                     */
+static int connection_identify(Connection *conn)
+{
+    int status = connection_read_size(conn, 0);
+    if (status <= 0)
+        return status;
+
+    Stripe_Hello hello;
+    ssize_t peeked = recv(conn->fd, &hello, sizeof(hello), MSG_PEEK);
+    if (peeked < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)  return 0;
+        perror("recv(2)");
+        return -1;
+    }
 
-    // Check for any remaining bytes in either file
-    if (!feof(fp1) || !feof(fp2)) {
-        isIdentical = 0;                    // Files are not identical
+    size_t compared = peeked < 4 ? peeked : 4;
+    if (peeked == 0 || memcmp(hello.magic, STRIPE_MAGIC, compared) != 0)
+    {
+        conn->identified = true;        // A plain connection (or a disconnect, which the read reports)
+        return 1;
+    }
+    if (peeked < (ssize_t)sizeof(hello))
+        return 0;
+
+    if (recv(conn->fd, &hello, sizeof(hello), 0) != sizeof(hello))
+        return -1;
+    int index = ntohs(hello.index), count = ntohs(hello.count);
+    if (count < 1 || index >= count)
+    {
+        log_error("ERROR: Connection #%d: Invalid stripe %d of %d\n", conn->id, index, count);
+        return -1;
+    }
+    conn->session = session_join(&hello, conn->id, conn->runSize);
+    if (conn->session == NULL)
+    {
+        log_error("ERROR: Failed to allocate a session for connection #%d!\n", conn->id);
+        return -1;
+    }
+    conn->stripe = index;
+    conn->identified = true;
+    connection_reset_run(conn);
+    log_info("Connection #%d: Stream %d of %d of session #%d\n", conn->id, index + 1, count, conn->session->number);
+    return 1;
+}
+
+/* Hand the block being filled to the workers           */
+static void connection_flush_block(Worker_Pool *pool, Connection *conn)
+{
+    __atomic_add_fetch(&conn->run->refs, 1, __ATOMIC_ACQ_REL);
+    pool_submit(pool, (Job){.type = JOB_WRITE, .run = conn->run, .block = conn->block, .length = conn->filled, .offset = conn->blockOffset});
+    conn->blockOffset += conn->filled;
+    conn->block = NULL;
+    conn->filled = 0;
+}
+
+/* Read what a connection has (up to READ_BUDGET bytes, */
+/* so one busy sender cannot starve the others) into    */
+/* blocks for the workers. A run's file is opened by    */
+/* its first bytes and handed over once complete; the   */
+/* streams of a striped transfer write their ranges of  */
+/* one shared file by offset.                           */
+/* Returns 1 while the connection stays open, 0 after   */
+/* EXIT or a disconnect and -1 on error                 */
+int connection_read(Worker_Pool *pool, Connection *conn)
+{
+    if (!conn->identified)
+    {
+        int status = connection_identify(conn);
+        if (status <= 0)
+            return status == 0 ? 1 : -1;
     }
 
-    fclose(fp1);
-    fclose(fp2);
+    for (long budget = READ_BUDGET; budget > 0; )
+    {
+        // Receive data straight into the current block, or, once the run's data is in, its sender's digest
+        bool trailer = conn->run != NULL && conn->left == 0;
+        char *target;
+        size_t space;
+        if (trailer)
+        {
+            target = (char *)conn->trailer + conn->trailerBytes;
+            space = sizeof(conn->trailer) - conn->trailerBytes;
+        }
+        else
+        {
+            if (conn->block == NULL)
+                conn->block = pool_block(pool);
+            target = conn->block + conn->filled;
+            space = SINK_BLOCK_SIZE - conn->filled;
+            if ((long)space > conn->left)
+                space = conn->left;     // Never read past the end of the current run (or range)
+        }
+        ssize_t bytes_received = recv(conn->fd, target, space, 0);
+
+        // Check for disconnect or error
+        if (bytes_received < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)    return 1;
+            if (errno == EINTR)                             continue;
+            perror("recv(2)");
+            return -1;
+        }
+        if (bytes_received == 0)
+        {
+            log_info("Connection #%d: Sender disconnected.\n", conn->id);
+            return 0;
+        }
+
+        if (trailer)
+        {
+            conn->trailerBytes += bytes_received;
+            if (conn->trailerBytes == sizeof(conn->trailer))
+                connection_end_run(pool, conn);
+            continue;
+        }
+
+        if (conn->run == NULL)
+        {
+            // Check for Exit command
+            if (bytes_received >= 4 && strncmp(conn->block, "EXIT", 4) == 0)
+            {
+                log_info("Connection #%d: EXIT command received.\n", conn->id);
+                return 0;
+            }
+
+            // The run's file is opened once, by its first bytes
+            Run *run;
+            if (conn->session)
+            {
+                run = session_run(conn->session, conn->stats.runs + 1);
+                if (run == NULL)
+                    return -1;
+            }
+            else
+            {
+                run = calloc(1, sizeof(Run));
+                char receivedFileName[64];
+                run_file_name(receivedFileName, sizeof(receivedFileName), conn->id, conn->stats.runs + 1);
+                if (run == NULL || (run->fd = open(receivedFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+                {
+                    perror("Failed to open file");
+                    free(run);
+                    return -1;
+                }
+                run->connection = conn->id;
+                run->number = conn->stats.runs + 1;
+                run->size = conn->runSize;
+                run->refs = 1;          // The event loop's hold, until the run is complete
+            }
+            conn->run = run;
+            conn->start = timing_now_ns();
+        }
+
+        // Hash the data as it arrives, and update counters with it
+        digest_update(&conn->digest, target, bytes_received);
+        conn->recvCalls++;
+        record_gap(&conn->stats.gaps, &conn->lastChunk);
+        conn->filled += bytes_received;
+        conn->fileSize += bytes_received;
+        conn->left -= bytes_received;
+        metrics_add(conn->metrics, METRIC_BYTES, bytes_received);
+        metrics_tcp_info(conn->metrics, conn->fd);
+        budget -= bytes_received;
+
+        // A full block, or the end of the run, goes to the workers
+        if (conn->filled == SINK_BLOCK_SIZE || conn->left == 0)
+            connection_flush_block(pool, conn);
+    }
+    return 1;
+}
+
+/* The run's data and its sender's digest are in:       */
+/* record the run and hand it over to the workers       */
+static void connection_end_run(Worker_Pool *pool, Connection *conn)
+{
+    uint64_t end_time = timing_now_ns();
+    double dt = timing_ms(conn->start, end_time);
+    stats_add(&conn->stats, dt, conn->fileSize);
+    metrics_add(conn->metrics, METRIC_RUNS, 1);
+    log_info("Connection #%d: Interim summury (Run #%d): %ld bytes received by %d recv(2) calls\n", conn->id, conn->stats.runs, conn->fileSize, conn->recvCalls);
+    if (conn->session == NULL)          // A striped run is reported once all its streams are in
+        bench_record(&bench, &(Bench_Record){.role = "receiver", .protocol = "tcp", .variant = pool->algo, .connection = conn->id, .run = conn->stats.runs,
+                                             .warmup = bench_is_warmup(&bench, conn->stats.runs), .bytes = conn->fileSize, .ms = dt,
+                                             .rttMs = -1, .rttP50Ms = -1, .rttP99Ms = -1, .segments = -1, .retransmissions = -1, .syscalls = conn->recvCalls, .cpuMs = -1});
+
+    uint64_t sent;
+    memcpy(&sent, conn->trailer, sizeof(sent));
+    if (!digest_check(conn->id, conn->stats.runs, digest_final(&conn->digest), be64toh(sent)))
+        conn->run->corrupt = true;
+
+    // The workers close and verify the file once its last block is written
+    if (conn->session)
+        session_stripe_done(pool, conn->session, conn->run, end_time);
+    else
+        conn->run->complete = true;
+    pool_submit(pool, (Job){.type = JOB_RELEASE, .run = conn->run});
+    connection_reset_run(conn);
+}
+
+/* Close a connection: an unfinished run is dropped,    */
+/* and the connection's statistics are printed.         */
+/* Returns true if its sender is done (for a stream of  */
+/* a striped transfer: once all its streams closed)     */
+bool connection_finish(Worker_Pool *pool, Connection *conn)
+{
+    if (conn->run)
+        pool_submit(pool, (Job){.type = JOB_RELEASE, .run = conn->run});
+    if (conn->block)
+        pool_return_block(pool, conn->block);
+
+    log_plain("--------------------------------------------\n");
+    log_info("Connection #%d with %s:%d closed after %d run(s)\n", conn->id, inet_ntoa(conn->addr.sin_addr), ntohs(conn->addr.sin_port), conn->stats.runs);
+    print_statistics(conn->stats.runTimes, conn->stats.runSpeeds, conn->stats.runs + 1, conn->stats.totalData, pool->algo, &conn->stats.gaps);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->received += conn->stats.totalData;
+    pthread_mutex_unlock(&pool->lock);
+
+    Session *session = conn->session;
+    if (session)
+        hist_merge(&session->stats.gaps, &conn->stats.gaps);
+    close(conn->fd);
+    metrics_release(conn->metrics);
+    stats_free(&conn->stats);
+    free(conn);
+    return session == NULL || session_leave(pool, session);
+}
+
+/* io_uring engine: a worker receives every run of the  */
+/* connection with its own ring, then closes it and     */
+/* tells the event loop                                 */
+void serve_connection_uring(Worker_Pool *pool, Connection *conn)
+{
+    Recv_Uring uring = {.ring = {.fd = -1}};
+    char magic[4];
+    if (connection_read_size(conn, MSG_WAITALL) < 0)
+        log_error("ERROR: Connection #%d: Failed to read the run size\n", conn->id);
+    else if (recv(conn->fd, magic, sizeof(magic), MSG_PEEK | MSG_WAITALL) == sizeof(magic) && memcmp(magic, STRIPE_MAGIC, sizeof(magic)) == 0)
+        log_error("ERROR: Connection #%d is a stream of a striped transfer (-P), which needs the sink engine\n", conn->id);
+    else if (uring_engine_init(&uring) < 0)
+        log_error("ERROR: Connection #%d: Failed to start the io_uring engine\n", conn->id);
+
+    while (uring.ring.fd >= 0)
+    {
+        char receivedFileName[64];
+        run_file_name(receivedFileName, sizeof(receivedFileName), conn->id, conn->stats.runs + 1);
+
+        long fileSize = 0;
+        int receives = 0, writes = 0;
+        long enterBefore = uring.ring.enterCalls;
+        uint64_t sent = 0;
+        uint64_t start_time = timing_now_ns();
+        digest_init(&conn->digest, 0);
+        int status = receive_run_uring(&uring, conn->fd, receivedFileName, conn->runSize, &fileSize, &receives, &writes, &conn->digest, &sent, &conn->stats.gaps, conn->metrics);
+        uint64_t end_time = timing_now_ns();
+        if (status == 0)
+            log_info("Connection #%d: EXIT command received.\n", conn->id);
+        if (status <= 0)
+            break;
+
+        double dt = timing_ms(start_time, end_time);
+        stats_add(&conn->stats, dt, fileSize);
+        metrics_add(conn->metrics, METRIC_RUNS, 1);
+        log_info("Connection #%d: Interim summury (Run #%d): %ld bytes received\n", conn->id, conn->stats.runs, fileSize);
+        log_info("Connection #%d, Run #%d: %d receives and %d writes in %ld io_uring_enter(2) calls\n", conn->id, conn->stats.runs, receives, writes, uring.ring.enterCalls - enterBefore);
+        bench_record(&bench, &(Bench_Record){.role = "receiver", .protocol = "tcp", .variant = pool->algo, .connection = conn->id, .run = conn->stats.runs,
+                                             .warmup = bench_is_warmup(&bench, conn->stats.runs), .bytes = fileSize, .ms = dt,
+                                             .rttMs = -1, .rttP50Ms = -1, .rttP99Ms = -1, .segments = -1, .retransmissions = -1, .syscalls = uring.ring.enterCalls - enterBefore, .cpuMs = -1});
+        bool corrupt = !digest_check(conn->id, conn->stats.runs, digest_final(&conn->digest), sent);
+        verify_run(conn->id, conn->stats.runs, receivedFileName, conn->runSize, corrupt);
+    }
+
+    uring_engine_free(&uring);
+    connection_finish(pool, conn);
+
+    uint64_t one = 1;
+    if (write(pool->doneFd, &one, sizeof(one)) < 0)
+        perror("write(2): eventfd");
+}
+
+/* Set up the receiver's ring and register its buffers */
+/* Returns 0 on success, -1 on failure                  */
+int uring_engine_init(Recv_Uring *engine)
+{
+    struct iovec registered[URING_DEPTH];
+
+    engine->buffers = aligned_alloc(4096, URING_DEPTH * URING_CHUNK);
+    if (engine->buffers == NULL || uring_init(&engine->ring, 2 * URING_DEPTH) < 0)
+    {
+        free(engine->buffers);
+        engine->buffers = NULL;
+        return -1;
+    }
+    for (int i = 0; i < URING_DEPTH; i++)
+        registered[i] = (struct iovec){engine->buffers + i * URING_CHUNK, URING_CHUNK};
+    if (uring_register_buffers(&engine->ring, registered, URING_DEPTH) < 0)
+    {
+        uring_engine_free(engine);
+        return -1;
+    }
+    return 0;
+}
+
+/* Release the receiver's ring and buffers              */
+void uring_engine_free(Recv_Uring *engine)
+{
+    if (engine->ring.fd >= 0)
+        uring_free(&engine->ring);
+    free(engine->buffers);
+    engine->buffers = NULL;
+}
+
+/* Receive one run of "size" bytes with io_uring. Every */
+/* receive is linked to a fixed-buffer write of its     */
+/* buffer at the file offset, so the write is issued by */
+/* the kernel as soon as the data is in; the next       */
+/* receive is submitted while earlier writes are still  */
+/* in flight. Returns 1 when the run was received, 0 on */
+/* an EXIT command and -1 on error or disconnect        */
+int receive_run_uring(Recv_Uring *engine, int sock, const char *filename, long size, long *fileSize, int *receives, int *writes, Digest *digest, uint64_t *expected, Histogram *gaps, Metrics_Block *metrics)
+{
+    IO_Uring *ring = &engine->ring;
+    unsigned lengths[URING_DEPTH];      // Bytes expected by the request using each buffer
+    bool busy[URING_DEPTH] = {false};   // Buffer still owned by a receive or write
+    bool receiving = false;             // A receive is in flight (only one at a time keeps the stream in order)
+    bool failed = false;
+    int next = 0;                       // Next buffer to receive into
+    long offset = 0;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+
+    // The first receive is not linked to a write: it may be the EXIT command
+    sqe = uring_get_sqe(ring);
+    uring_prep_recv(sqe, sock, engine->buffers, size < URING_CHUNK ? size : URING_CHUNK, 0);
+    if (uring_submit(ring, 1) < 0 || (cqe = uring_wait_cqe(ring)) == NULL)
+        return -1;
+    int first = cqe->res;
+    uring_cqe_seen(ring);
+    (*receives)++;
+    if (first <= 0)
+    {
+        if (first == 0) log_info("Sender disconnected.\n");
+        else            log_error("recv(2): %s\n", strerror(-first));
+        return -1;
+    }
+    if (first >= 4 && strncmp(engine->buffers, "EXIT", 4) == 0)
+        return 0;
+    digest_update(digest, engine->buffers, first);
+    metrics_add(metrics, METRIC_BYTES, first);
+    uint64_t lastChunk = 0;             // Arrival of the latest chunk, for the gaps between chunks
+    record_gap(gaps, &lastChunk);
+
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror("Failed to open file");
+        return -1;
+    }
+
+    // Write the first chunk; buffer 0 stays busy until it completes
+    sqe = uring_get_sqe(ring);
+    uring_prep_write_fixed(sqe, fd, engine->buffers, first, 0, 0);
+    sqe->user_data = 0;
+    lengths[0] = first;
+    busy[0] = true;
+    next = 1 % URING_DEPTH;
+    offset = first;
+
+    // user_data: buffer index * 2, plus 1 for a receive
+    while (offset < size || ring->inFlight > 0 || ring->queued > 0)
+    {
+        if (!failed && !receiving && offset < size && !busy[next])
+        {
+            unsigned length = (size - offset < URING_CHUNK) ? size - offset : URING_CHUNK;
+            char *buffer = engine->buffers + next * URING_CHUNK;
+
+            sqe = uring_get_sqe(ring);
+            uring_prep_recv(sqe, sock, buffer, length, MSG_WAITALL);
+            sqe->flags |= IOSQE_IO_LINK;        // A short receive cancels the write
+            sqe->user_data = next * 2 + 1;
+
+            sqe = uring_get_sqe(ring);
+            uring_prep_write_fixed(sqe, fd, buffer, length, offset, next);
+            sqe->user_data = next * 2;
+
+            lengths[next] = length;
+            busy[next] = true;
+            receiving = true;
+            offset += length;
+            next = (next + 1) % URING_DEPTH;
+        }
+        else if (failed && offset < size)
+        {
+            offset = size;                      // Stop receiving, only drain what is in flight
+        }
+        if (ring->inFlight == 0 && ring->queued == 0)
+            break;
+
+        // Submit anything prepared and wait for at least one completion
+        if (uring_submit(ring, 1) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+        while ((cqe = uring_peek_cqe(ring)) != NULL)
+        {
+            int index = cqe->user_data / 2;
+            bool isReceive = cqe->user_data % 2;
+            int result = cqe->res;
+            uring_cqe_seen(ring);
+
+            if (isReceive)
+            {
+                receiving = false;
+                (*receives)++;
+            }
+            else
+            {
+                busy[index] = false;
+                (*writes)++;
+            }
+            if (result == (int)lengths[index])
+            {
+                // Receives complete in order (one at a time): hash each buffer before its write frees it
+                if (isReceive)
+                {
+                    record_gap(gaps, &lastChunk);
+                    *fileSize += result;
+                    metrics_add(metrics, METRIC_BYTES, result);
+                    metrics_tcp_info(metrics, sock);
+                    digest_update(digest, engine->buffers + index * URING_CHUNK, result);
+                }
+                continue;
+            }
+
+            // A receive short of its chunk means the sender went away; the linked write is then canceled
+            if (!failed)
+            {
+                if (isReceive && result >= 0)   log_info("Sender disconnected.\n");
+                else if (result != -ECANCELED)  log_error("%s: %s\n", isReceive ? "recv(2)" : "write(2)", result < 0 ? strerror(-result) : "short write");
+            }
+            failed = true;
+        }
+    }
+
+    *fileSize += first;
+    if (close(fd) < 0)
+        failed = true;
+
+    // The sender's digest follows the run's data
+    uint64_t trailer = 0;
+    if (!failed && recv(sock, &trailer, sizeof(trailer), MSG_WAITALL) != sizeof(trailer))
+    {
+        log_info("Sender disconnected.\n");
+        failed = true;
+    }
+    *expected = be64toh(trailer);
+    return failed ? -1 : 1;
+}
 
-    return isIdentical;
-}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <stdarg.h>         // For variadic functions
 #include <arpa/inet.h>
@@ -8,15 +9,98 @@
 #include <netinet/tcp.h>    // For setting congestion control
 #include <time.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>   // For the zero-copy send paths
+#include <sys/resource.h>   // For the CPU time spent sending
+#include <sys/mman.h>       // For hashing the ranges the zero-copy paths send
+#include <endian.h>
+#include <pthread.h>        // For the parallel streams (-P)
+#include "IO_Uring.h"
+#include "Payload.h"
+#include "Digest.h"
+#include "Pipeline.h"
+#include "Bench.h"
+#include "Timing.h"
+#include "Log.h"
+#include "Metrics.h"
 
 
 // Define constants for the Sender
 #define DATA_SIZE 2097152      // Default size of the data packet sent by the sender (2MB in bytes)
+#define COPY_BUFFER_SIZE 4096  // Buffer of the copy send path (fread + send)
+#define SPLICE_CHUNK 65536     // Bytes moved per splice(2) call on the splice send path
+#define URING_CHUNK 262144     // Bytes per linked read + send pair on the io_uring send path
+#define URING_DEPTH 4          // Read + send pairs chained into one io_uring submission
+#define PIPE_SLOT_SIZE 262144  // Bytes per ring slot on the pipelined send path
+#define PIPE_SLOTS 8           // Ring slots per stream on the pipelined send path (a power of two)
+#define MAX_STREAMS 64         // Largest number of parallel streams (-P)
+#define STRIPE_MAGIC "STRP"    // First bytes of the hello every stream of a striped transfer sends
+#define SIZE_MAGIC "SIZE"      // First bytes of the hello announcing a run size other than DATA_SIZE (-size)
+
+
+// Ways to move a file into the socket
+typedef enum {
+    SEND_COPY,                 // fread(3) into a user buffer, then send(2): two copies per byte
+    SEND_SENDFILE,             // sendfile(2): page cache straight to the socket
+    SEND_SPLICE,               // splice(2) file -> pipe -> socket, no user-space copy
+    SEND_URING,                // io_uring: chains of fixed-buffer reads linked to sends, one system call per chain
+    SEND_PIPE                  // No file: a producer thread generates the payload into a ring drained by send(2)
+} Send_Mode;
+
+// io_uring engine of the sender: the ring and its registered buffers
+typedef struct {
+    IO_Uring ring;
+    char *buffers;             // URING_DEPTH registered buffers of URING_CHUNK bytes
+} Send_Uring;
+
+// Hello a stream sends first when the file is striped over several connections (-P N > 1)
+typedef struct {
+    char magic[4];             // STRIPE_MAGIC
+    uint32_t session;          // Random ID shared by the streams of this sender
+    uint16_t index;            // The stream's number (0-based): it carries range "index" of every file
+    uint16_t count;            // Number of streams
+} Stripe_Hello;
+
+// Hello every stream sends first when the runs are not DATA_SIZE bytes (-size)
+typedef struct {
+    char magic[4];             // SIZE_MAGIC
+    uint32_t reserved;
+    uint64_t size;             // Bytes of every run (network byte order)
+} Size_Hello;
+
+// One of the parallel connections, with the byte range of the file it sends
+typedef struct {
+    int sock;                  // The stream's connection
+    int index;                 // The stream's number
+    pthread_t thread;          // Thread sending the range
+    const char *filename;      // File of the current run
+    uint64_t seed;             // Payload seed of the current run (pipelined send path)
+    long offset;               // Start of the stream's range of the file
+    long length;               // Bytes in the range
+    Send_Mode mode;            // Send path
+    Send_Uring engine;         // The stream's own ring (io_uring send path)
+    Pipeline pipeline;         // The stream's producer and its ring (pipelined send path)
+    long sent;                 // Bytes sent in the current run (-1 on error)
+    long syscalls;             // System calls the current run took
+    double ms;                 // Duration of the current run
+    long totalSent;            // Bytes sent across all runs
+    double totalMs;            // Time spent sending across all runs
+    Metrics_Block *metrics;    // Live counters of the stream (-metrics)
+} Stream;
 
 
 // Auxiliary function declaration (see full implementation below)
-void util_generate_random_data_file(const char* filename, unsigned int size);
-void print_time(const char *format, ...);
+long send_file(int sock, const char *filename, long offset, long length, Send_Mode mode, Send_Uring *engine, long *syscalls, Metrics_Block *metrics, Digest *digest);
+int digest_file_range(int fd, long offset, long length, Digest *digest);
+long send_file_uring(int sock, int fd, long offset, long length, Send_Uring *engine, long *syscalls, Metrics_Block *metrics);
+long send_pipeline(int sock, Pipeline *pipeline, uint64_t seed, long offset, long length, long *syscalls, Metrics_Block *metrics, Digest *digest);
+int send_uring_init(Send_Uring *engine);
+void send_uring_free(Send_Uring *engine);
+int stream_connect(const struct sockaddr_in *receiver, const char *algo);
+void *stream_send(void *arg);
+double cpu_time_ms(const struct timeval *tv);
+void tcp_info_sample(const Stream *streams, int count, long *retransmissions, double *rtt_ms);
+void stream_metrics(Metrics_Block *metrics, int sock, long bytes);
 
 
 /*Main function for TCP sender.*/
@@ -28,15 +112,22 @@ int main(int argc, char *argv[])
     /*    Validate Command-Line Arguments     */
     /*----------------------------------------*/
 
-    if (argc != 7)
+    if (argc < 7 || argc % 2 == 0)
     {
-        print_time("Usage: %s -ip IP -p PORT -algo ALGO", argv[0]);
+        log_error("Usage: %s -ip IP -p PORT -algo ALGO [-send copy|sendfile|splice|uring|pipe] [-P STREAMS] [-seed SEED]"
+                  " [-size BYTES] [-runs N] [-warmup N] [-duration SECONDS] [-report FILE] [-format csv|json] [-log LEVEL] [-metrics 0|1]\n", argv[0]);
         return 1;
     }
 
     const char *receiver_ip = NULL;
     int receiver_port = 0;
     const char *algo = NULL;
+    const char *send_path = "copy";
+    int num_streams = 1;                        // Parallel connections every file is striped over
+    uint64_t seed = payload_random_seed();      // Seeds the payload of every run (a receiver given it verifies on its own)
+    int applied;                                // 1 if a shared option parser took the flag, -1 if it rejected the value
+    Bench bench;                                // Run size, number of runs and report
+    bench_init(&bench, DATA_SIZE);
 
     // Parsing command-line arguments
     for (int i = 1; i < argc; i+=2)
@@ -47,39 +138,59 @@ int main(int argc, char *argv[])
             receiver_port = atoi(argv[i + 1]);
         else if (strcmp(argv[i], "-algo") == 0)
             algo = argv[i + 1];
+        else if (strcmp(argv[i], "-send") == 0)
+            send_path = argv[i + 1];
+        else if (strcmp(argv[i], "-P") == 0)
+            num_streams = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-seed") == 0)
+            seed = strtoull(argv[i + 1], NULL, 0);
+        else if ((applied = bench_option(&bench, argv[i], argv[i + 1])) != 0 || (applied = log_option(argv[i], argv[i + 1])) != 0 ||
+                 (applied = metrics_option(argv[i], argv[i + 1])) != 0)
+        {
+            if (applied < 0)
+                return 1;
+        }
+        else
+        {
+            log_error("Usage: %s -ip IP -p PORT -algo ALGO [-send copy|sendfile|splice|uring|pipe] [-P STREAMS] [-seed SEED]"
+                      " [-size BYTES] [-runs N] [-warmup N] [-duration SECONDS] [-report FILE] [-format csv|json] [-log LEVEL] [-metrics 0|1]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Choose how the file contents reach the socket
+    Send_Mode mode;
+    if (strcmp(send_path, "copy") == 0)             mode = SEND_COPY;
+    else if (strcmp(send_path, "sendfile") == 0)    mode = SEND_SENDFILE;
+    else if (strcmp(send_path, "splice") == 0)      mode = SEND_SPLICE;
+    else if (strcmp(send_path, "uring") == 0)       mode = SEND_URING;
+    else if (strcmp(send_path, "pipe") == 0)        mode = SEND_PIPE;
+    else
+    {
+        log_error("ERROR: Unknown send path '%s' (available: copy, sendfile, splice, uring, pipe)\n", send_path);
+        return 1;
     }
 
     // Validate that both server_ip and server_port have been properly assigned
     if (receiver_ip == NULL || receiver_port <= 0)
     {
-        print_time("Usage: %s -ip IP -p PORT\n", argv[0]);
+        log_error("Usage: %s -ip IP -p PORT\n", argv[0]);
         return -1;
     }
-    printf("\n");
-    print_time("Arguments for connection were received successfully\n");
+    if (num_streams < 1 || num_streams > MAX_STREAMS)
+    {
+        log_error("ERROR: The number of streams must be between 1 and %d\n", MAX_STREAMS);
+        return 1;
+    }
+    if (bench_open(&bench) < 0 || metrics_open(argv[0]) < 0)
+        return 1;
+    log_plain("\n");
+    log_info("Arguments for connection were received successfully\n");
 
     /*----------------------------------------*/
     /*                Main Code               */
     /*----------------------------------------*/
 
-    // Create a TCP socket (IPv4, stream-based, default protocol)
-    int sock = -1;
-    sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0)
-    {
-        perror("socket(2)");
-    }
-    print_time("Sender's TCP socket opened successfully\n");
-
-    // Set congestion control algorithm
-    int scc = setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, algo, strlen(algo) + 1);
-    if (scc != 0)
-    {
-        perror("setsockopt(2)");
-        close(sock);
-        return 1;
-    }
-
     // Set structual data
     struct sockaddr_in receiver;              // A variable that stores the receiver's address.
     memset(&receiver, 0, sizeof(receiver));   // Reset the receiver structure to zeros
@@ -90,127 +201,603 @@ int main(int argc, char *argv[])
     if (inet_pton(AF_INET, receiver_ip, &receiver.sin_addr) <= 0)
     {
         perror("inet_pton(3)");
-        close(sock);
         return 1;
     }
 
-    // Connet to the receiver
-    print_time("Trying to connect  the server with IP: %s, Port: %d, Algo: %s\n", receiver_ip, receiver_port, algo);
-    if (connect(sock, (struct sockaddr *)&receiver, sizeof(receiver)) < 0)
+    // Streams of a striped transfer tell the receiver which session and range they belong to
+    uint32_t session = payload_random_seed();
+
+    // Open every stream (each with its own io_uring engine on that path)
+    Stream streams[MAX_STREAMS];
+    memset(streams, 0, sizeof(streams));
+    int opened = 0;
+    bool failed = false;
+    log_info("Trying to connect  the server with IP: %s, Port: %d, Algo: %s\n", receiver_ip, receiver_port, algo);
+    for (; opened < num_streams && !failed; opened++)
     {
-        perror("connect(2)");
-        close(sock);
+        Stream *stream = &streams[opened];
+        stream->index = opened;
+        stream->mode = mode;
+        stream->engine = (Send_Uring){.ring = {.fd = -1}};
+        stream->sock = stream_connect(&receiver, algo);
+        stream->metrics = metrics_claim(METRICS_TCP_SENDER, "stream=\"%d\"", opened);
+        if (stream->sock < 0)
+            break;
+        if (mode == SEND_URING && send_uring_init(&stream->engine) < 0)
+        {
+            log_error("ERROR: Failed to set up io_uring\n");
+            failed = true;
+        }
+        if (bench.size != DATA_SIZE)
+        {
+            Size_Hello hello = {.size = htobe64(bench.size)};
+            memcpy(hello.magic, SIZE_MAGIC, sizeof(hello.magic));
+            if (send(stream->sock, &hello, sizeof(hello), 0) != sizeof(hello))
+            {
+                perror("send(2)");
+                failed = true;
+            }
+        }
+        if (num_streams > 1)
+        {
+            Stripe_Hello hello = {.session = htonl(session), .index = htons(opened), .count = htons(num_streams)};
+            memcpy(hello.magic, STRIPE_MAGIC, sizeof(hello.magic));
+            if (send(stream->sock, &hello, sizeof(hello), 0) != sizeof(hello))
+            {
+                perror("send(2)");
+                failed = true;
+            }
+        }
+    }
+    if (opened < num_streams || failed)
+    {
+        for (int i = 0; i < opened; i++)
+        {
+            close(streams[i].sock);
+            send_uring_free(&streams[i].engine);
+        }
+        bench_close(&bench);
         return 1;
     }
-    print_time("TCP 3-way handshake completed!\n");
-    print_time("Connection established with %s:%d using %s\n", receiver_ip, receiver_port, algo);
+    log_info("TCP 3-way handshake completed!\n");
+    if (num_streams > 1)
+        log_info("Connection established with %s:%d using %s over %d streams; Send path: %s\n", receiver_ip, receiver_port, algo, num_streams, send_path);
+    else
+        log_info("Connection established with %s:%d using %s; Send path: %s\n", receiver_ip, receiver_port, algo, send_path);
+    log_info("Payload seed: 0x%016llx (generator: %s); Run size: %llu bytes\n", (unsigned long long)seed, payload_kernel(), (unsigned long long)bench.size);
+    if (!bench.interactive)
+    {
+        if (bench.duration > 0)
+            log_info("Benchmark mode: %d warm-up run(s), then %d run(s) or until %g s have passed\n", bench.warmup, bench.runs, bench.duration);
+        else
+            log_info("Benchmark mode: %d warm-up run(s), then %d run(s)\n", bench.warmup, bench.runs);
+    }
 
     int file_count = 0;
     long total_bytes_sent;
     char decision = 'y'; 
     int runs = 1;
+    long total_syscalls = 0;                    // System calls spent sending across all runs
+    long total_data_sent = 0;                   // Bytes sent across all runs
+    double total_cpu_ms = 0;                    // CPU time (user + system) spent sending across all runs
+    double total_ms = 0;                        // Wall time spent sending across all runs
 
     // Main loop for sendings data
     while(decision == 'y' || decision == 'Y')
     {
         total_bytes_sent = 0; 
         char filename[256];
-        sprintf(filename, "Generate_File_%d.txt", ++file_count);
-
-        // Generate a 2MB file with random data
-        util_generate_random_data_file(filename, DATA_SIZE); 
-
-        // Open the file
-        FILE* file = fopen(filename, "rb");
-        if (!file)
+        sprintf(filename, "Generate_File_%d_%d.txt", (int)getpid(), ++file_count);     // Per process: other senders may share the directory
+        uint64_t run_seed = payload_run_seed(seed, file_count);
+
+        // Generate the run's file with random data (the pipelined path generates it while sending instead)
+        uint64_t start, end;
+        bool warmup = bench_is_warmup(&bench, runs);
+        start = timing_now_ns();
+        if (mode != SEND_PIPE && payload_write_file(filename, bench.size, run_seed) < 0)
         {
-            perror("Failed to open file");
+            failed = true;
             break;
         }
+        end = timing_now_ns();
 
-        // Send the file
-        char buffer[4096];
-        int bytes_read;
+        log_plain("----------------- run #%d%s ------------------\n", runs, warmup ? " (warm-up)" : "");
+        if (mode != SEND_PIPE)
+            log_info("Payload generated into '%s' in %.3f ms, before sending\n", filename, timing_ms(start, end));
 
-        printf("----------------- run #%d ------------------\n", runs);
-
-        // Secondary loop to handle sending all data as segments
-        while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) 
+        // Split the file into one byte range per stream
+        for (int i = 0; i < num_streams; i++)
         {
+            streams[i].filename = filename;
+            streams[i].seed = run_seed;
+            streams[i].offset = (long)bench.size * i / num_streams;
+            streams[i].length = (long)bench.size * (i + 1) / num_streams - streams[i].offset;
+            streams[i].syscalls = 0;
+        }
 
-            // Try to send the data to the receiver
-            int bytes_sent = send(sock, buffer, bytes_read, 0);
-
-            if (bytes_sent < 0)
-            {
-                perror("send(2)");
-                close(sock);
-                return 1;
-            }
-            total_bytes_sent += bytes_sent;
+        // Send the ranges concurrently, measuring the system calls and CPU time of the send path alone
+        long syscalls = 0;
+        long retrans_before, retrans_after;
+        double rtt_ms;
+        struct rusage before, after;
+        bool threaded[MAX_STREAMS];             // A single stream is sent by the main thread
+        tcp_info_sample(streams, num_streams, &retrans_before, &rtt_ms);
+        bench_run_started(&bench, runs);
+        getrusage(RUSAGE_SELF, &before);
+        start = timing_now_ns();
+        for (int i = 0; i < num_streams; i++)
+        {
+            threaded[i] = num_streams > 1 && pthread_create(&streams[i].thread, NULL, stream_send, &streams[i]) == 0;
+            if (!threaded[i])
+                stream_send(&streams[i]);
+        }
+        for (int i = 0; i < num_streams; i++)
+        {
+            if (threaded[i])
+                pthread_join(streams[i].thread, NULL);
+            if (streams[i].sent < 0)
+                failed = true;
+            total_bytes_sent += streams[i].sent;
+            syscalls += streams[i].syscalls;
         }
+        end = timing_now_ns();
+        getrusage(RUSAGE_SELF, &after);
+        if (mode != SEND_PIPE)
+            unlink(filename);                   // Sent: the Receiver verifies the run by its digest, not against this file
+        if (failed)
+            break;
+        tcp_info_sample(streams, num_streams, &retrans_after, &rtt_ms);
+
+        double ms = timing_ms(start, end);
+        double user_ms = cpu_time_ms(&after.ru_utime) - cpu_time_ms(&before.ru_utime);
+        double sys_ms = cpu_time_ms(&after.ru_stime) - cpu_time_ms(&before.ru_stime);
+        total_syscalls += syscalls;
+        total_data_sent += total_bytes_sent;
+        total_cpu_ms += user_ms + sys_ms;
+        total_ms += ms;
+        bench_record(&bench, &(Bench_Record){.role = "sender", .protocol = "tcp", .variant = algo, .connection = 1, .run = runs,
+                                             .warmup = warmup, .bytes = total_bytes_sent, .ms = ms, .rttMs = rtt_ms, .rttP50Ms = -1, .rttP99Ms = -1, .segments = -1,
+                                             .retransmissions = retrans_after - retrans_before, .syscalls = syscalls, .cpuMs = user_ms + sys_ms});
         runs++;
 
-        print_time("Data sent successfully. Sent %d bytes to the receiver!\n", total_bytes_sent);
+        log_info("Data sent successfully. Sent %ld bytes to the receiver!\n", total_bytes_sent);
+        if (num_streams > 1)
+        {
+            for (int i = 0; i < num_streams; i++)
+                log_info("Stream #%d: %ld bytes in %.3f ms (%.3f Mbit/s)\n", i + 1, streams[i].sent, streams[i].ms,
+                         streams[i].ms > 0 ? streams[i].sent * 8 / 1e6 / (streams[i].ms / 1000.0) : 0.0);
+            log_info("Aggregate: %ld bytes over %d streams in %.3f ms (%.3f Mbit/s)\n", total_bytes_sent, num_streams, ms,
+                     ms > 0 ? total_bytes_sent * 8 / 1e6 / (ms / 1000.0) : 0.0);
+        }
+        log_info("Send path %s: %ld system calls (%.1f bytes/call); CPU time: %.3f ms user, %.3f ms system\n",
+                 send_path, syscalls, syscalls ? (double)total_bytes_sent / syscalls : 0.0, user_ms, sys_ms);
+        if (mode == SEND_PIPE)
+        {
+            double produce_ms = 0;
+            for (int i = 0; i < num_streams; i++)
+                produce_ms += streams[i].pipeline.produceMs;
+            log_info("Producer threads spent %.3f ms generating the payload, overlapped with sending\n", produce_ms);
+        }
+        log_info("TCP retransmissions: %ld; RTT: %.3f ms\n", retrans_after - retrans_before, rtt_ms);
+
+        // Ask for another run, unless the benchmark plan decides
+        if (bench.interactive && !warmup)
+        {
+            log_info("Do you want to send another file? (y/n): ");
+            log_flush();                    // The question is on the terminal before the answer is read
+            scanf(" %c", &decision);
+        }
+        else if (!bench_next(&bench, runs - 1))
+        {
+            decision = 'n';
+        }
 
-        print_time("Do you want to send another file? (y/n): ");
-        scanf(" %c", &decision);
-        
     }
 
-    // Send an exit messenge to the receiver
-    int exit = send(sock, "EXIT", 4, 0);
-    if (exit < 0)
+    // Send an exit messenge to the receiver on every stream
+    for (int i = 0; i < num_streams && !failed; i++)
     {
-        perror("Failed to send exit messenge");
+        if (send(streams[i].sock, "EXIT", 4, 0) < 0)
+            perror("Failed to send exit messenge");
     }
-    else
+    if (!failed)
     {
-        printf("--------------------------------------------\n");
-        print_time("Sending exit messenge to close the connection...\n");
+        log_plain("--------------------------------------------\n");
+        log_info("Sending exit messenge to close the connection...\n");
     }
 
-    close(sock);
-    print_time("Connection closed\n");
+    // Summary of the send path across all runs
+    if (num_streams > 1)
+    {
+        for (int i = 0; i < num_streams; i++)
+            log_info("Stream #%d: %ld bytes in %.3f ms (%.3f Mbit/s)\n", i + 1, streams[i].totalSent, streams[i].totalMs,
+                     streams[i].totalMs > 0 ? streams[i].totalSent * 8 / 1e6 / (streams[i].totalMs / 1000.0) : 0.0);
+        log_info("Aggregate: %ld bytes over %d streams in %.3f ms (%.3f Mbit/s)\n", total_data_sent, num_streams, total_ms,
+                 total_ms > 0 ? total_data_sent * 8 / 1e6 / (total_ms / 1000.0) : 0.0);
+    }
+    log_info("Send path %s: %ld bytes in %ld system calls (%.1f bytes/call); CPU time: %.3f ms (%.3f ms per MB)\n",
+             send_path, total_data_sent, total_syscalls, total_syscalls ? (double)total_data_sent / total_syscalls : 0.0,
+             total_cpu_ms, total_data_sent ? total_cpu_ms / (total_data_sent / 1048576.0) : 0.0);
 
-    return 0;
+    for (int i = 0; i < num_streams; i++)
+    {
+        close(streams[i].sock);
+        send_uring_free(&streams[i].engine);
+        pipeline_free(&streams[i].pipeline);
+    }
+    bench_close(&bench);
+    log_info("Connection closed\n");
+
+    return failed ? 1 : 0;
 }
 
 /*----------------------------------------*/
 /*          Auxiliary functions           */
 /*----------------------------------------*/
 
-/* Utility function to generate a file with random data */
-void util_generate_random_data_file(const char* filename, unsigned int size)
+/* Open a stream: a TCP socket using "algo", connected  */
+/* to the receiver. Returns the socket, or -1 on error  */
+int stream_connect(const struct sockaddr_in *receiver, const char *algo)
+{
+    // Create a TCP socket (IPv4, stream-based, default protocol)
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        perror("socket(2)");
+        return -1;
+    }
+
+    // Set congestion control algorithm
+    if (setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, algo, strlen(algo) + 1) != 0)
+    {
+        perror("setsockopt(2)");
+        close(sock);
+        return -1;
+    }
+
+    // Connet to the receiver
+    if (connect(sock, (struct sockaddr *)receiver, sizeof(*receiver)) < 0)
+    {
+        perror("connect(2)");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* Thread of a stream: send its range of the run's file */
+/* (or of the payload, generated on the pipelined path) */
+/* followed by the range's digest, and time it          */
+void *stream_send(void *arg)
+{
+    Stream *stream = arg;
+    uint64_t start = timing_now_ns();
+    Digest digest;
+
+    digest_init(&digest, 0);
+    if (stream->mode == SEND_PIPE)
+        stream->sent = send_pipeline(stream->sock, &stream->pipeline, stream->seed, stream->offset, stream->length, &stream->syscalls, stream->metrics, &digest);
+    else
+        stream->sent = send_file(stream->sock, stream->filename, stream->offset, stream->length, stream->mode, &stream->engine, &stream->syscalls, stream->metrics, &digest);
+    if (stream->sent == stream->length)
+    {
+        // The trailer lets the receiver verify the range without the file
+        uint64_t trailer = htobe64(digest_final(&digest));
+        stream->syscalls++;
+        if (send(stream->sock, &trailer, sizeof(trailer), 0) != sizeof(trailer))
+        {
+            perror("send(2): digest");
+            stream->sent = -1;
+        }
+    }
+    stream->ms = timing_ms(start, timing_now_ns());
+    if (stream->sent > 0)
+    {
+        metrics_add(stream->metrics, METRIC_RUNS, 1);
+        stream->totalSent += stream->sent;
+        stream->totalMs += stream->ms;
+    }
+    return NULL;
+}
+
+/* Send "length" bytes of a file, from "offset", over  */
+/* the socket by the chosen path, adding them to        */
+/* "digest". Returns the bytes sent, or -1 on error;    */
+/* "syscalls" counts the read/send/sendfile/splice/     */
+/* io_uring_enter calls it took                         */
+long send_file(int sock, const char *filename, long offset, long length, Send_Mode mode, Send_Uring *engine, long *syscalls, Metrics_Block *metrics, Digest *digest)
 {
-    FILE* file = fopen(filename, "wb");
-    if (!file) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
         perror("Failed to open file");
-        exit(1); // Exit if file cannot be opened
+        return -1;
     }
+    long end = offset + length;
 
-    srand(time(NULL)); // Randomize seed for the random number generator
-    for (unsigned int i = 0; i < size; i++) 
+    long sent = 0;
+    if (mode == SEND_COPY)
+    {
+        // Two copies per byte: page cache -> buffer -> socket
+        char buffer[COPY_BUFFER_SIZE];
+        ssize_t bytes_read;
+        while (offset < end && ((*syscalls)++, (bytes_read = pread(fd, buffer, (end - offset < COPY_BUFFER_SIZE) ? end - offset : COPY_BUFFER_SIZE, offset)) > 0))
+        {
+            offset += bytes_read;
+            digest_update(digest, buffer, bytes_read);  // Hashed while it is hot in the buffer
+            for (ssize_t done = 0; done < bytes_read; )
+            {
+                ssize_t bytes_sent = send(sock, buffer + done, bytes_read - done, 0);
+                (*syscalls)++;
+                if (bytes_sent < 0)
+                {
+                    perror("send(2)");
+                    close(fd);
+                    return -1;
+                }
+                done += bytes_sent;
+                sent += bytes_sent;
+                stream_metrics(metrics, sock, bytes_sent);
+            }
+        }
+    }
+    else if (mode == SEND_SENDFILE)
+    {
+        // The kernel moves the pages from the page cache into the socket
+        off_t position = offset;
+        while (position < end)
+        {
+            ssize_t bytes_sent = sendfile(sock, fd, &position, end - position);
+            (*syscalls)++;
+            if (bytes_sent <= 0)
+            {
+                perror("sendfile(2)");
+                close(fd);
+                return -1;
+            }
+            sent += bytes_sent;
+            stream_metrics(metrics, sock, bytes_sent);
+        }
+    }
+    else if (mode == SEND_URING)
+    {
+        sent = send_file_uring(sock, fd, offset, length, engine, syscalls, metrics);
+    }
+    else
     {
-        unsigned char random_byte = rand() % 256;
-        fwrite(&random_byte, 1, 1, file);
+        // File pages are spliced into a pipe, and the pipe into the socket
+        int pipefd[2];
+        if (pipe(pipefd) < 0)
+        {
+            perror("pipe(2)");
+            close(fd);
+            return -1;
+        }
+        fcntl(pipefd[1], F_SETPIPE_SZ, SPLICE_CHUNK);   // Room for a whole chunk per splice
+
+        loff_t position = offset;
+        while (sent >= 0 && position < end)
+        {
+            ssize_t in_pipe = splice(fd, &position, pipefd[1], NULL, (end - position < SPLICE_CHUNK) ? end - position : SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+            (*syscalls)++;
+            if (in_pipe <= 0)
+            {
+                perror("splice(2)");
+                sent = -1;
+            }
+
+            // Drain the pipe into the socket
+            while (sent >= 0 && in_pipe > 0)
+            {
+                ssize_t bytes_sent = splice(pipefd[0], NULL, sock, NULL, in_pipe, SPLICE_F_MOVE | SPLICE_F_MORE);
+                (*syscalls)++;
+                if (bytes_sent <= 0)
+                {
+                    perror("splice(2)");
+                    sent = -1;
+                    break;
+                }
+                in_pipe -= bytes_sent;
+                sent += bytes_sent;
+                stream_metrics(metrics, sock, bytes_sent);
+            }
+        }
+        close(pipefd[0]);
+        close(pipefd[1]);
     }
 
-    fclose(file);
+    // The zero-copy paths never bring the data to user space: hash the range from the page cache
+    if (mode != SEND_COPY && sent == length && digest_file_range(fd, end - length, length, digest) < 0)
+        sent = -1;
+
+    close(fd);
+    return sent;
 }
 
-/*This fucntions helps to show time while printing to terminal*/
-void print_time(const char *format, ...)
+/* Pipelined send path: a producer thread generates     */
+/* the range into the stream's ring of PIPE_SLOTS       */
+/* buffers while this thread hashes and sends every     */
+/* slot it published, so producing and sending the run  */
+/* overlap. Returns the bytes sent, or -1 on error       */
+long send_pipeline(int sock, Pipeline *pipeline, uint64_t seed, long offset, long length, long *syscalls, Metrics_Block *metrics, Digest *digest)
 {
-    char formatted_time[9]; // Buffer for HH:MM:SS format
-    va_list args;
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now); // Take current time
+    if (pipeline_start(pipeline, PIPE_SLOTS, PIPE_SLOT_SIZE, seed, offset, length) < 0)
+        return -1;
+    Ring *ring = &pipeline->ring;
 
-    strftime(formatted_time, sizeof(formatted_time), "%H:%M:%S", tm_info); // Format current time to HH:MM:SS
+    long sent = 0;
+    for (uint32_t seq = 0; sent >= 0 && ring_wait(ring, seq); seq++)
+    {
+        size_t size;
+        char *slot = ring_slot(ring, seq, &size);
+        digest_update(digest, slot, size);
+        for (size_t done = 0; done < size; )
+        {
+            ssize_t bytes_sent = send(sock, slot + done, size - done, 0);
+            (*syscalls)++;
+            if (bytes_sent < 0)
+            {
+                perror("send(2)");
+                sent = -1;
+                break;
+            }
+            done += bytes_sent;
+            sent += bytes_sent;
+            stream_metrics(metrics, sock, bytes_sent);
+        }
+        ring_release(ring, seq + 1);        // The slot goes back to the producer
+    }
 
-    va_start(args, format);          // Start processing variable arguments
-    printf("[%s] ", formatted_time); // Print the current time prefix
-    vprintf(format, args);           // Print the rest of the message with format and args
-    va_end(args);                    // Clean up
+    pipeline_finish(pipeline);
+    return sent;
 }
+
+/* Add a range of a file to a digest, through a         */
+/* read-only mapping. Returns 0 on success, -1 on error */
+int digest_file_range(int fd, long offset, long length, Digest *digest)
+{
+    if (length == 0)
+        return 0;
+    long skip = offset % sysconf(_SC_PAGESIZE);     // Mappings start on a page boundary
+    char *map = mmap(NULL, length + skip, PROT_READ, MAP_SHARED, fd, offset - skip);
+    if (map == MAP_FAILED)
+    {
+        perror("mmap(2)");
+        return -1;
+    }
+    digest_update(digest, map + skip, length);
+    munmap(map, length + skip);
+    return 0;
+}
+
+/* io_uring send path: every chunk is a fixed-buffer     */
+/* read linked to a send of the same buffer, and up to  */
+/* URING_DEPTH pairs are chained (so the stream stays   */
+/* in order) and submitted with one io_uring_enter(2)   */
+long send_file_uring(int sock, int fd, long offset, long length, Send_Uring *engine, long *syscalls, Metrics_Block *metrics)
+{
+    IO_Uring *ring = &engine->ring;
+    long enterBefore = ring->enterCalls;
+    long size = offset + length, sent = 0;
+
+    while (offset < size)
+    {
+        // Chain read(i) -> send(i) -> read(i+1) -> ... for the next URING_DEPTH chunks
+        int requests = 0;
+        for (int i = 0; i < URING_DEPTH && offset < size; i++)
+        {
+            unsigned length = (size - offset < URING_CHUNK) ? size - offset : URING_CHUNK;
+            char *buffer = engine->buffers + i * URING_CHUNK;
+
+            struct io_uring_sqe *sqe = uring_get_sqe(ring);
+            uring_prep_read_fixed(sqe, fd, buffer, length, offset, i);
+            sqe->flags |= IOSQE_IO_LINK;
+            sqe->user_data = length;
+
+            sqe = uring_get_sqe(ring);
+            uring_prep_send(sqe, sock, buffer, length, MSG_WAITALL);
+            sqe->flags |= IOSQE_IO_LINK;
+            sqe->user_data = length;
+
+            offset += length;
+            requests += 2;
+        }
+
+        // Submit the chain and wait for all of it in one system call
+        if (uring_submit(ring, requests) < 0)
+            return -1;
+
+        // Every read and send must have moved its whole chunk
+        bool failed = false;
+        for (int i = 0; i < requests; i++)
+        {
+            struct io_uring_cqe *cqe = uring_wait_cqe(ring);
+            if (cqe == NULL)
+                return -1;
+            if (cqe->res != (int)cqe->user_data)
+            {
+                if (!failed)
+                    log_error("io_uring: request failed (%s)\n", cqe->res < 0 ? strerror(-cqe->res) : "short transfer");
+                failed = true;
+            }
+            else if (i % 2 == 1)
+            {
+                sent += cqe->res;
+                stream_metrics(metrics, sock, cqe->res);
+            }
+            uring_cqe_seen(ring);
+        }
+        if (failed)
+            return -1;
+    }
+
+    *syscalls += ring->enterCalls - enterBefore;
+    return sent;
+}
+
+/* Set up a ring for the io_uring send path and        */
+/* register its buffers. Returns 0 on success, -1 on    */
+/* failure                                              */
+int send_uring_init(Send_Uring *engine)
+{
+    struct iovec registered[URING_DEPTH];
+
+    engine->buffers = aligned_alloc(4096, URING_DEPTH * URING_CHUNK);
+    if (engine->buffers == NULL || uring_init(&engine->ring, 2 * URING_DEPTH) < 0)
+    {
+        free(engine->buffers);
+        engine->buffers = NULL;
+        return -1;
+    }
+    for (int i = 0; i < URING_DEPTH; i++)
+        registered[i] = (struct iovec){engine->buffers + i * URING_CHUNK, URING_CHUNK};
+    if (uring_register_buffers(&engine->ring, registered, URING_DEPTH) < 0)
+    {
+        send_uring_free(engine);
+        return -1;
+    }
+    return 0;
+}
+
+/* Release the ring and buffers of the io_uring path    */
+void send_uring_free(Send_Uring *engine)
+{
+    if (engine->ring.fd >= 0)
+        uring_free(&engine->ring);
+    free(engine->buffers);
+    engine->buffers = NULL;
+}
+
+/* Sample TCP_INFO of the streams: the retransmissions */
+/* of all of them so far and the smoothed RTT of the    */
+/* first one                                            */
+void tcp_info_sample(const Stream *streams, int count, long *retransmissions, double *rtt_ms)
+{
+    *retransmissions = 0;
+    *rtt_ms = -1;
+    for (int i = 0; i < count; i++)
+    {
+        struct tcp_info info;
+        socklen_t length = sizeof(info);
+        if (getsockopt(streams[i].sock, IPPROTO_TCP, TCP_INFO, &info, &length) < 0)
+            continue;
+        *retransmissions += info.tcpi_total_retrans;
+        if (i == 0)
+            *rtt_ms = info.tcpi_rtt / 1000.0;
+    }
+}
+
+/* Count bytes just sent in the stream's live metrics,  */
+/* refreshing its TCP_INFO gauges now and then          */
+void stream_metrics(Metrics_Block *metrics, int sock, long bytes)
+{
+    metrics_add(metrics, METRIC_BYTES, bytes);
+    metrics_tcp_info(metrics, sock);
+}
+
+/* Convert a CPU time from getrusage(2) to milliseconds */
+double cpu_time_ms(const struct timeval *tv)
+{
+    return tv->tv_sec * 1000.0 + tv->tv_usec / 1000.0;
+}
+
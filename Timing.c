@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <linux/net_tstamp.h>
+#include "Timing.h"
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#define TIMING_CALIBRATION_NS 10000000  // TSC calibration window (10 ms, once per process)
+#define TIMING_SHIFT 32                 // Fixed-point fraction bits of the cycles-to-ns factor
+
+static pthread_once_t timingOnce = PTHREAD_ONCE_INIT;
+static int useTsc;                      // Set when the clock is the calibrated TSC
+static uint64_t baseCycles;             // TSC at the end of the calibration
+static uint64_t baseNs;                 // CLOCK_MONOTONIC_RAW at the end of the calibration
+static uint64_t nsPerCycle;             // Nanoseconds per cycle, shifted left by TIMING_SHIFT
+
+
+/********************************************************/
+/* CLOCK_MONOTONIC_RAW in nanoseconds                   */
+/********************************************************/
+static uint64_t timing_raw_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+#if defined(__x86_64__)
+/********************************************************/
+/* Whether the TSC ticks at a constant rate in every    */
+/* power state (CPUID 0x80000007, EDX bit 8) and the    */
+/* kernel keeps it as its clocksource, i.e. found it    */
+/* synchronized across the CPUs                         */
+/********************************************************/
+static int timing_tsc_usable(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8)))
+        return 0;
+
+    char source[32] = "";
+    FILE *file = fopen("/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+    if (file == NULL)
+        return 0;
+    if (fgets(source, sizeof(source), file) == NULL)
+        source[0] = '\0';
+    fclose(file);
+    return strncmp(source, "tsc\n", 4) == 0;
+}
+#endif
+
+/********************************************************/
+/* Pick the clock once per process; the TSC is measured */
+/* against CLOCK_MONOTONIC_RAW over a short busy wait   */
+/********************************************************/
+static void timing_init(void)
+{
+#if defined(__x86_64__)
+    if (!timing_tsc_usable())
+        return;
+
+    uint64_t startNs = timing_raw_ns();
+    uint64_t startCycles = __rdtsc();
+    uint64_t endNs, endCycles;
+    do
+    {
+        endNs = timing_raw_ns();
+        endCycles = __rdtsc();
+    } while (endNs - startNs < TIMING_CALIBRATION_NS);
+    if (endCycles <= startCycles)
+        return;
+
+    nsPerCycle = (uint64_t)(((unsigned __int128)(endNs - startNs) << TIMING_SHIFT) / (endCycles - startCycles));
+    baseCycles = endCycles;
+    baseNs = endNs;
+    useTsc = nsPerCycle > 0;
+#endif
+}
+
+/********************************************************/
+/* Current time in nanoseconds on the shared monotonic  */
+/* clock. Only differences between two readings are     */
+/* meaningful                                           */
+/********************************************************/
+uint64_t timing_now_ns(void)
+{
+    pthread_once(&timingOnce, timing_init);
+#if defined(__x86_64__)
+    if (useTsc)
+    {
+        uint64_t cycles = __rdtsc() - baseCycles;
+        return baseNs + (uint64_t)(((unsigned __int128)cycles * nsPerCycle) >> TIMING_SHIFT);
+    }
+#endif
+    return timing_raw_ns();
+}
+
+/********************************************************/
+/* Milliseconds between two readings of timing_now_ns() */
+/********************************************************/
+double timing_ms(uint64_t start, uint64_t end)
+{
+    return (double)(int64_t)(end - start) / 1e6;
+}
+
+/********************************************************/
+/* Name of the clock behind timing_now_ns()             */
+/********************************************************/
+const char *timing_source(void)
+{
+    pthread_once(&timingOnce, timing_init);
+    return useTsc ? "TSC" : "CLOCK_MONOTONIC_RAW";
+}
+
+/********************************************************/
+/* Have the kernel stamp every datagram the socket      */
+/* receives (SO_TIMESTAMPING, software stamps taken as  */
+/* the packet enters the stack). Returns 0 on success   */
+/* and -1 if the socket option is unsupported           */
+/********************************************************/
+int timing_enable_rx_timestamps(int sock)
+{
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0)
+    {
+        perror("setsockopt: SO_TIMESTAMPING");
+        return -1;
+    }
+    return 0;
+}
+
+/********************************************************/
+/* If "cmsg" is a SO_TIMESTAMPING stamp (wall clock),   */
+/* store in "arrival" that moment on the shared clock:  */
+/* "now" (a timing_now_ns() reading taken just after    */
+/* the receive) minus the packet's age. Returns 1 if    */
+/* "cmsg" carried a stamp, 0 otherwise                  */
+/********************************************************/
+int timing_rx_timestamp(const struct cmsghdr *cmsg, uint64_t now, uint64_t *arrival)
+{
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SO_TIMESTAMPING)
+        return 0;
+
+    struct timespec stamps[3];          // Software, (deprecated) and hardware stamps
+    memcpy(stamps, CMSG_DATA(cmsg), sizeof(stamps));
+    if (stamps[0].tv_sec == 0 && stamps[0].tv_nsec == 0)
+        return 0;
+
+    struct timespec real;
+    clock_gettime(CLOCK_REALTIME, &real);
+    int64_t age = (int64_t)(real.tv_sec - stamps[0].tv_sec) * 1000000000LL + (real.tv_nsec - stamps[0].tv_nsec);
+    *arrival = age > 0 && (uint64_t)age < now ? now - age : now;
+    return 1;
+}
@@ -0,0 +1,26 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+/*
+ * One clock for every measurement of the four programs: run durations,
+ * per-segment timestamps and the RTO machinery all read timing_now_ns(),
+ * nanoseconds on a monotonic clock that NTP can neither step nor slew.
+ * On x86-64 with an invariant TSC that the kernel itself trusts as its
+ * clocksource, the clock is the TSC, calibrated once against
+ * CLOCK_MONOTONIC_RAW and scaled with a multiply and a shift (no system
+ * call, no vDSO); everywhere else it is CLOCK_MONOTONIC_RAW. A socket may
+ * also have the kernel stamp every datagram as it arrives (SO_TIMESTAMPING):
+ * timing_rx_timestamp() moves such a stamp onto the same clock, so arrival
+ * times exclude the time a packet waited for the receiving thread.
+ */
+
+uint64_t timing_now_ns(void);
+double timing_ms(uint64_t start, uint64_t end);
+const char *timing_source(void);
+int timing_enable_rx_timestamps(int sock);
+int timing_rx_timestamp(const struct cmsghdr *cmsg, uint64_t now, uint64_t *arrival);
+
+#endif